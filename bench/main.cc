@@ -0,0 +1,599 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "lib/crc_factories.h"
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define HAVE_RDTSC 1
+#endif
+
+namespace
+{
+    class arg_error : public std::logic_error
+    {
+        public:
+            arg_error(const std::string &msg) : std::logic_error(msg) { }
+    };
+
+    struct Options
+    {
+        std::vector<uint64_t> sizes;
+        std::vector<size_t> bufferSizes;
+        std::vector<std::string> algorithms;
+        std::string dir;
+        uint64_t maxMemorySize;
+        double minTime;
+        std::string outputPath;
+        std::string baselinePath;
+        double tolerance;
+    };
+
+    struct Result
+    {
+        std::string algorithm;
+        std::string operation;
+        std::string backend;
+        std::string corpus;
+        uint64_t size;
+        size_t bufferSize;
+        uint64_t numRuns;
+        double seconds;
+        double cycles;
+
+        std::string getName() const
+        {
+            std::ostringstream name;
+            name << algorithm << "/" << operation << "/" << backend
+                << "/" << corpus << "/" << size;
+            if (bufferSize)
+                name << "/" << bufferSize;
+            return name.str();
+        }
+
+        double getThroughput() const
+        {
+            return size * numRuns / seconds / 1e9;
+        }
+    };
+
+    void printUsage(std::ostream &s)
+    {
+        s << "CRC manipulator benchmark v" << CRCMANIP_VERSION << "\n";
+        s << R"(
+Measures throughput of every algorithm and prints the results as JSON.
+Usage: crcmanip-bench [OPTIONS]
+
+OPTIONS can be:
+  -s, --sizes LIST     comma separated input sizes; K, M and G suffixes are
+                       accepted (default: 64,4K,1M,64M)
+  -b, --buffers LIST   comma separated buffer sizes used to feed in-memory
+                       data to a checksum stream (default: 4K,64K)
+  -a, --algorithm ALG  comma separated algorithms to measure (default: all)
+  -d, --dir DIR        where to write the on-disk corpora (default: .)
+  -m, --max-memory NUM biggest input to generate in memory; bigger inputs
+                       are only measured on disk (default: 1G)
+  -t, --min-time SECS  how long to repeat each measurement (default: 0.1)
+  -o, --output FILE    where to write the JSON (default: standard output)
+  --baseline FILE      JSON from an earlier run to compare against; exits
+                       with an error if any measurement got slower than
+                       the tolerance allows
+  --tolerance PCT      allowed slowdown against the baseline (default: 20)
+
+Measurements:
+  forward              checksum, read front to back
+  reverse              patch for a checksum at the very start, which reads
+                       the whole input back to front
+  patch-insert         patch inserted in the middle of the input
+  patch-overwrite      patch overwriting the middle of the input
+Each is done on random data in memory (and on zeros for checksums), then on
+a file on disk. In-memory checksums are also measured through the lanes
+kernel, with the input split into four buffers, and through a stream fed
+with each buffer size.
+
+Examples:
+  crcmanip-bench -a CRC32 -s 1M,4G -d /tmp
+  crcmanip-bench -o new.json --baseline old.json --tolerance 10
+)";
+    }
+
+    uint64_t parseSize(const std::string &text)
+    {
+        size_t end;
+        uint64_t size;
+        try
+        {
+            size = std::stoull(text, &end, 10);
+        }
+        catch (std::exception &)
+        {
+            throw arg_error("Bad size: " + text);
+        }
+        auto suffix = text.substr(end);
+        if (suffix == "K" || suffix == "k")
+            size <<= 10;
+        else if (suffix == "M")
+            size <<= 20;
+        else if (suffix == "G")
+            size <<= 30;
+        else if (!suffix.empty())
+            throw arg_error("Bad size: " + text);
+        return size;
+    }
+
+    std::vector<std::string> split(const std::string &text)
+    {
+        std::vector<std::string> parts;
+        std::istringstream stream(text);
+        std::string part;
+        while (std::getline(stream, part, ','))
+            parts.push_back(part);
+        return parts;
+    }
+
+    Options parseOptions(const std::vector<std::string> &args)
+    {
+        Options options;
+        options.sizes = {64, 4 << 10, 1 << 20, 64 << 20};
+        options.bufferSizes = {4 << 10, 64 << 10};
+        options.dir = ".";
+        options.maxMemorySize = 1ull << 30;
+        options.minTime = 0.1;
+        options.tolerance = 20;
+
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            auto arg = args[i];
+            if (i + 1 >= args.size())
+                throw arg_error("Missing value for " + arg);
+            auto value = args[++i];
+
+            if (arg == "-s" || arg == "--sizes")
+            {
+                options.sizes.clear();
+                for (auto &part : split(value))
+                    options.sizes.push_back(parseSize(part));
+            }
+            else if (arg == "-b" || arg == "--buffers")
+            {
+                options.bufferSizes.clear();
+                for (auto &part : split(value))
+                    options.bufferSizes.push_back(parseSize(part));
+                for (auto bufferSize : options.bufferSizes)
+                    if (bufferSize == 0)
+                        throw arg_error("Buffer size must be positive");
+            }
+            else if (arg == "-a" || arg == "--algorithm")
+                options.algorithms = split(value);
+            else if (arg == "-d" || arg == "--dir")
+                options.dir = value;
+            else if (arg == "-m" || arg == "--max-memory")
+                options.maxMemorySize = parseSize(value);
+            else if (arg == "-t" || arg == "--min-time")
+                options.minTime = std::stod(value);
+            else if (arg == "-o" || arg == "--output")
+                options.outputPath = value;
+            else if (arg == "--baseline")
+                options.baselinePath = value;
+            else if (arg == "--tolerance")
+                options.tolerance = std::stod(value);
+            else
+                throw arg_error("Unknown option: " + arg);
+        }
+        return options;
+    }
+
+    /**
+     * Time stamp counter ticks, which track cycles at the nominal
+     * frequency; zero where there's no such counter.
+     */
+    uint64_t readCycles()
+    {
+        #if HAVE_RDTSC
+            return __rdtsc();
+        #else
+            return 0;
+        #endif
+    }
+
+    //keeps the compiler from dropping the measured work
+    volatile CRC::Value sink;
+
+    /**
+     * Runs the work until minTime passes, at least once.
+     */
+    void measure(
+        Result &result,
+        double minTime,
+        const std::function<CRC::Value()> &work)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        result.numRuns = 0;
+        auto startTime = Clock::now();
+        auto startCycles = readCycles();
+        double seconds;
+        do
+        {
+            sink = work();
+            result.numRuns++;
+            seconds = std::chrono::duration<double>(
+                Clock::now() - startTime).count();
+        }
+        while (seconds < minTime);
+        result.cycles = readCycles() - startCycles;
+        result.seconds = seconds;
+    }
+
+    /**
+     * Same pseudo random bytes for every run, so that results compare.
+     */
+    void generateData(uint8_t *data, size_t size, uint64_t &seed)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            data[i] = seed;
+        }
+    }
+
+    void writeCorpus(const std::string &path, uint64_t size)
+    {
+        const size_t ChunkSize = 1 << 20;
+        std::vector<uint8_t> chunk(ChunkSize);
+        uint64_t seed = 0x9E3779B97F4A7C15ull;
+        auto file = File::fromFileName(
+            path, File::Mode::Write | File::Mode::Binary);
+        for (uint64_t pos = 0; pos < size; pos += ChunkSize)
+        {
+            auto chunkSize = std::min<uint64_t>(ChunkSize, size - pos);
+            generateData(chunk.data(), chunkSize, seed);
+            file->write(chunk.data(), chunkSize);
+        }
+    }
+
+    class Benchmark final
+    {
+        public:
+            Benchmark(const Options &options) : options(options) { }
+
+            void runMemory(const CRC &crc, uint64_t size);
+            void runDisk(const CRC &crc, uint64_t size);
+
+            const std::vector<Result> &getResults() const
+            {
+                return results;
+            }
+
+        private:
+            void add(
+                const CRC &crc,
+                const std::string &operation,
+                const std::string &backend,
+                const std::string &corpus,
+                uint64_t size,
+                size_t bufferSize,
+                const std::function<CRC::Value()> &work);
+
+            const Options &options;
+            std::vector<Result> results;
+    };
+
+    void Benchmark::add(
+        const CRC &crc,
+        const std::string &operation,
+        const std::string &backend,
+        const std::string &corpus,
+        uint64_t size,
+        size_t bufferSize,
+        const std::function<CRC::Value()> &work)
+    {
+        Result result;
+        result.algorithm = crc.getSpecs().name;
+        result.operation = operation;
+        result.backend = backend;
+        result.corpus = corpus;
+        result.size = size;
+        result.bufferSize = bufferSize;
+        std::cerr << result.getName() << "\n";
+        measure(result, options.minTime, work);
+        results.push_back(result);
+    }
+
+    void Benchmark::runMemory(const CRC &crc, uint64_t size)
+    {
+        uint64_t seed = 0x9E3779B97F4A7C15ull;
+        std::vector<uint8_t> random(size);
+        generateData(random.data(), size, seed);
+        std::vector<uint8_t> zeros(size);
+        auto data = random.data();
+        auto target = crc.getSpecs().test;
+
+        add(crc, "forward", "table", "memory-random", size, 0, [&]()
+            { return crc.computeChecksum(data, size); });
+        add(crc, "forward", "table", "memory-zeros", size, 0, [&]()
+            { return crc.computeChecksum(zeros.data(), size); });
+
+        //same data as four separate buffers
+        std::vector<const uint8_t*> laneData;
+        std::vector<size_t> laneSizes;
+        for (uint64_t i = 0; i < 4; i++)
+        {
+            laneData.push_back(data + size * i / 4);
+            laneSizes.push_back(size * (i + 1) / 4 - size * i / 4);
+        }
+        add(crc, "forward", "lanes", "memory-random", size, 0, [&]()
+            { return crc.computeChecksums(laneData, laneSizes)[0]; });
+
+        for (auto bufferSize : options.bufferSizes)
+        {
+            add(crc, "forward", "stream", "memory-random", size, bufferSize,
+                [&]()
+                {
+                    CRC::Stream stream(crc);
+                    for (uint64_t pos = 0; pos < size; pos += bufferSize)
+                    {
+                        stream.update(
+                            data + pos,
+                            std::min<uint64_t>(bufferSize, size - pos));
+                    }
+                    return stream.finalize();
+                });
+        }
+
+        add(crc, "reverse", "table", "memory-random", size, 0, [&]()
+            { return crc.computePatch(target, data, size, 0, false)[0]; });
+
+        add(crc, "patch-insert", "table", "memory-random", size, 0, [&]()
+            {
+                return crc.computePatch(
+                    target, data, size, size / 2, false)[0];
+            });
+
+        if (size >= crc.getSpecs().numBytes)
+        {
+            auto position = std::min<uint64_t>(
+                size / 2, size - crc.getSpecs().numBytes);
+            add(crc, "patch-overwrite", "table", "memory-random", size, 0,
+                [&]()
+                {
+                    return crc.computePatch(
+                        target, data, size, position, true)[0];
+                });
+        }
+    }
+
+    void Benchmark::runDisk(const CRC &crc, uint64_t size)
+    {
+        auto inputPath = options.dir + "/crcmanip-bench-input.bin";
+        auto outputPath = options.dir + "/crcmanip-bench-output.bin";
+        auto target = crc.getSpecs().test;
+        auto openInput = [&]()
+            {
+                return File::fromFileName(
+                    inputPath, File::Mode::Read | File::Mode::Binary);
+            };
+        Progress progress;
+
+        writeCorpus(inputPath, size);
+
+        add(crc, "forward", "file", "disk-random", size, 0, [&]()
+            { return crc.computeChecksum(*openInput(), progress); });
+
+        add(crc, "reverse", "file", "disk-random", size, 0, [&]()
+            {
+                auto inputFile = openInput();
+                return crc.computePartPatch(
+                    target, {inputFile.get()}, 0, 0, false, progress);
+            });
+
+        for (auto overwrite : {false, true})
+        {
+            if (overwrite && size < crc.getSpecs().numBytes)
+                continue;
+            auto position = overwrite
+                ? std::min<uint64_t>(size / 2, size - crc.getSpecs().numBytes)
+                : size / 2;
+            add(crc, overwrite ? "patch-overwrite" : "patch-insert", "file",
+                "disk-random", size, 0, [&]()
+                {
+                    auto outputFile = File::fromFileName(
+                        outputPath, File::Mode::Write | File::Mode::Binary);
+                    crc.applyPatch(
+                        target,
+                        position,
+                        *openInput(),
+                        *outputFile,
+                        overwrite,
+                        progress,
+                        progress);
+                    return target;
+                });
+        }
+
+        std::remove(inputPath.c_str());
+        std::remove(outputPath.c_str());
+    }
+
+    void writeJson(std::ostream &s, const std::vector<Result> &results)
+    {
+        s << "{\n";
+        s << "  \"version\": \"" << CRCMANIP_VERSION << "\",\n";
+        s << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const auto &result = results[i];
+            s << "    {"
+                << "\"name\": \"" << result.getName() << "\", "
+                << "\"algorithm\": \"" << result.algorithm << "\", "
+                << "\"operation\": \"" << result.operation << "\", "
+                << "\"backend\": \"" << result.backend << "\", "
+                << "\"corpus\": \"" << result.corpus << "\", "
+                << "\"size\": " << result.size << ", "
+                << "\"bufferSize\": " << result.bufferSize << ", "
+                << "\"runs\": " << result.numRuns << ", "
+                << "\"seconds\": " << result.seconds << ", "
+                << "\"gbps\": " << result.getThroughput() << ", "
+                << "\"cyclesPerByte\": ";
+            if (result.cycles > 0)
+                s << result.cycles / (result.size * result.numRuns);
+            else
+                s << "null";
+            s << (i + 1 < results.size() ? "},\n" : "}\n");
+        }
+        s << "  ]\n";
+        s << "}\n";
+    }
+
+    /**
+     * Reads names and throughputs back from JSON written by writeJson(),
+     * which puts each result on its own line.
+     */
+    std::map<std::string, double> readBaseline(const std::string &path)
+    {
+        std::ifstream stream(path);
+        if (!stream)
+            throw std::runtime_error("Couldn't open baseline " + path);
+
+        const std::string nameKey = "\"name\": \"";
+        const std::string throughputKey = "\"gbps\": ";
+        std::map<std::string, double> baseline;
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            auto namePos = line.find(nameKey);
+            auto throughputPos = line.find(throughputKey);
+            if (namePos == std::string::npos
+                || throughputPos == std::string::npos)
+            {
+                continue;
+            }
+            namePos += nameKey.size();
+            auto name = line.substr(namePos, line.find('"', namePos) - namePos);
+            baseline[name] = std::stod(
+                line.substr(throughputPos + throughputKey.size()));
+        }
+        return baseline;
+    }
+
+    /**
+     * Returns the number of measurements slower than the baseline allows.
+     */
+    size_t compareWithBaseline(
+        const std::vector<Result> &results,
+        const std::map<std::string, double> &baseline,
+        double tolerance)
+    {
+        size_t numRegressions = 0;
+        for (const auto &result : results)
+        {
+            auto it = baseline.find(result.getName());
+            if (it == baseline.end())
+                continue;
+            auto throughput = result.getThroughput();
+            if (throughput < it->second * (1.0 - tolerance / 100.0))
+            {
+                std::cerr << "Regression: " << result.getName() << ": "
+                    << throughput << " GB/s, was " << it->second << " GB/s\n";
+                numRegressions++;
+            }
+        }
+        return numRegressions;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+        args.push_back(std::string(argv[i]));
+
+    for (auto &arg : args)
+    {
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage(std::cout);
+            return 0;
+        }
+    }
+
+    try
+    {
+        Options options;
+        try
+        {
+            options = parseOptions(args);
+        }
+        catch (arg_error &e)
+        {
+            std::cerr << e.what() << "\n\n";
+            printUsage(std::cerr);
+            return 1;
+        }
+
+        std::vector<std::shared_ptr<CRC>> crcs;
+        for (auto &crc : createAllCRC())
+        {
+            if (options.algorithms.empty()
+                || std::find(
+                    options.algorithms.begin(),
+                    options.algorithms.end(),
+                    crc->getSpecs().name) != options.algorithms.end())
+            {
+                crcs.push_back(crc);
+            }
+        }
+        if (crcs.size() < std::max<size_t>(options.algorithms.size(), 1))
+            throw std::runtime_error("Unknown algorithm");
+
+        Benchmark benchmark(options);
+        for (auto &crc : crcs)
+        {
+            for (auto size : options.sizes)
+            {
+                if (size <= options.maxMemorySize)
+                    benchmark.runMemory(*crc, size);
+                benchmark.runDisk(*crc, size);
+            }
+        }
+
+        if (options.outputPath.empty())
+            writeJson(std::cout, benchmark.getResults());
+        else
+        {
+            std::ofstream output(options.outputPath);
+            if (!output)
+                throw std::runtime_error("Couldn't open output file");
+            writeJson(output, benchmark.getResults());
+        }
+
+        if (!options.baselinePath.empty())
+        {
+            auto numRegressions = compareWithBaseline(
+                benchmark.getResults(),
+                readBaseline(options.baselinePath),
+                options.tolerance);
+            if (numRegressions > 0)
+            {
+                std::cerr << numRegressions << " measurements regressed\n";
+                return 1;
+            }
+        }
+        return 0;
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -1,10 +1,25 @@
 #include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <vector>
+#include "lib/checksum_state.h"
 #include "lib/crc_factories.h"
 #include "lib/file.h"
+#include "lib/profile.h"
+#include "lib/progress.h"
+#include "lib/server.h"
+#include "lib/sfv.h"
+#include "lib/small_files.h"
+#include "lib/stats.h"
+#include "lib/tune.h"
 #include "lib/util.h"
 
 namespace
@@ -46,40 +61,134 @@ namespace
             bool on;
     };
 
-    void printUsage(std::ostream &s, std::vector<std::shared_ptr<CRC>> crcs)
+    /**
+     * Prints progress of given work as it gets sampled by an observer.
+     */
+    void showProgress(Progress &progress)
+    {
+        progress.changed = [&progress](double percentage)
+            {
+                static const char *phaseNames[] =
+                    {"", "prefix", "suffix", "copy"};
+                std::ostringstream line;
+                line << std::left
+                    << std::setw(7)
+                    << phaseNames[static_cast<int>(progress.getPhase())]
+                    << std::right
+                    << std::setw(6)
+                    << std::fixed
+                    << std::setprecision(2)
+                    << percentage
+                    << "% done\r";
+                std::cout << line.str();
+                std::cout.flush();
+            };
+    }
+
+    void printUsage(std::ostream &s)
     {
         s << "CRC manipulator v" << CRCMANIP_VERSION << "\n";
         s << R"(
 Freely reverse and change CRC checksums through smart file patching.
 Usage: crcmanip p[atch] INFILE OUTFILE CHECKSUM [PATCH_OPTIONS]
-   or: crcmanip c[alc]  INFILE [CALC_OPTIONS]
+   or: crcmanip p[atch] INFILE OUTDIR --targets LIST [PATCH_OPTIONS]
+   or: crcmanip c[alc]  INFILE... [CALC_OPTIONS]
+   or: crcmanip f[ind]  INFILE FIND_OPTIONS
+   or: crcmanip t[une]  [DIR] [TUNE_OPTIONS]
+   or: crcmanip serve   --socket PATH [SERVE_OPTIONS]
+   or: crcmanip sfv     create INFILE... [SFV_OPTIONS] > LIST.sfv
+   or: crcmanip sfv     verify LIST.sfv [SFV_OPTIONS]
    or: crcmanip h[elp]
 
 Common options:
-  INFILE               path to input file
+  INFILE               path to input file; calc takes many of them and
+                       prints each checksum along with the file name
   OUTFILE              path to output file
+  OUTDIR               path to existing directory for batch outputs
   CHECKSUM             target checksum; must be a hexadecimal value
+  --nocache            keep data read and written out of the page cache,
+                       so that bulk runs don't evict other programs' data
+  --stats[=json]       print where the time of calc or patch went, per
+                       phase, along with file operation counts, to stderr
 
 PATCH_OPTIONS can be:
-  -a, --algorithm ALG  which algorithm to use
+  -a, --algorithm ALG  which algorithm to use; several comma separated
+                       algorithms can be patched at once, given as many
+                       comma separated checksums
   -i, --insert         specifies that patch should be inserted (default)
   -o, --overwrite      specifies that patch should overwrite existing bytes
+  --verify             checksum the output as it's written and remove it
+                       if it doesn't match CHECKSUM; costs no extra reads
   -p, --position NUM   position where to append the patch; unless specified,
                        patch will be placed at the end of the input file;
                        if position is negative, patch will be placed at the
                        n-th byte from the end of file
+  -c, --charset SET    use only bytes from SET in the patch, which makes it
+                       longer; SET is printable, alnum, hex, base64 or a
+                       list of characters and ranges such as a-z0-9_
+  -r, --region OFF:LEN[:MASK]
+                       instead of inserting a patch, change only bits of
+                       existing bytes within given region; can be given
+                       many times; MASK is a hexadecimal mask of bits that
+                       may change in each byte (FF by default)
+  -t, --targets LIST   patch for every checksum listed in LIST (one per
+                       line) at once; outputs are named CHECKSUM_INFILE
+  -v, --volumes LIST   treat INFILE as one of comma separated volumes of a
+                       split file, so that the checksum of all volumes
+                       joined together matches CHECKSUM; only INFILE is
+                       patched and the rest are left intact
 
 CALC_OPTIONS can be:
   -a, --algorithm ALG  which algorithm to use
+  -s, --state FILE     keep the running checksum in FILE; on the next run,
+                       only the bytes appended since then are read
+  -m, --mask OFF:LEN[:zero|skip]
+                       treat given range as zeros (default), or leave it
+                       out of the checksum entirely; can be given many times
+
+FIND_OPTIONS can be:
+  -w, --window NUM     size of the sliding window in bytes
+  --crc CHECKSUM       prints offset of every window with this checksum
+  -a, --algorithm ALG  which algorithm to use
+
+SERVE_OPTIONS can be:
+  --socket PATH        Unix socket to take calc and patch requests on; the
+                       engines stay built between requests (see README)
+  -j, --jobs NUM       how many requests may run at once (a core each by
+                       default); clients with requests waiting take turns
+
+SFV_OPTIONS can be:
+  -j, --jobs NUM       how many files to read at once (a core each by
+                       default); the biggest files go first
+  --fail-fast          stop verifying at the first file that doesn't match
+  --cache FILE         (create only) remember the checksums in FILE; on
+                       the next run, files that only grew are read past
+                       their old end, other files are read whole
+
+Instead of ALG, calc, patch and find can use a custom algorithm:
+  --poly HEX           polynomial without the top bit, e.g. 1021
+  --width NUM          width in bits: 8, 16, 24 or 32 (32 by default)
+  --init HEX           initial register value (0 by default)
+  --xorout HEX         value XORed with the final register (0 by default)
+  --refin BOOL         whether input and output are reflected, true or
+                       false (false by default)
+
+TUNE_OPTIONS can be:
+  DIR                  directory on the filesystem to tune; it needs about
+                       64 MB of free space (current directory by default)
+  --profile FILE       where to keep the results; by default it's
+                       $CRCMANIP_PROFILE or ~/.crcmanip-profile, which every
+                       later run reads on startup
 
 Available ALG aglorithms:
 )";
 
         const size_t maxChecksumSize = 8;
+        auto allSpecs = getBuiltinSpecs();
         size_t maxNameSize = 0;
-        for (auto &crc : crcs)
-            if (maxNameSize < crc->getSpecs().name.size())
-                maxNameSize = crc->getSpecs().name.size();
+        for (auto &specs : allSpecs)
+            if (maxNameSize < specs.name.size())
+                maxNameSize = specs.name.size();
 
         std::ios oldState(nullptr);
         oldState.copyfmt(s);
@@ -93,13 +202,12 @@ Available ALG aglorithms:
             << "\n";
 
         bool isDefault = true;
-        for (auto &crc : crcs)
+        for (auto &specs : allSpecs)
         {
-            const auto &specs = crc->getSpecs();
             auto fill = std::string(maxChecksumSize - specs.numBytes * 2, ' ');
             s.copyfmt(oldState);
             s << "  "
-                << std::setw(maxNameSize) << std::left << crc->getSpecs().name
+                << std::setw(maxNameSize) << std::left << specs.name
                 << " | " << fill << hex(specs.polynomial, specs.numBytes * 2)
                 << "  " << fill << hex(specs.initialXOR, specs.numBytes * 2)
                 << "  " << fill << hex(specs.finalXOR, specs.numBytes * 2)
@@ -121,10 +229,65 @@ Available ALG aglorithms:
 Examples:
   ./crcmanip p input.txt output.txt 1234abcd
   ./crcmanip patch input.txt output.txt 1234abcd -p -1
+  ./crcmanip patch input.txt output.txt 1234abcd --verify
+  ./crcmanip patch input.txt outdir --targets checksums.txt
+  ./crcmanip patch input.txt output.txt 1234abcd,5678 -a CRC32,CRC16IBM
+  ./crcmanip patch config.ini output.ini 1234abcd --charset printable
+  ./crcmanip patch image.bin output.bin 1234abcd -r 16:8 -r -64:64:0F
+  ./crcmanip patch a.003 out.003 1234abcd -v a.001,a.002,a.003
+  ./crcmanip patch big.iso out.iso 1234abcd --stats=json
   ./crcmanip calc input.txt -a CRC16IBM
+  ./crcmanip calc journal.log --state journal.crc
+  ./crcmanip calc archive.bin --mask 8:4 --mask -16:16:skip
+  ./crcmanip calc *.txt -a CRC16IBM
+  ./crcmanip calc input.txt --poly 1021 --width 16 --init FFFF
+  ./crcmanip find dump.bin --window 4096 --crc 1234abcd
+  ./crcmanip tune /mnt/nas
+  ./crcmanip serve --socket /run/crcmanip.sock
+  ./crcmanip sfv create *.rar > release.sfv
+  ./crcmanip sfv create *.log --cache ~/.logs.crc > logs.sfv
+  ./crcmanip sfv verify release.sfv
 )";
     }
 
+    std::vector<std::string> split(const std::string &str, char separator)
+    {
+        std::vector<std::string> parts;
+        std::istringstream stream(str);
+        std::string part;
+        while (std::getline(stream, part, separator))
+            parts.push_back(part);
+        return parts;
+    }
+
+    /**
+     * parseInteger() for option values, so that errors come with usage.
+     */
+    int64_t parseOption(
+        const std::string &name,
+        const std::string &str,
+        int base,
+        int64_t min,
+        int64_t max)
+    {
+        try
+        {
+            return parseInteger(name, str, base, min, max);
+        }
+        catch (std::invalid_argument &e)
+        {
+            throw arg_error(e.what());
+        }
+    }
+
+    std::shared_ptr<CRC> findCRC(const std::string &name)
+    {
+        auto crc = findBuiltinCRC(name);
+        if (crc == nullptr)
+            throw arg_error("Unknown algorithm: " + name);
+        return crc;
+    }
+
     void validateChecksum(CRC &crc, const std::string &str)
     {
         size_t expectedDigits = crc.getSpecs().numBytes * 2;
@@ -156,35 +319,396 @@ Examples:
         }
     }
 
+    enum class StatsFormat : uint8_t
+    {
+        None,
+        Text,
+        Json
+    };
+
     class Command
     {
         public:
+            Command() : statsFormat(StatsFormat::None) { }
             virtual void parse(std::vector<std::string> args) = 0;
             virtual void run() const = 0;
+
+            /**
+             * Files drop what they touched from the page cache as they
+             * close, so this comes before the stats.
+             */
+            virtual void closeFiles() { }
+
+            void printStats(
+                std::ostream &s, const StatsCollector &collector) const;
+
+        protected:
+            bool parseStatsOption(const std::string &arg);
+            bool parseAlgorithmOption(
+                const std::vector<std::string> &args, size_t &i);
+            std::vector<std::shared_ptr<CRC>> getAlgorithms() const;
+            void announceProgress() const;
+
+            StatsFormat statsFormat;
+            std::vector<std::string> algorithmNames;
+            std::map<std::string, std::string> customOptions;
+            mutable Progress checksumProgress;
+            mutable Progress writeProgress;
     };
 
+    bool Command::parseStatsOption(const std::string &arg)
+    {
+        if (arg == "--stats" || arg == "--stats=text")
+            statsFormat = StatsFormat::Text;
+        else if (arg == "--stats=json")
+            statsFormat = StatsFormat::Json;
+        else if (arg.compare(0, 8, "--stats=") == 0)
+            throw arg_error("Stats format must be text or json.");
+        else
+            return false;
+        return true;
+    }
+
+    /**
+     * Takes -a and the custom algorithm options, along with their values.
+     */
+    bool Command::parseAlgorithmOption(
+        const std::vector<std::string> &args, size_t &i)
+    {
+        auto &arg = args[i];
+        bool custom = arg == "--poly"
+            || arg == "--width"
+            || arg == "--init"
+            || arg == "--xorout"
+            || arg == "--refin";
+        if (!custom && arg != "-a" && arg != "--alg" && arg != "--algorithm")
+            return false;
+        if (i == args.size() - 1)
+            throw arg_error(arg + " needs a parameter.");
+        if (custom)
+            customOptions[arg] = args[++i];
+        else
+            algorithmNames = split(args[++i], ',');
+        return true;
+    }
+
+    /**
+     * Only the selected engines get built, so that a run doesn't pay for
+     * algorithms it doesn't use.
+     */
+    std::vector<std::shared_ptr<CRC>> Command::getAlgorithms() const
+    {
+        if (customOptions.empty())
+        {
+            std::vector<std::shared_ptr<CRC>> crcs;
+            for (auto &name : algorithmNames)
+                crcs.push_back(findCRC(name));
+            if (crcs.empty())
+                crcs.push_back(findCRC(getBuiltinSpecs()[0].name));
+            return crcs;
+        }
+
+        if (!algorithmNames.empty())
+            throw arg_error("--algorithm can't be used with --poly.");
+        if (!customOptions.count("--poly"))
+            throw arg_error("Custom algorithm needs --poly.");
+        auto getOption = [&](const std::string &name, const std::string &def)
+        {
+            auto it = customOptions.find(name);
+            return it == customOptions.end() ? def : it->second;
+        };
+        auto refin = getOption("--refin", "false");
+        if (refin != "true" && refin != "false")
+            throw arg_error("--refin must be true or false.");
+        auto getValue = [&](
+            const std::string &name, const std::string &def, int base)
+        {
+            return parseInteger(
+                name, getOption(name, def), base, 0, 0xFFFFFFFF);
+        };
+        try
+        {
+            return {std::shared_ptr<CRC>(createCustomCRC(
+                getValue("--width", "32", 10),
+                getValue("--poly", "", 16),
+                getValue("--init", "0", 16),
+                getValue("--xorout", "0", 16),
+                refin == "true"))};
+        }
+        catch (std::invalid_argument &e)
+        {
+            throw arg_error(e.what());
+        }
+        catch (std::out_of_range &e)
+        {
+            throw arg_error(e.what());
+        }
+    }
+
+    void Command::announceProgress() const
+    {
+        writeProgress.started = []() { std::cout << "Output started\n"; };
+        writeProgress.finished = []() { std::cout << "Output finished\n"; };
+
+        checksumProgress.started = []()
+            { std::cout << "Checksum started\n"; };
+        checksumProgress.finished = []()
+            { std::cout << "Checksum finished\n"; };
+    }
+
+    void printPhaseStats(
+        std::ostream &s,
+        const std::string &label,
+        const Progress::PhaseStats &stats)
+    {
+        s << std::left << std::setw(14) << label << std::right;
+        if (!stats.numRuns)
+        {
+            s << "-\n";
+            return;
+        }
+        s << stats.seconds << " s, "
+            << stats.bytes / 1048576.0 << " MiB";
+        if (stats.seconds > 0)
+            s << ", " << stats.bytes / 1048576.0 / stats.seconds << " MiB/s";
+        s << "\n";
+    }
+
+    void printPhaseStatsJson(
+        std::ostream &s,
+        const std::string &name,
+        const Progress::PhaseStats &stats)
+    {
+        s << "\"" << name << "\": {"
+            << "\"seconds\": " << stats.seconds << ", "
+            << "\"bytes\": " << stats.bytes << ", "
+            << "\"runs\": " << stats.numRuns << "}";
+    }
+
+    /**
+     * Goes to stderr, so that the regular output stays parseable.
+     */
+    void Command::printStats(
+        std::ostream &s, const StatsCollector &collector) const
+    {
+        if (statsFormat == StatsFormat::None)
+            return;
+
+        auto stats = collector.collect({&checksumProgress, &writeProgress});
+        s << std::fixed << std::setprecision(3);
+        if (statsFormat == StatsFormat::Json)
+        {
+            s << "{\"backend\": \"" << stats.backend << "\", "
+                << "\"seconds\": " << stats.seconds << ", "
+                << "\"phases\": {";
+            printPhaseStatsJson(s, "prefix", stats.prefix);
+            s << ", ";
+            printPhaseStatsJson(s, "suffix", stats.suffix);
+            s << ", ";
+            printPhaseStatsJson(s, "copy", stats.copy);
+            s << "}, \"file\": {"
+                << "\"opens\": " << stats.file.numOpens << ", "
+                << "\"reads\": " << stats.file.numReads << ", "
+                << "\"bytesRead\": " << stats.file.bytesRead << ", "
+                << "\"writes\": " << stats.file.numWrites << ", "
+                << "\"bytesWritten\": " << stats.file.bytesWritten << ", "
+                << "\"seeks\": " << stats.file.numSeeks << ", "
+                << "\"holeQueries\": " << stats.file.numHoleQueries << ", "
+                << "\"syncs\": " << stats.file.numSyncs << ", "
+                << "\"dropRequests\": " << stats.file.numDropRequests << ", "
+                << "\"bytesDropped\": " << stats.file.bytesDropped
+                << "}}\n";
+            return;
+        }
+
+        s << "Backend:      " << stats.backend << "\n";
+        s << "Total time:   " << stats.seconds << " s\n";
+        printPhaseStats(s, "Prefix pass:", stats.prefix);
+        printPhaseStats(s, "Suffix pass:", stats.suffix);
+        printPhaseStats(s, "Copy:", stats.copy);
+        s << "File opens:   " << stats.file.numOpens << "\n";
+        s << "File reads:   " << stats.file.numReads << ", "
+            << stats.file.bytesRead / 1048576.0 << " MiB\n";
+        s << "File writes:  " << stats.file.numWrites << ", "
+            << stats.file.bytesWritten / 1048576.0 << " MiB\n";
+        s << "File seeks:   " << stats.file.numSeeks << "\n";
+        s << "Hole queries: " << stats.file.numHoleQueries << "\n";
+        s << "Syncs:        " << stats.file.numSyncs << "\n";
+        s << "Cache drops:  " << stats.file.numDropRequests << ", "
+            << stats.file.bytesDropped / 1048576.0 << " MiB\n";
+    }
+
     class CalculateCommand : public Command
     {
         public:
-            CalculateCommand(std::vector<std::shared_ptr<CRC>> crcs);
             virtual void parse(std::vector<std::string> args);
             virtual void run() const;
+            virtual void closeFiles() { inputFile.reset(); }
 
         private:
+            void runMany() const;
+
             std::shared_ptr<CRC> crc;
             std::unique_ptr<File> inputFile;
-
-            std::vector<std::shared_ptr<CRC>> crcs;
+            std::vector<std::string> inputPaths;
+            std::string statePath;
+            std::vector<CRC::Mask> masks;
     };
 
-    CalculateCommand::CalculateCommand(std::vector<std::shared_ptr<CRC>> crcs)
-        : crcs(crcs)
+    void CalculateCommand::parse(std::vector<std::string> args)
     {
+        if (args.size() < 1)
+            throw arg_error("No input file specified.");
+        inputPaths = {args[0]};
+        inputFile = File::fromFileName(
+            args[0], File::Mode::Read | File::Mode::Binary);
+
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            auto &arg = args[i];
+            if (parseStatsOption(arg) || parseAlgorithmOption(args, i))
+                continue;
+            if (!arg.empty() && arg[0] != '-')
+                inputPaths.push_back(arg);
+            else if (arg == "-s" || arg == "--state")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                statePath = args[++i];
+            }
+            else if (arg == "-m" || arg == "--mask")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                auto parts = split(args[++i], ':');
+                if (parts.size() < 2 || parts.size() > 3)
+                    throw arg_error("Mask must be OFFSET:LEN[:zero|skip].");
+                auto fileSize = inputFile->getSize();
+                CRC::Mask mask;
+                mask.offset = parseOption(
+                    "mask offset", parts[0], 10, -fileSize, fileSize);
+                if (mask.offset < 0)
+                    mask.offset += fileSize;
+                mask.size = parseOption("mask size", parts[1], 10, 0, fileSize);
+                mask.skip = parts.size() > 2 && parts[2] == "skip";
+                if (parts.size() > 2 && !mask.skip && parts[2] != "zero")
+                    throw arg_error("Mask kind must be zero or skip.");
+                masks.push_back(mask);
+            }
+        }
+
+        auto crcs = getAlgorithms();
+        if (crcs.size() > 1)
+            throw arg_error("calc works with a single algorithm only.");
+        crc = crcs[0];
+
+        if (!statePath.empty() && !masks.empty())
+            throw arg_error("--state and --mask can't be used together.");
+        if (inputPaths.size() > 1 && (!statePath.empty() || !masks.empty()))
+            throw arg_error("--state and --mask work with one file only.");
     }
 
-    void CalculateCommand::parse(std::vector<std::string> args)
+    /**
+     * Small files are read whole, many at a time, and checksummed in
+     * batches, which keeps several of them in flight at once; bigger ones
+     * are streamed.
+     */
+    void CalculateCommand::runMany() const
     {
-        crc = crcs[0];
+        const size_t MaxSmallFileSize = 4096;
+        const size_t BatchSize = 1024;
+
+        auto numDigits = crc->getSpecs().numBytes * 2;
+        for (size_t start = 0; start < inputPaths.size(); start += BatchSize)
+        {
+            auto end = std::min(start + BatchSize, inputPaths.size());
+            std::vector<std::string> paths(
+                inputPaths.begin() + start, inputPaths.begin() + end);
+            auto files = readSmallFiles(paths, MaxSmallFileSize);
+
+            std::vector<const uint8_t*> data;
+            std::vector<size_t> sizes;
+            for (auto &file : files)
+            {
+                if (file.status != SmallFile::Status::Read)
+                    continue;
+                data.push_back(file.content.data());
+                sizes.push_back(file.content.size());
+            }
+            auto results = crc->computeChecksums(data, sizes);
+
+            auto result = results.begin();
+            for (size_t i = 0; i < paths.size(); i++)
+            {
+                CRC::Value checksum;
+                if (files[i].status == SmallFile::Status::Read)
+                    checksum = *result++;
+                else if (files[i].status == SmallFile::Status::TooBig)
+                {
+                    auto file = File::fromFileName(
+                        paths[i], File::Mode::Read | File::Mode::Binary);
+                    checksum = crc->computeChecksum(*file, checksumProgress);
+                }
+                else
+                    throw std::runtime_error("Couldn't read " + paths[i]);
+
+                std::cout << hex(checksum, numDigits)
+                    << "  " << paths[i] << "\n";
+            }
+        }
+    }
+
+    void CalculateCommand::run() const
+    {
+        if (inputPaths.size() > 1)
+        {
+            runMany();
+            return;
+        }
+
+        CRC::Value checksum;
+        if (!masks.empty())
+        {
+            checksum = crc->computeMaskedChecksum(
+                *inputFile, masks, checksumProgress);
+        }
+        else if (statePath.empty())
+            checksum = crc->computeChecksum(*inputFile, checksumProgress);
+        else
+        {
+            ChecksumState state = {};
+            bool loaded = loadChecksumState(statePath, state);
+            bool resumed;
+            checksum = updateChecksumState(
+                *crc, *inputFile, state, checksumProgress, &resumed);
+            if (loaded && !resumed)
+            {
+                std::cerr << "Warning: file doesn't match saved state; "
+                    << "checksum was computed from scratch.\n";
+            }
+            saveChecksumState(statePath, state);
+        }
+        std::cout << hex(checksum, crc->getSpecs().numBytes * 2) << std::endl;
+    }
+
+    class FindCommand : public Command
+    {
+        public:
+            virtual void parse(std::vector<std::string> args);
+            virtual void run() const;
+            virtual void closeFiles() { inputFile.reset(); }
+
+        private:
+            std::shared_ptr<CRC> crc;
+            std::unique_ptr<File> inputFile;
+            File::OffsetType windowSize;
+            std::string checksumText;
+    };
+
+    void FindCommand::parse(std::vector<std::string> args)
+    {
+        windowSize = 0;
+        checksumText = "";
 
         if (args.size() < 1)
             throw arg_error("No input file specified.");
@@ -194,79 +718,418 @@ Examples:
         for (size_t i = 1; i < args.size(); i++)
         {
             auto &arg = args[i];
-            if (arg == "-a" || arg == "--alg" || arg == "--algorithm")
+            if (parseAlgorithmOption(args, i))
+                continue;
+            if (arg == "-w" || arg == "--window")
             {
                 if (i == args.size() - 1)
                     throw arg_error(arg + " needs a parameter.");
-                auto algo  = args[++i];
-                auto it = std::find_if(
-                    crcs.begin(), crcs.end(), [&](std::shared_ptr<CRC> crc)
-                    { return crc->getSpecs().name == algo; });
-                if (it == crcs.end())
-                    throw arg_error("Unknown algorithm: " + algo);
-                crc = *it;
+                windowSize = parseOption(
+                    "window size", args[++i], 10, 1, INT64_MAX);
+            }
+            else if (arg == "--crc")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                checksumText = args[++i];
             }
         }
+
+        auto crcs = getAlgorithms();
+        if (crcs.size() > 1)
+            throw arg_error("find works with a single algorithm only.");
+        crc = crcs[0];
+
+        if (windowSize == 0)
+            throw arg_error("No window size specified.");
+        if (checksumText.empty())
+            throw arg_error("No checksum specified.");
+        validateChecksum(*crc, checksumText);
     }
 
-    void CalculateCommand::run() const
+    void FindCommand::run() const
     {
         Progress dummyProgress;
-        auto checksum = crc->computeChecksum(*inputFile, dummyProgress);
-        std::cout << hex(checksum, crc->getSpecs().numBytes * 2) << std::endl;
+        auto offsets = crc->findWindows(
+            *inputFile,
+            windowSize,
+            std::stoull(checksumText, nullptr, 16),
+            dummyProgress);
+        for (auto offset : offsets)
+            std::cout << offset << "\n";
+    }
+
+    class TuneCommand : public Command
+    {
+        public:
+            virtual void parse(std::vector<std::string> args);
+            virtual void run() const;
+
+        private:
+            std::string dir;
+            std::string profilePath;
+    };
+
+    void TuneCommand::parse(std::vector<std::string> args)
+    {
+        dir = ".";
+        profilePath = getDefaultProfilePath();
+
+        bool dirGiven = false;
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            auto &arg = args[i];
+            if (arg == "--profile")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                profilePath = args[++i];
+            }
+            else if (!dirGiven && (arg.empty() || arg[0] != '-'))
+            {
+                dir = arg;
+                dirGiven = true;
+            }
+            else
+                throw arg_error("Unknown option: " + arg);
+        }
+    }
+
+    /**
+     * The latest tuned filesystem also becomes the default for the rest,
+     * since it's most likely where the user works.
+     */
+    void TuneCommand::run() const
+    {
+        Profile profile = getBuiltinProfile();
+        loadProfile(profilePath, profile);
+
+        std::cerr << "Tuning " << dir << "...\n";
+        uint64_t device;
+        auto tuning = tuneFilesystem(dir, device);
+        profile.filesystems[device] = tuning;
+        profile.defaults = tuning;
+        saveProfile(profilePath, profile);
+
+        std::cout
+            << "chunk size:  " << tuning.chunkSize << "\n"
+            << "buffer size: " << tuning.bufferSize << "\n"
+            << "queue depth: " << tuning.queueDepth << "\n"
+            << "saved to:    " << profilePath << "\n";
+    }
+
+    class ServeCommand : public Command
+    {
+        public:
+            virtual void parse(std::vector<std::string> args);
+            virtual void run() const;
+
+        private:
+            std::string socketPath;
+            size_t maxActiveJobs;
+    };
+
+    Server *runningServer = nullptr;
+
+    void stopServer(int)
+    {
+        if (runningServer != nullptr)
+            runningServer->stop();
+    }
+
+    void ServeCommand::parse(std::vector<std::string> args)
+    {
+        socketPath = "";
+        maxActiveJobs = 0;
+
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            auto &arg = args[i];
+            if (arg == "--socket")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                socketPath = args[++i];
+            }
+            else if (arg == "-j" || arg == "--jobs")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                auto jobs = parseOption(
+                    arg, args[++i], 10, INT64_MIN, INT64_MAX);
+                if (jobs <= 0)
+                    throw arg_error("Number of jobs must be positive.");
+                maxActiveJobs = jobs;
+            }
+            else
+                throw arg_error("Unknown option: " + arg);
+        }
+
+        if (socketPath.empty())
+            throw arg_error("No socket specified.");
+    }
+
+    /**
+     * Runs until interrupted; the socket file is removed on the way out.
+     */
+    void ServeCommand::run() const
+    {
+        Server server(socketPath, maxActiveJobs);
+        runningServer = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+
+        std::cerr << "Listening on " << socketPath << "\n";
+        server.run();
+
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        runningServer = nullptr;
+    }
+
+    class SfvCommand : public Command
+    {
+        public:
+            virtual void parse(std::vector<std::string> args);
+            virtual void run() const;
+
+        private:
+            void runCreate() const;
+            void runVerify() const;
+
+            bool verify;
+            std::vector<std::string> paths;
+            std::string cachePath;
+            size_t maxJobs;
+            bool failFast;
+    };
+
+    void SfvCommand::parse(std::vector<std::string> args)
+    {
+        paths.clear();
+        cachePath = "";
+        maxJobs = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        failFast = false;
+
+        if (args.size() < 1 || (args[0] != "create" && args[0] != "verify"))
+            throw arg_error("sfv needs create or verify.");
+        verify = args[0] == "verify";
+
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            auto &arg = args[i];
+            if (arg == "--cache")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                cachePath = args[++i];
+            }
+            else if (arg == "-j" || arg == "--jobs")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                auto jobs = parseOption(
+                    arg, args[++i], 10, INT64_MIN, INT64_MAX);
+                if (jobs <= 0)
+                    throw arg_error("Number of jobs must be positive.");
+                maxJobs = jobs;
+            }
+            else if (arg == "--fail-fast")
+                failFast = true;
+            else if (!arg.empty() && arg[0] != '-')
+                paths.push_back(arg);
+            else
+                throw arg_error("Unknown option: " + arg);
+        }
+
+        if (paths.empty())
+            throw arg_error("No input file specified.");
+        if (verify && paths.size() > 1)
+            throw arg_error("sfv verify takes a single list.");
+        if (!verify && failFast)
+            throw arg_error("--fail-fast works with sfv verify only.");
+        if (verify && !cachePath.empty())
+            throw arg_error("--cache works with sfv create only.");
+    }
+
+    /**
+     * Names are written as given, so the list should be created in the
+     * directory where it's going to be kept.
+     */
+    void SfvCommand::runCreate() const
+    {
+        std::map<std::string, ChecksumState> states;
+        if (!cachePath.empty())
+            loadChecksumStates(cachePath, states);
+
+        std::vector<SfvEntry> entries(paths.size());
+        std::string error;
+        computeFileChecksums(
+            findCRC("CRC32"),
+            paths,
+            maxJobs,
+            cachePath.empty() ? nullptr : &states,
+            [&](size_t index, const FileChecksum &result)
+            {
+                entries[index].path = paths[index];
+                entries[index].checksum = result.checksum;
+                if (!result.error.empty())
+                    error = paths[index] + ": " + result.error;
+                return error.empty();
+            });
+        if (!cachePath.empty())
+            saveChecksumStates(cachePath, states);
+        if (!error.empty())
+            throw std::runtime_error(error);
+
+        std::cout << "; Generated by crcmanip v" << CRCMANIP_VERSION << "\n";
+        writeSfv(std::cout, entries);
+    }
+
+    /**
+     * Results come out as files finish, which is biggest first rather
+     * than in the order of the list.
+     */
+    void SfvCommand::runVerify() const
+    {
+        std::ifstream stream(paths[0]);
+        if (!stream)
+            throw std::runtime_error("Couldn't open " + paths[0]);
+        auto entries = readSfv(stream);
+
+        //names are relative to the list
+        auto dir = paths[0].substr(0, paths[0].find_last_of("/\\") + 1);
+        std::vector<std::string> filePaths;
+        for (auto &entry : entries)
+        {
+            bool absolute = !entry.path.empty()
+                && (entry.path[0] == '/' || entry.path.find(':') == 1);
+            filePaths.push_back(absolute ? entry.path : dir + entry.path);
+        }
+
+        //files are always read whole, as a cache can't vouch for them
+        size_t numFailed = 0;
+        computeFileChecksums(
+            findCRC("CRC32"),
+            filePaths,
+            maxJobs,
+            nullptr,
+            [&](size_t index, const FileChecksum &result)
+            {
+                std::cout << entries[index].path << ": ";
+                if (!result.error.empty())
+                    std::cout << result.error << "\n";
+                else if (result.checksum != entries[index].checksum)
+                {
+                    std::cout << "FAILED (got "
+                        << hex(result.checksum, 8) << ")\n";
+                }
+                else
+                {
+                    std::cout << "OK\n";
+                    return true;
+                }
+                numFailed++;
+                return !failFast;
+            });
+
+        if (numFailed)
+        {
+            throw std::runtime_error(
+                std::to_string(numFailed) + " of "
+                + std::to_string(entries.size())
+                + " files failed verification");
+        }
+    }
+
+    void SfvCommand::run() const
+    {
+        if (verify)
+            runVerify();
+        else
+            runCreate();
     }
 
     class PatchCommand : public Command
     {
         public:
-            PatchCommand(std::vector<std::shared_ptr<CRC>> crcs);
             virtual void parse(std::vector<std::string> args);
             virtual void run() const;
+            virtual void closeFiles();
 
         private:
+            std::vector<const CRC*> getSelectedEngines() const;
+            File::OffsetType getTargetPosition() const;
+            void runBatch() const;
+            void runMulti() const;
+            void runScattered() const;
+            void runVolumes() const;
+
             std::shared_ptr<CRC> crc;
             std::unique_ptr<File> inputFile;
-            std::unique_ptr<File> outputFile;
+            mutable std::unique_ptr<File> outputFile;
+            std::string inputPath;
+            std::string outputPath;
+            std::string outputDir;
+            std::string targetsPath;
             CRC::Value checksum;
+            std::vector<std::shared_ptr<CRC>> selectedCrcs;
+            std::vector<CRC::Value> checksums;
+            CRC::ByteSet allowedBytes;
+            std::vector<CRC::Region> regions;
+            std::vector<std::string> volumePaths;
             File::OffsetType position;
             bool positionSupplied;
             bool overwrite;
-
-            std::vector<std::shared_ptr<CRC>> crcs;
+            bool verify;
     };
 
-    PatchCommand::PatchCommand(std::vector<std::shared_ptr<CRC>> crcs)
-        : crcs(crcs)
-    {
-    }
-
     void PatchCommand::parse(std::vector<std::string> args)
     {
-        crc = crcs[0];
+        allowedBytes.set();
+        regions.clear();
+        volumePaths.clear();
         positionSupplied = false;
         position = 0;
         overwrite = false;
+        verify = false;
+
+        targetsPath = "";
 
         if (args.size() < 1)
             throw arg_error("No input file specified.");
+        inputPath = args[0];
         inputFile = File::fromFileName(
-            args[0], File::Mode::Read | File::Mode::Binary);
+            inputPath, File::Mode::Read | File::Mode::Binary);
+
+        bool batch = std::find_if(
+            args.begin(), args.end(), [](const std::string &arg)
+            { return arg == "-t" || arg == "--targets"; }) != args.end();
 
         if (args.size() < 2)
             throw arg_error("No output file specified.");
-        outputFile = File::fromFileName(
-            args[1], File::Mode::Write | File::Mode::Binary);
-
-        if (args.size() < 3)
-            throw arg_error("No checksum specified.");
+        if (batch)
+            outputDir = args[1];
+        else
+        {
+            outputPath = args[1];
+            outputFile = File::fromFileName(
+                outputPath, File::Mode::Write | File::Mode::Binary);
+            if (args.size() < 3)
+                throw arg_error("No checksum specified.");
+        }
 
-        for (size_t i = 3; i < args.size(); i++)
+        for (size_t i = batch ? 2 : 3; i < args.size(); i++)
         {
             auto &arg = args[i];
+            if (parseStatsOption(arg) || parseAlgorithmOption(args, i))
+                continue;
             if (arg == "-i" || arg == "--insert")
                 overwrite = false;
             else if (arg == "-o" || arg == "--overwrite")
                 overwrite = true;
+            else if (arg == "--verify")
+                verify = true;
             else if (arg == "-p" || arg == "--pos" || arg == "--position")
             {
                 if (i == args.size() - 1)
@@ -275,65 +1138,348 @@ Examples:
                 positionSupplied = true;
                 position = std::stoll(pos);
             }
-            else if (arg == "-a" || arg == "--alg" || arg == "--algorithm")
+            else if (arg == "-c" || arg == "--charset")
             {
                 if (i == args.size() - 1)
                     throw arg_error(arg + " needs a parameter.");
-                auto algo  = args[++i];
-                auto it = std::find_if(
-                    crcs.begin(), crcs.end(), [&](std::shared_ptr<CRC> crc)
-                    { return crc->getSpecs().name == algo; });
-                if (it == crcs.end())
-                    throw arg_error("Unknown algorithm: " + algo);
-                crc = *it;
+                try
+                {
+                    allowedBytes = parseByteSet(args[++i]);
+                }
+                catch (std::invalid_argument &e)
+                {
+                    throw arg_error(e.what());
+                }
+            }
+            else if (arg == "-r" || arg == "--region")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                auto parts = split(args[++i], ':');
+                if (parts.size() < 2 || parts.size() > 3)
+                    throw arg_error("Region must be OFFSET:LEN[:MASK].");
+                auto fileSize = inputFile->getSize();
+                CRC::Region region;
+                region.offset = parseOption(
+                    "region offset", parts[0], 10, -fileSize, fileSize);
+                if (region.offset < 0)
+                    region.offset += fileSize;
+                region.size = parseOption(
+                    "region size", parts[1], 10, 1, fileSize);
+                region.mask = parts.size() > 2
+                    ? parseOption("region mask", parts[2], 16, 1, 0xFF)
+                    : 0xFF;
+                regions.push_back(region);
+            }
+            else if (arg == "-t" || arg == "--targets")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                targetsPath = args[++i];
+            }
+            else if (arg == "-v" || arg == "--volumes")
+            {
+                if (i == args.size() - 1)
+                    throw arg_error(arg + " needs a parameter.");
+                volumePaths = split(args[++i], ',');
+            }
+        }
+
+        selectedCrcs = getAlgorithms();
+        crc = selectedCrcs[0];
+
+        if (verify
+            && (batch
+                || selectedCrcs.size() > 1
+                || !allowedBytes.all()
+                || !regions.empty()
+                || !volumePaths.empty()))
+        {
+            throw arg_error(
+                "--verify works with a single algorithm and no --targets, "
+                "--charset, --region or --volumes only.");
+        }
+
+        if (batch && (selectedCrcs.size() > 1 || !allowedBytes.all()))
+        {
+            throw arg_error(
+                "--targets works with a single algorithm "
+                "and no --charset only.");
+        }
+
+        if (!regions.empty())
+        {
+            if (batch || selectedCrcs.size() > 1 || !allowedBytes.all())
+            {
+                throw arg_error(
+                    "--region works with a single algorithm and no "
+                    "--targets or --charset only.");
+            }
+            try
+            {
+                validateRegions(regions, inputFile->getSize());
+            }
+            catch (std::invalid_argument &e)
+            {
+                throw arg_error(e.what());
             }
         }
 
-        validateChecksum(*crc, args[2]);
-        checksum = std::stoull(args[2], nullptr, 16);
+        if (!volumePaths.empty())
+        {
+            if (batch
+                || selectedCrcs.size() > 1
+                || !allowedBytes.all()
+                || !regions.empty())
+            {
+                throw arg_error(
+                    "--volumes works with a single algorithm and no "
+                    "--targets, --charset or --region only.");
+            }
+            if (std::count(
+                volumePaths.begin(), volumePaths.end(), inputPath) != 1)
+            {
+                throw arg_error(
+                    "Input file must be listed among volumes exactly once.");
+            }
+        }
+
+        if (!batch)
+        {
+            auto values = split(args[2], ',');
+            if (values.size() != selectedCrcs.size())
+                throw arg_error("Expected one checksum per algorithm.");
+            checksums.clear();
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                validateChecksum(*selectedCrcs[i], values[i]);
+                checksums.push_back(std::stoull(values[i], nullptr, 16));
+            }
+            checksum = checksums[0];
+        }
     }
 
-    void PatchCommand::run() const
+    std::vector<const CRC*> PatchCommand::getSelectedEngines() const
     {
-        Progress writeProgress;
-        writeProgress.started = []() { std::cout << "Output started\n"; };
-        writeProgress.finished = []() { std::cout << "Output finished\n"; };
+        std::vector<const CRC*> engines;
+        for (auto &selectedCrc : selectedCrcs)
+            engines.push_back(selectedCrc.get());
+        return engines;
+    }
 
-        Progress crcProgress;
-        crcProgress.started = []() { std::cout << "Checksum started\n"; };
-        crcProgress.finished = []() { std::cout << "Checksum finished\n"; };
+    File::OffsetType PatchCommand::getTargetPosition() const
+    {
+        auto patchSize = CRC::getMultiPatchSize(
+            getSelectedEngines(), allowedBytes);
 
-        crcProgress.changed = writeProgress.changed
-            = [](double percentage)
-                {
-                    std::cout
-                        << std::setw(5)
-                        << std::fixed
-                        << std::setprecision(2)
-                        << percentage
-                        << "% done\r";
-                        std::cout.flush();
-                };
-
-        auto correctedPosition = positionSupplied
+        return positionSupplied
             ? shiftUserPosition(
                 position,
                 inputFile->getSize(),
-                crc->getSpecs().numBytes,
+                patchSize,
                 overwrite)
             : computeAutoPosition(
                 inputFile->getSize(),
-                crc->getSpecs().numBytes,
+                patchSize,
                 overwrite);
+    }
 
-        crc->applyPatch(
+    void PatchCommand::runScattered() const
+    {
+        announceProgress();
+
+        crc->applyScatteredPatch(
             checksum,
-            correctedPosition,
+            regions,
             *inputFile,
             *outputFile,
+            writeProgress,
+            checksumProgress);
+    }
+
+    void PatchCommand::runVolumes() const
+    {
+        announceProgress();
+
+        std::vector<std::unique_ptr<File>> volumeFiles;
+        std::vector<File*> volumes;
+        size_t patchedVolume = 0;
+        for (size_t i = 0; i < volumePaths.size(); i++)
+        {
+            if (volumePaths[i] == inputPath)
+            {
+                patchedVolume = i;
+                volumes.push_back(inputFile.get());
+                continue;
+            }
+            volumeFiles.push_back(File::fromFileName(
+                volumePaths[i], File::Mode::Read | File::Mode::Binary));
+            volumes.push_back(volumeFiles.back().get());
+        }
+
+        crc->applyPartPatch(
+            checksum,
+            volumes,
+            patchedVolume,
+            getTargetPosition(),
+            *outputFile,
             overwrite,
             writeProgress,
-            crcProgress);
+            checksumProgress);
+    }
+
+    void PatchCommand::runMulti() const
+    {
+        announceProgress();
+
+        auto targetPosition = getTargetPosition();
+        auto patch = CRC::computeMultiPatch(
+            getSelectedEngines(),
+            checksums,
+            targetPosition,
+            *inputFile,
+            overwrite,
+            allowedBytes,
+            checksumProgress);
+        CRC::writePatch(
+            patch,
+            targetPosition,
+            *inputFile,
+            *outputFile,
+            overwrite,
+            writeProgress);
+
+        std::cout << "Patch length: " << patch.size() << " bytes\n";
+    }
+
+    /**
+     * Reads the input once to compute all the patches, then once per group
+     * of outputs, since we can't keep thousands of files open at once.
+     */
+    void PatchCommand::runBatch() const
+    {
+        const size_t MaxOpenOutputs = 128;
+
+        std::ifstream targetsStream(targetsPath);
+        if (!targetsStream)
+            throw std::runtime_error("Couldn't open target list");
+
+        //outputs are named after their checksums, so a checksum listed
+        //twice, even in different case, would write the same file twice
+        std::vector<CRC::Value> targets;
+        std::set<CRC::Value> seenTargets;
+        std::string line;
+        while (std::getline(targetsStream, line))
+        {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty() || line[0] == '#')
+                continue;
+            validateChecksum(*crc, line);
+            auto target = std::stoull(line, nullptr, 16);
+            if (seenTargets.insert(target).second)
+                targets.push_back(target);
+        }
+
+        auto baseName = inputPath.substr(inputPath.find_last_of("/\\") + 1);
+        auto targetPosition = getTargetPosition();
+
+        checksumProgress.started = []()
+            { std::cout << "Checksum started\n"; };
+        checksumProgress.finished = []()
+            { std::cout << "Checksum finished\n"; };
+        auto patches = crc->computePatches(
+            targets, targetPosition, *inputFile, overwrite, checksumProgress);
+
+        for (size_t start = 0; start < targets.size(); start += MaxOpenOutputs)
+        {
+            auto end = std::min(start + MaxOpenOutputs, targets.size());
+            std::vector<std::unique_ptr<File>> outputFiles;
+            std::vector<File*> outputs;
+            for (size_t i = start; i < end; i++)
+            {
+                std::ostringstream outputPath;
+                outputPath << outputDir << "/"
+                    << hex(targets[i], crc->getSpecs().numBytes * 2)
+                    << "_" << baseName;
+                outputFiles.push_back(File::fromFileName(
+                    outputPath.str(), File::Mode::Write | File::Mode::Binary));
+                outputs.push_back(outputFiles.back().get());
+            }
+
+            crc->applyPatches(
+                std::vector<CRC::Value>(
+                    patches.begin() + start, patches.begin() + end),
+                targetPosition,
+                *inputFile,
+                outputs,
+                overwrite,
+                writeProgress);
+        }
+
+        std::cout << "Written " << targets.size() << " outputs\n";
+    }
+
+    void PatchCommand::closeFiles()
+    {
+        outputFile.reset();
+        inputFile.reset();
+    }
+
+    void PatchCommand::run() const
+    {
+        if (!targetsPath.empty())
+        {
+            runBatch();
+            return;
+        }
+
+        if (!regions.empty())
+        {
+            runScattered();
+            return;
+        }
+
+        if (!volumePaths.empty())
+        {
+            runVolumes();
+            return;
+        }
+
+        if (selectedCrcs.size() > 1 || !allowedBytes.all())
+        {
+            runMulti();
+            return;
+        }
+
+        announceProgress();
+
+        showProgress(checksumProgress);
+        showProgress(writeProgress);
+        ProgressObserver observer({&checksumProgress, &writeProgress});
+
+        try
+        {
+            crc->applyPatch(
+                checksum,
+                getTargetPosition(),
+                *inputFile,
+                *outputFile,
+                overwrite,
+                writeProgress,
+                checksumProgress,
+                verify);
+        }
+        catch (...)
+        {
+            //an output that failed verification mustn't look usable
+            if (verify)
+            {
+                outputFile.reset();
+                std::remove(outputPath.c_str());
+            }
+            throw;
+        }
     }
 }
 
@@ -343,19 +1489,26 @@ int main(int argc, char **argv)
     for (int i = 1; i < argc; i++)
         args.push_back(std::string(argv[i]));
 
-    auto crcs = createAllCRC();
-
     for (auto &arg : args)
     {
         if (arg == "-h" || arg == "--help")
         {
-            printUsage(std::cout, crcs);
+            printUsage(std::cout);
             return 0;
         }
     }
 
+    auto noCacheArg = std::find(args.begin(), args.end(), "--nocache");
+    if (noCacheArg != args.end())
+    {
+        args.erase(noCacheArg);
+        File::setCachePolicy(File::CachePolicy::NoCache);
+    }
+    activateDefaultProfile();
+
     try
     {
+        StatsCollector statsCollector;
         std::unique_ptr<Command> command;
         try
         {
@@ -367,15 +1520,23 @@ int main(int argc, char **argv)
             cmdName.erase(0, cmdName.find_first_not_of('-'));
 
             if (cmdName == "p" || cmdName == "patch")
-                command.reset(new PatchCommand(crcs));
+                command.reset(new PatchCommand());
             else if (cmdName == "c" || cmdName == "calc"
                 || cmdName == "calculate")
             {
-                command.reset(new CalculateCommand(crcs));
+                command.reset(new CalculateCommand());
             }
+            else if (cmdName == "f" || cmdName == "find")
+                command.reset(new FindCommand());
+            else if (cmdName == "t" || cmdName == "tune")
+                command.reset(new TuneCommand());
+            else if (cmdName == "serve")
+                command.reset(new ServeCommand());
+            else if (cmdName == "sfv")
+                command.reset(new SfvCommand());
             else if (cmdName == "h" || cmdName == "help")
             {
-                printUsage(std::cout, crcs);
+                printUsage(std::cout);
                 return 0;
             }
             else
@@ -386,11 +1547,13 @@ int main(int argc, char **argv)
         catch (arg_error &e)
         {
             std::cerr << e.what() << "\n\n";
-            printUsage(std::cerr, crcs);
+            printUsage(std::cerr);
             return 1;
         }
 
         command->run();
+        command->closeFiles();
+        command->printStats(std::cerr, statsCollector);
         return 0;
     }
     catch (std::exception &e)
@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "lib/crc_factories.h"
+#include "tests/test_crc_reference.h"
+
+namespace
+{
+    const size_t HeaderSize = 18;
+
+    uint32_t readValue(const uint8_t *data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    /**
+     * Builtin algorithms get their generated tables checked, custom ones
+     * cover widths and bit orders that no builtin has.
+     */
+    std::shared_ptr<CRC> createEngine(const uint8_t *header)
+    {
+        auto builtins = getBuiltinSpecs();
+        if (header[0] < 0x80)
+            return findBuiltinCRC(builtins[header[0] % builtins.size()].name);
+
+        size_t numBits = 8 * (1 + header[1] % 4);
+        CRC::Value mask = (1ull << numBits) - 1;
+        return std::shared_ptr<CRC>(createCustomCRC(
+            numBits,
+            (readValue(header + 2) & mask) | 1,
+            readValue(header + 6) & mask,
+            readValue(header + 10) & mask,
+            header[0] & 1));
+    }
+}
+
+/**
+ * Input layout: algorithm choice and parameters, then the seed for splits
+ * and patch positions, a zero run to splice in, and the data itself.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < HeaderSize)
+        return 0;
+
+    auto crc = createEngine(data);
+    uint64_t seed = readValue(data + 14) ^ size;
+    std::vector<uint8_t> content(data + HeaderSize, data + size);
+
+    //long zero runs are unlikely to come from mutations alone
+    auto zerosPos = seed % (content.size() + 1);
+    content.insert(
+        content.begin() + zerosPos, (data[1] >> 2) * 256, 0);
+
+    auto mismatch = findReferenceMismatch(*crc, content, seed, false);
+    if (!mismatch.empty())
+    {
+        fprintf(stderr, "%s: %s\n", crc->getSpecs().name.c_str(),
+            mismatch.c_str());
+        abort();
+    }
+    return 0;
+}
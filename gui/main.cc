@@ -4,6 +4,7 @@
 #endif
 
 #include "gui/main_window.h"
+#include "lib/profile.h"
 
 #ifdef _WIN32
 Q_IMPORT_PLUGIN (QWindowsIntegrationPlugin)
@@ -12,6 +13,7 @@ Q_IMPORT_PLUGIN (QWindowsIntegrationPlugin)
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+    activateDefaultProfile();
     MainWindow w;
     w.show();
     return app.exec();
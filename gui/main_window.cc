@@ -31,58 +31,35 @@ namespace
     }
 }
 
-Patcher::Patcher(
-    std::unique_ptr<CRC> crc,
-    std::unique_ptr<File> inputFile,
-    std::unique_ptr<File> outputFile,
-    uint32_t checksum,
-    File::OffsetType position)
-    : crc(std::move(crc)),
-        inputFile(std::move(inputFile)),
-        outputFile(std::move(outputFile)),
-        checksum(checksum),
-        position(position)
-{
-}
-
-Patcher::~Patcher()
-{
-}
-
-void Patcher::run()
-{
-    Progress progress;
-    progress.changed = [&](double percentage)
-        { emit progressChanged(percentage); };
-
-    try
-    {
-        crc->applyPatch(
-            checksum,
-            position,
-            *inputFile,
-            *outputFile,
-            false,
-            progress,
-            progress);
-    }
-    catch (std::exception &ex)
-    {
-        emit errorOccurred(std::string(ex.what()) + ".");
-    }
-}
-
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    progressTimer(new QTimer(this))
 {
     ui->setupUi(this);
+    progressTimer->setInterval(100);
+    connect(
+        progressTimer, SIGNAL(timeout()),
+        this, SLOT(progressTimerTicked()));
     setWindowTitle(windowTitle() + " v" + CRCMANIP_VERSION);
     changeStatus(*ui, "Ready");
 }
 
+/**
+ * Doesn't leave a half written output behind when closed mid-patch.
+ */
 MainWindow::~MainWindow()
 {
+    if (job == nullptr)
+        return;
+    job->cancel();
+    try
+    {
+        job->get();
+    }
+    catch (...)
+    {
+    }
 }
 
 void MainWindow::on_inputPathLineEdit_textChanged(const QString &newText)
@@ -129,9 +106,7 @@ void MainWindow::on_patchPushButton_clicked()
     auto inputPath = ui->inputPathLineEdit->text().toStdString();
     auto outputPath = ui->outputPathLineEdit->text().toStdString();
 
-    std::unique_ptr<CRC> crc(createCRC32());
     std::unique_ptr<File> inputFile;
-    std::unique_ptr<File> outputFile;
 
     try
     {
@@ -144,43 +119,45 @@ void MainWindow::on_patchPushButton_clicked()
         return;
     }
 
-    try
-    {
-        outputFile = File::fromFileName(
-            outputPath, File::Mode::Write | File::Mode::Binary);
-    }
-    catch (...)
-    {
-        finishWork(*ui, "Can't open output file.", false);
-        return;
-    }
-
     File::OffsetType targetPosition = inputFile->getSize();
+    inputFile.reset();
 
-    Patcher *patcher = new Patcher(
-        std::move(crc),
-        std::move(inputFile),
-        std::move(outputFile),
+    job = Job::applyPatch(
+        std::shared_ptr<const CRC>(createCRC32()),
         targetChecksum,
-        targetPosition);
-
-    connect(
-        patcher, SIGNAL(progressChanged(double)),
-        this, SLOT(progressChanged(double)));
-
-    connect(
-        patcher, SIGNAL(errorOccurred(const std::string &)),
-        this, SLOT(errorOccurred(const std::string &)));
-
-    connect(
-        patcher, SIGNAL(finished()),
-        this, SLOT(workFinished()));
+        targetPosition,
+        inputPath,
+        outputPath,
+        false,
+        true);
+
+    //the bar samples the job's progress instead of being signaled about
+    //every chunk it processes
+    auto showProgress = [this](double percentage)
+        { ui->progressBar->setValue(percentage); };
+    job->getChecksumProgress().changed = showProgress;
+    job->getWriteProgress().changed = showProgress;
+    progressTimer->start();
+}
 
-    connect(
-        patcher, SIGNAL(finished()),
-        patcher, SLOT(deleteLater()));
+void MainWindow::progressTimerTicked()
+{
+    job->getChecksumProgress().poll();
+    job->getWriteProgress().poll();
+    if (!job->isDone())
+        return;
 
-    patcher->start();
+    progressTimer->stop();
+    try
+    {
+        job->get();
+        workFinished();
+    }
+    catch (std::exception &ex)
+    {
+        errorOccurred(std::string(ex.what()) + ".");
+    }
+    job.reset();
 }
 
 void MainWindow::workStarted()
@@ -188,11 +165,6 @@ void MainWindow::workStarted()
     startWork(*ui);
 }
 
-void MainWindow::progressChanged(double progress)
-{
-    ui->progressBar->setValue(progress);
-}
-
 void MainWindow::errorOccurred(const std::string &message)
 {
     finishWork(*ui, message, false);
@@ -1,45 +1,17 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 #include <QMainWindow>
-#include <QThread>
+#include <QTimer>
 #include <memory>
 #include "lib/crc_factories.h"
 #include "lib/file.h"
+#include "lib/job.h"
 
 namespace Ui
 {
     class MainWindow;
-    class Patcher;
 }
 
-class Patcher : public QThread
-{
-    Q_OBJECT
-
-    public:
-        explicit Patcher(
-            std::unique_ptr<CRC> crc,
-            std::unique_ptr<File> inputFile,
-            std::unique_ptr<File> outputFile,
-            uint32_t checksum,
-            File::OffsetType position);
-        ~Patcher();
-
-    signals:
-        void progressChanged(double progress);
-        void errorOccurred(const std::string &message);
-
-    private:
-        void run();
-
-        std::unique_ptr<CRC> crc;
-        std::unique_ptr<File> inputFile;
-        std::unique_ptr<File> outputFile;
-        uint32_t checksum;
-        File::OffsetType position;
-        std::function<void()> endFunction;
-};
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -55,13 +27,15 @@ private slots:
     void on_inputPathLineEdit_textChanged(const QString &);
     void on_outputPathLineEdit_textChanged(const QString &);
 
-    void progressChanged(double progress);
+    void progressTimerTicked();
     void workStarted();
     void errorOccurred(const std::string &message);
     void workFinished();
 
 private:
     std::unique_ptr<Ui::MainWindow> ui;
+    QTimer *progressTimer;
+    std::shared_ptr<Job> job;
 };
 
 #endif
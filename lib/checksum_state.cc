@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include "checksum_state.h"
+
+namespace
+{
+    const char *Magic = "crcmanip-state";
+    const char *CacheMagic = "crcmanip-states";
+    const int Version = 1;
+    const File::OffsetType MaxTailSize = 65536;
+
+    uint64_t computeFingerprint(
+        File &input, File::OffsetType startPos, File::OffsetType endPos)
+    {
+        //FNV-1a; independent of the CRC so that CRC16 states aren't weak
+        uint64_t hash = 0xCBF29CE484222325ull;
+        auto size = static_cast<size_t>(endPos - startPos);
+        std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
+        File::OffsetType oldPos = input.tell();
+        input.seek(startPos, File::Origin::Start);
+        input.read(buffer.get(), size);
+        input.seek(oldPos, File::Origin::Start);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= buffer[i];
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    void resetState(const CRC &crc, ChecksumState &state)
+    {
+        state.algorithm = crc.getSpecs().name;
+        state.state = crc.getSpecs().initialXOR;
+        state.size = 0;
+        state.tailSize = 0;
+        state.tailFingerprint = 0;
+    }
+
+    bool readState(std::istream &stream, ChecksumState &state)
+    {
+        stream
+            >> state.algorithm
+            >> std::hex >> state.state
+            >> std::dec >> state.size >> state.tailSize
+            >> std::hex >> state.tailFingerprint
+            >> std::dec;
+        return !stream.fail();
+    }
+
+    void writeState(std::ostream &stream, const ChecksumState &state)
+    {
+        stream
+            << state.algorithm << "\n"
+            << std::hex << state.state << "\n"
+            << std::dec << state.size << " " << state.tailSize << "\n"
+            << std::hex << state.tailFingerprint << "\n"
+            << std::dec;
+    }
+
+    /**
+     * Written aside and renamed, so that an interrupted run doesn't leave
+     * a half-written file behind.
+     */
+    void saveFile(
+        const std::string &path,
+        const std::function<void(std::ostream &stream)> &write)
+    {
+        auto tmpPath = path + ".tmp";
+        {
+            std::ofstream stream(tmpPath);
+            write(stream);
+            if (!stream)
+                throw std::runtime_error("Can't write state file: " + path);
+        }
+
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(path.c_str());
+            if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+                throw std::runtime_error("Can't write state file: " + path);
+        }
+    }
+
+    bool canResume(const CRC &crc, File &input, const ChecksumState &state)
+    {
+        if (state.algorithm != crc.getSpecs().name)
+            return false;
+        if (state.size < 0 || state.size > input.getSize())
+            return false;
+        if (state.tailSize < 0 || state.tailSize > state.size)
+            return false;
+        return computeFingerprint(
+            input, state.size - state.tailSize, state.size)
+                == state.tailFingerprint;
+    }
+}
+
+bool loadChecksumState(const std::string &path, ChecksumState &state)
+{
+    std::ifstream stream(path);
+    if (!stream)
+        return false;
+
+    std::string magic;
+    int version;
+    stream >> magic >> version;
+    if (!stream || magic != Magic || version != Version)
+        throw std::runtime_error("Invalid state file: " + path);
+
+    if (!readState(stream, state))
+        throw std::runtime_error("Invalid state file: " + path);
+    return true;
+}
+
+void saveChecksumState(const std::string &path, const ChecksumState &state)
+{
+    saveFile(path, [&](std::ostream &stream)
+    {
+        stream << Magic << " " << Version << "\n";
+        writeState(stream, state);
+    });
+}
+
+bool loadChecksumStates(
+    const std::string &path, std::map<std::string, ChecksumState> &states)
+{
+    std::ifstream stream(path);
+    if (!stream)
+        return false;
+
+    std::string magic;
+    int version;
+    stream >> magic >> version;
+    if (!stream || magic != CacheMagic || version != Version)
+        throw std::runtime_error("Invalid state file: " + path);
+
+    std::string filePath;
+    while (std::getline(stream >> std::ws, filePath))
+    {
+        if (!readState(stream, states[filePath]))
+            throw std::runtime_error("Invalid state file: " + path);
+    }
+    return true;
+}
+
+void saveChecksumStates(
+    const std::string &path,
+    const std::map<std::string, ChecksumState> &states)
+{
+    saveFile(path, [&](std::ostream &stream)
+    {
+        stream << CacheMagic << " " << Version << "\n";
+        for (auto &state : states)
+        {
+            stream << state.first << "\n";
+            writeState(stream, state.second);
+        }
+    });
+}
+
+CRC::Value updateChecksumState(
+    const CRC &crc,
+    File &input,
+    ChecksumState &state,
+    Progress &progress,
+    bool *resumed)
+{
+    bool ok = canResume(crc, input, state);
+    if (!ok)
+        resetState(crc, state);
+    if (resumed != nullptr)
+        *resumed = ok;
+
+    auto endPos = input.getSize();
+    state.state = crc.computePartialChecksum(
+        input, state.size, endPos, state.state, progress);
+    state.size = endPos;
+    state.tailSize = std::min(MaxTailSize, endPos);
+    state.tailFingerprint = computeFingerprint(
+        input, endPos - state.tailSize, endPos);
+
+    return crc.finalizeChecksum(state.state, state.size);
+}
@@ -0,0 +1,49 @@
+#ifndef CHECKSUM_STATE_H
+#define CHECKSUM_STATE_H
+#include <map>
+#include <string>
+#include "crc.h"
+
+/**
+ * Running CRC state of a file that is only ever appended to. Lets the
+ * checksum be resumed from the last known size instead of from scratch.
+ */
+struct ChecksumState
+{
+    std::string algorithm;
+    CRC::Value state;
+    File::OffsetType size;
+    File::OffsetType tailSize;
+    uint64_t tailFingerprint;
+};
+
+/**
+ * Returns false if the state file doesn't exist yet.
+ */
+bool loadChecksumState(const std::string &path, ChecksumState &state);
+void saveChecksumState(const std::string &path, const ChecksumState &state);
+
+/**
+ * Same as above, for states of many files kept in one file, keyed by path.
+ */
+bool loadChecksumStates(
+    const std::string &path, std::map<std::string, ChecksumState> &states);
+void saveChecksumStates(
+    const std::string &path,
+    const std::map<std::string, ChecksumState> &states);
+
+/**
+ * Brings the state up to date with the current file content and returns the
+ * finalized checksum. If the file was truncated, rewritten near its former
+ * end or the state belongs to another algorithm, the state is discarded and
+ * the whole file is read again.
+ * Returns true through resumed if the previous state could be reused.
+ */
+CRC::Value updateChecksumState(
+    const CRC &crc,
+    File &inputFile,
+    ChecksumState &state,
+    Progress &progress,
+    bool *resumed = nullptr);
+
+#endif
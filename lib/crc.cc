@@ -1,5 +1,13 @@
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
 #include "crc.h"
+#include "gf2.h"
 
 /**
  * NOTICE: following code is strongly based on SAR-PR-2006-05
@@ -7,13 +15,22 @@
 
 namespace
 {
-    const size_t BufferSize = 8192;
+    //independent registers updated together in the batch kernel
+    const size_t NumLanes = 4;
 
-    size_t getChunkSize(File::OffsetType currentPos, File::OffsetType maxPos)
+    //zero runs shorter than that are cheaper to step through byte by byte
+    const size_t ZeroRunThreshold = 256;
+    const size_t ZeroBlockSize = 16;
+
+    size_t getChunkSize(
+        const File &input,
+        File::OffsetType currentPos,
+        File::OffsetType maxPos)
     {
-        if (currentPos + static_cast<File::OffsetType>(BufferSize) >= maxPos)
+        auto chunkSize = static_cast<File::OffsetType>(input.getChunkSize());
+        if (currentPos + chunkSize >= maxPos)
             return maxPos - currentPos;
-        return BufferSize;
+        return chunkSize;
     }
 
     CRC::Value getPolynomialReverse(CRC::Value polynomial, size_t numBytes)
@@ -41,6 +58,306 @@ namespace
     {
         return (1ull << bits) - 1ull;
     }
+
+    /**
+     * Linear map over the bits of CRC register, stored as the images of
+     * each single bit. Feeding zero bytes is such a map, which lets us skip
+     * over known data without touching it byte by byte.
+     */
+    struct Operator
+    {
+        CRC::Value columns[32];
+
+        CRC::Value apply(CRC::Value value) const
+        {
+            CRC::Value result = 0;
+            for (size_t i = 0; value; i++, value >>= 1)
+                if (value & 1)
+                    result ^= columns[i];
+            return result;
+        }
+
+        Operator multiply(const Operator &other) const
+        {
+            Operator result;
+            for (size_t i = 0; i < 32; i++)
+                result.columns[i] = apply(other.columns[i]);
+            return result;
+        }
+    };
+
+    const size_t MaxShiftBits = 64;
+
+    /**
+     * Finds an affine subspace of byte values that fits in given set, as
+     * large as greedy search allows. Values of linear patch bytes can only
+     * range over such a subspace.
+     */
+    void findByteSubspace(
+        const CRC::ByteSet &allowedBytes,
+        uint8_t &bestBase,
+        std::vector<uint8_t> &bestDirections)
+    {
+        std::vector<uint8_t> candidates;
+        for (size_t bit = 0; bit < 8; bit++)
+            candidates.push_back(1 << bit);
+        for (size_t value = 1; value < 256; value++)
+            if (value & (value - 1))
+                candidates.push_back(value);
+
+        bool found = false;
+        for (size_t base = 0; base < 256; base++)
+        {
+            if (!allowedBytes[base])
+                continue;
+
+            std::vector<uint8_t> subspace = {static_cast<uint8_t>(base)};
+            std::vector<uint8_t> directions;
+            for (auto direction : candidates)
+            {
+                bool fits = true;
+                for (auto value : subspace)
+                {
+                    uint8_t shifted = value ^ direction;
+                    if (!allowedBytes[shifted] || shifted == base)
+                    {
+                        fits = false;
+                        break;
+                    }
+                }
+                if (!fits)
+                    continue;
+                auto size = subspace.size();
+                for (size_t i = 0; i < size; i++)
+                    subspace.push_back(subspace[i] ^ direction);
+                directions.push_back(direction);
+            }
+
+            if (!found || directions.size() > bestDirections.size())
+            {
+                found = true;
+                bestBase = base;
+                bestDirections = directions;
+            }
+        }
+
+        if (!found)
+            throw std::invalid_argument("No bytes are allowed in the patch");
+    }
+
+    bool isZeroBlock(const uint8_t *data)
+    {
+        #if defined(__SSE2__)
+            auto block = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data));
+            auto zeros = _mm_cmpeq_epi8(block, _mm_setzero_si128());
+            return _mm_movemask_epi8(zeros) == 0xFFFF;
+        #else
+            uint64_t words[2];
+            memcpy(words, data, sizeof(words));
+            return !(words[0] | words[1]);
+        #endif
+    }
+
+    /**
+     * Lists runs of zero bytes at least ZeroRunThreshold long as ascending
+     * [start, end) pairs, checking a whole block at a time. Runs start at a
+     * block boundary; the few zeros before that aren't worth finding.
+     */
+    std::vector<std::pair<size_t, size_t>> findZeroRuns(
+        const uint8_t *data, size_t size)
+    {
+        std::vector<std::pair<size_t, size_t>> runs;
+        size_t runStart = 0;
+        size_t pos = 0;
+        for (; pos + ZeroBlockSize <= size; pos += ZeroBlockSize)
+        {
+            if (isZeroBlock(data + pos))
+                continue;
+            if (pos - runStart >= ZeroRunThreshold)
+                runs.push_back(std::make_pair(runStart, pos));
+            runStart = pos + ZeroBlockSize;
+        }
+        while (pos < size && !data[pos])
+            pos++;
+        if (pos - runStart >= ZeroRunThreshold)
+            runs.push_back(std::make_pair(runStart, pos));
+        return runs;
+    }
+
+    typedef std::vector<std::pair<File::OffsetType, File::OffsetType>> Holes;
+
+    /**
+     * Lists holes of a sparse file within given range as ascending
+     * [start, end) pairs. Files that can't report holes have none.
+     */
+    Holes findHoles(File &file, File::OffsetType start, File::OffsetType end)
+    {
+        Holes holes;
+        auto pos = start;
+        while (pos < end)
+        {
+            auto dataPos = std::min(file.findData(pos), end);
+            if (dataPos > pos)
+                holes.push_back(std::make_pair(pos, dataPos));
+            if (dataPos >= end)
+                break;
+            pos = std::min(file.findHole(dataPos), end);
+        }
+        return holes;
+    }
+
+    /**
+     * Copies given range of the input to the outputs, leaving holes in
+     * place of the input's holes. Everything written is also fed into the
+     * verifier, if there's one.
+     */
+    void copyRange(
+        File &input,
+        const std::vector<File*> &outputs,
+        File::OffsetType startPos,
+        File::OffsetType endPos,
+        uint8_t *buffer,
+        Progress &progress,
+        CRC::Stream *verifier)
+    {
+        auto holes = findHoles(input, startPos, endPos);
+        auto hole = holes.begin();
+        auto pos = startPos;
+        input.seek(pos, File::Origin::Start);
+
+        while (pos < endPos)
+        {
+            progress.set(pos);
+            if (hole != holes.end() && hole->first == pos)
+            {
+                for (auto output : outputs)
+                    output->writeZeros(hole->second - pos);
+                if (verifier != nullptr)
+                    verifier->updateZeros(hole->second - pos);
+                pos = hole->second;
+                input.seek(pos, File::Origin::Start);
+                ++hole;
+                continue;
+            }
+
+            auto chunkSize = getChunkSize(
+                input,
+                pos,
+                hole != holes.end() ? hole->first : endPos);
+            input.read(buffer, chunkSize);
+            for (auto output : outputs)
+                output->write(buffer, chunkSize);
+            if (verifier != nullptr)
+                verifier->update(buffer, chunkSize);
+            pos += chunkSize;
+        }
+    }
+
+    /**
+     * Copies the input to the outputs, writing i-th patch to i-th output at
+     * given position along the way. The verifier, if any, sees what goes
+     * to the first output.
+     */
+    void copyWithPatches(
+        const std::vector<std::vector<uint8_t>> &patches,
+        File::OffsetType targetPos,
+        File &input,
+        const std::vector<File*> &outputs,
+        bool overwrite,
+        Progress &progress,
+        CRC::Stream *verifier = nullptr)
+    {
+        std::unique_ptr<uint8_t[]> buffer(new uint8_t[input.getChunkSize()]);
+        progress.start(input.getSize(), Progress::Phase::Copy);
+
+        //output first half
+        copyRange(
+            input, outputs, 0, targetPos, buffer.get(), progress, verifier);
+
+        //output patch
+        for (size_t n = 0; n < outputs.size(); n++)
+            outputs[n]->write(patches[n].data(), patches[n].size());
+        if (verifier != nullptr)
+            verifier->update(patches[0].data(), patches[0].size());
+        File::OffsetType pos = targetPos;
+        if (overwrite)
+            pos += patches[0].size();
+
+        //output second half
+        copyRange(
+            input,
+            outputs,
+            pos,
+            input.getSize(),
+            buffer.get(),
+            progress,
+            verifier);
+
+        progress.finish();
+    }
+
+    /**
+     * Copies the input to the output, XORing bytes at given ascending
+     * positions along the way.
+     */
+    void copyWithFlips(
+        const std::vector<std::pair<File::OffsetType, uint8_t>> &flips,
+        File &input,
+        File &output,
+        Progress &progress)
+    {
+        std::unique_ptr<uint8_t[]> buffer(new uint8_t[input.getChunkSize()]);
+
+        //flipped bytes can't stay in a hole, so cut them out of holes
+        Holes holes;
+        auto it = flips.begin();
+        for (auto hole : findHoles(input, 0, input.getSize()))
+        {
+            for (; it != flips.end() && it->first < hole.second; ++it)
+            {
+                if (it->first < hole.first)
+                    continue;
+                if (it->first > hole.first)
+                    holes.push_back(std::make_pair(hole.first, it->first));
+                hole.first = it->first + 1;
+            }
+            if (hole.first < hole.second)
+                holes.push_back(hole);
+        }
+
+        input.seek(0, File::Origin::Start);
+        File::OffsetType pos = input.tell();
+        progress.start(input.getSize(), Progress::Phase::Copy);
+
+        it = flips.begin();
+        auto hole = holes.begin();
+        while (pos < input.getSize())
+        {
+            progress.set(pos);
+            if (hole != holes.end() && hole->first == pos)
+            {
+                output.writeZeros(hole->second - pos);
+                pos = hole->second;
+                input.seek(pos, File::Origin::Start);
+                ++hole;
+                continue;
+            }
+
+            auto chunkSize = getChunkSize(
+                input,
+                pos,
+                hole != holes.end() ? hole->first : input.getSize());
+            input.read(buffer.get(), chunkSize);
+            auto chunkEnd = pos + static_cast<File::OffsetType>(chunkSize);
+            for (; it != flips.end() && it->first < chunkEnd; ++it)
+                buffer[it->first - pos] ^= it->second;
+            output.write(buffer.get(), chunkSize);
+            pos = chunkEnd;
+        }
+
+        progress.finish();
+    }
 }
 
 struct CRC::Internals
@@ -51,7 +368,51 @@ struct CRC::Internals
     Value lookupTable[256];
     Value invLookupTable[256];
 
+    //shift operators over 2^k zero bytes, forwards and backwards
+    std::vector<Operator> zeroOperators;
+    std::vector<Operator> invZeroOperators;
+
+    /**
+     * Everything that patch computation needs to know about the input.
+     * Once known, the patch for any target checksum costs O(1).
+     */
+    struct PatchContext
+    {
+        Value before; //register before the patch
+        Value after; //register before the data that follows the patch
+        Value end; //register after the whole input
+        Operator suffixInverse; //rewinds over the data after the patch
+        File::OffsetType outputSize;
+    };
+
+    /**
+     * Output byte that a linear patch is free to change. Its value is base
+     * XOR any combination of the directions.
+     */
+    struct FreeByte
+    {
+        File::OffsetType position;
+        uint8_t base;
+        std::vector<uint8_t> directions;
+        uint8_t value;
+    };
+
     Internals(CRC &crc, const CRC::Specs &specs);
+    Internals(CRC &crc, const CRC::Specs &specs, const CRC::Tables &tables);
+
+    void buildLookupTables();
+    void buildZeroOperators();
+
+    std::vector<Value> computeCheckpoints(
+        File &inputFile,
+        const std::vector<File::OffsetType> &positions,
+        Progress &progress) const;
+
+    static std::vector<std::vector<Value>> computeCheckpoints(
+        const std::vector<const Internals*> &engines,
+        File &inputFile,
+        const std::vector<File::OffsetType> &positions,
+        Progress &progress);
 
     Value computePartialChecksum(
         File &inputFile,
@@ -60,6 +421,17 @@ struct CRC::Internals
         Value initialChecksum,
         Progress &progress) const;
 
+    Value computeMaskedChecksum(
+        File &inputFile,
+        const std::vector<CRC::Mask> &masks,
+        Progress &progress) const;
+
+    std::vector<File::OffsetType> findWindows(
+        File &inputFile,
+        File::OffsetType windowSize,
+        Value targetChecksum,
+        Progress &progress) const;
+
     Value computeReversePartialChecksum(
         File &inputFile,
         File::OffsetType startPosition,
@@ -74,6 +446,55 @@ struct CRC::Internals
         bool overwrite,
         Progress &progress) const;
 
+    std::vector<std::pair<File::OffsetType, uint8_t>> computeScatteredPatch(
+        Value targetChecksum,
+        const std::vector<CRC::Region> &regions,
+        File &inputFile,
+        Progress &progress) const;
+
+    PatchContext computePatchContext(
+        File::OffsetType targetPosition,
+        File &inputFile,
+        bool overwrite,
+        Progress &progress) const;
+
+    PatchContext computePatchContext(
+        size_t targetPosition,
+        const uint8_t *data,
+        size_t size,
+        bool overwrite) const;
+
+    PatchContext computePartPatchContext(
+        const std::vector<File*> &parts,
+        size_t patchedPart,
+        File::OffsetType targetPosition,
+        bool overwrite,
+        Progress &progress) const;
+
+    Value computePatch(
+        Value targetChecksum, const PatchContext &context) const;
+
+    Value unwindFileSize(
+        Value targetChecksum, File::OffsetType fileSize) const;
+
+    Value solvePatch(Value checksumBefore, Value checksumAfter) const;
+
+    std::vector<uint8_t> getPatchBytes(Value patch) const;
+
+    static bool solveLinearPatch(
+        const std::vector<const Internals*> &engines,
+        const std::vector<Value> &deltas,
+        File::OffsetType outputSize,
+        std::vector<FreeByte> &freeBytes);
+
+    Operator getShiftOperator(uint64_t numBytes, bool inverse) const;
+    Value shift(Value checksum, uint64_t numBytes, bool inverse) const;
+
+    Value feed(Value checksum, const uint8_t *data, size_t size) const;
+    void feedLanes(
+        Value *checksums, const uint8_t *const *data, size_t size) const;
+    Value unfeed(Value checksum, const uint8_t *data, size_t size) const;
+
     Value next(Value prevChecksum, uint8_t c) const;
     Value prev(Value nextChecksum, uint8_t c) const;
 };
@@ -82,6 +503,11 @@ CRC::CRC(const CRC::Specs &specs) : internals(new Internals(*this, specs))
 {
 }
 
+CRC::CRC(const CRC::Specs &specs, const CRC::Tables &tables)
+    : internals(new Internals(*this, specs, tables))
+{
+}
+
 CRC::~CRC()
 {
 }
@@ -91,9 +517,31 @@ const CRC::Specs &CRC::getSpecs() const
     return internals->specs;
 }
 
+void CRC::getTables(CRC::Tables &tables) const
+{
+    memcpy(tables.lookup, internals->lookupTable, sizeof(tables.lookup));
+    memcpy(
+        tables.invLookup,
+        internals->invLookupTable,
+        sizeof(tables.invLookup));
+    for (size_t k = 0; k < MaxShiftBits; k++)
+    {
+        memcpy(
+            tables.zeroOperators[k],
+            internals->zeroOperators[k].columns,
+            sizeof(tables.zeroOperators[k]));
+        memcpy(
+            tables.invZeroOperators[k],
+            internals->invZeroOperators[k].columns,
+            sizeof(tables.invZeroOperators[k]));
+    }
+}
+
 /**
  * Method that copies the input to the output, outputting
  * computed patch at given position along the way.
+ * With verify set, the checksum of the bytes written is computed as they
+ * go out, which proves the output right without reading it back.
  */
 void CRC::applyPatch(
     CRC::Value finalChecksum,
@@ -102,48 +550,391 @@ void CRC::applyPatch(
     File &output,
     bool overwrite,
     Progress &writeProgress,
-    Progress &checksumProgress) const
+    Progress &checksumProgress,
+    bool verify) const
 {
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[BufferSize]);
     CRC::Value patch = internals->computePatch(
         finalChecksum, targetPos, input, overwrite, checksumProgress);
 
-    input.seek(0, File::Origin::Start);
-    File::OffsetType pos = input.tell();
-    writeProgress.start(input.getSize());
+    Stream verifier(*this);
+    copyWithPatches(
+        {internals->getPatchBytes(patch)},
+        targetPos,
+        input,
+        {&output},
+        overwrite,
+        writeProgress,
+        verify ? &verifier : nullptr);
+
+    if (verify && verifier.finalize() != finalChecksum)
+        throw std::runtime_error("Patched output doesn't match the checksum");
+}
+
+/**
+ * Computes patch bytes for data held in memory. Writing them at given
+ * position makes the data match the target checksum.
+ */
+std::vector<uint8_t> CRC::computePatch(
+    CRC::Value targetChecksum,
+    const uint8_t *data,
+    size_t size,
+    size_t targetPos,
+    bool overwrite) const
+{
+    auto patchSize = overwrite ? internals->specs.numBytes : 0;
+    if (targetPos > size || targetPos + patchSize > size)
+        throw std::invalid_argument("Patch doesn't fit in the data");
+    auto context = internals->computePatchContext(
+        targetPos, data, size, overwrite);
+    return internals->getPatchBytes(
+        internals->computePatch(targetChecksum, context));
+}
+
+/**
+ * Computes patch for one part of a multi-part set (such as split archive
+ * volumes), so that the concatenation of all parts matches the target.
+ * Each part is read once; parts after the patched one are combined with
+ * the shift operator rather than by rewinding through them.
+ */
+CRC::Value CRC::computePartPatch(
+    CRC::Value targetChecksum,
+    const std::vector<File*> &parts,
+    size_t patchedPart,
+    File::OffsetType targetPos,
+    bool overwrite,
+    Progress &progress) const
+{
+    if (patchedPart >= parts.size())
+        throw std::invalid_argument("Patched part is out of range");
+    auto context = internals->computePartPatchContext(
+        parts, patchedPart, targetPos, overwrite, progress);
+    return internals->computePatch(targetChecksum, context);
+}
+
+/**
+ * Copies the patched part to the output; other parts are left as they are.
+ */
+void CRC::applyPartPatch(
+    CRC::Value targetChecksum,
+    const std::vector<File*> &parts,
+    size_t patchedPart,
+    File::OffsetType targetPos,
+    File &output,
+    bool overwrite,
+    Progress &writeProgress,
+    Progress &checksumProgress) const
+{
+    CRC::Value patch = computePartPatch(
+        targetChecksum,
+        parts,
+        patchedPart,
+        targetPos,
+        overwrite,
+        checksumProgress);
+
+    copyWithPatches(
+        {internals->getPatchBytes(patch)},
+        targetPos,
+        *parts[patchedPart],
+        {&output},
+        overwrite,
+        writeProgress);
+}
+
+/**
+ * Returns which bits within given regions of the input need to be flipped,
+ * as positions and XOR masks, to make it match the target checksum.
+ * The input is read once.
+ */
+std::vector<std::pair<File::OffsetType, uint8_t>> CRC::computeScatteredPatch(
+    CRC::Value targetChecksum,
+    const std::vector<CRC::Region> &regions,
+    File &input,
+    Progress &progress) const
+{
+    return internals->computeScatteredPatch(
+        targetChecksum, regions, input, progress);
+}
+
+/**
+ * Copies the input to the output, changing only bits within given regions
+ * so that the output matches the target checksum.
+ */
+void CRC::applyScatteredPatch(
+    CRC::Value targetChecksum,
+    const std::vector<CRC::Region> &regions,
+    File &input,
+    File &output,
+    Progress &writeProgress,
+    Progress &checksumProgress) const
+{
+    auto flips = internals->computeScatteredPatch(
+        targetChecksum, regions, input, checksumProgress);
+    copyWithFlips(flips, input, output, writeProgress);
+}
+
+/**
+ * Computes patches for many target checksums at once. The input is read
+ * only once; each additional target costs O(1).
+ */
+std::vector<CRC::Value> CRC::computePatches(
+    const std::vector<CRC::Value> &targetChecksums,
+    File::OffsetType targetPos,
+    File &input,
+    bool overwrite,
+    Progress &progress) const
+{
+    auto context = internals->computePatchContext(
+        targetPos, input, overwrite, progress);
+
+    std::vector<CRC::Value> patches;
+    patches.reserve(targetChecksums.size());
+    for (auto targetChecksum : targetChecksums)
+        patches.push_back(internals->computePatch(targetChecksum, context));
+    return patches;
+}
+
+/**
+ * Computes patches for the same target checksum at many positions, reading
+ * the input only once. Register after the patch at position p satisfies
+ *   after(p) = S(p') ^ Z^-(n-p') (target ^ S(n))
+ * where S is the register of the unpatched input, p' is where the data
+ * following the patch starts and Z is the zero byte operator, so walking
+ * the positions backwards costs a single rewind step per neighbor.
+ */
+std::vector<CRC::Value> CRC::computePatchesAtPositions(
+    CRC::Value targetChecksum,
+    const std::vector<File::OffsetType> &targetPositions,
+    File &input,
+    bool overwrite,
+    Progress &progress) const
+{
+    const auto &specs = internals->specs;
+    File::OffsetType patchSize = overwrite ? specs.numBytes : 0;
+    auto posEnd = input.getSize();
 
-    //output first half
-    while (pos < targetPos)
+    std::vector<File::OffsetType> checkpoints;
+    for (auto pos : targetPositions)
     {
-        writeProgress.set(pos);
-        auto chunkSize = getChunkSize(pos, targetPos);
-        input.read(buffer.get(), chunkSize);
-        output.write(buffer.get(), chunkSize);
-        pos += chunkSize;
+        if (pos < 0 || pos + patchSize > posEnd)
+        {
+            throw std::invalid_argument(
+                "Patch position is located outside available input");
+        }
+        checkpoints.push_back(pos);
+        checkpoints.push_back(pos + patchSize);
     }
+    checkpoints.push_back(posEnd);
+    std::sort(checkpoints.begin(), checkpoints.end());
+    checkpoints.erase(
+        std::unique(checkpoints.begin(), checkpoints.end()),
+        checkpoints.end());
+
+    auto checksums = internals->computeCheckpoints(
+        input, checkpoints, progress);
+    auto getChecksum = [&](File::OffsetType pos)
+    {
+        auto it = std::lower_bound(checkpoints.begin(), checkpoints.end(), pos);
+        return checksums[it - checkpoints.begin()];
+    };
+
+    targetChecksum ^= specs.finalXOR;
+    if (specs.flags & CRC::Flags::UseFileSize)
+    {
+        targetChecksum = internals->unwindFileSize(
+            targetChecksum, posEnd + (overwrite ? 0 : specs.numBytes));
+    }
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < targetPositions.size(); i++)
+        order.push_back(i);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+        { return targetPositions[a] > targetPositions[b]; });
+
+    std::vector<CRC::Value> patches(targetPositions.size());
+    CRC::Value rewound = targetChecksum ^ checksums.back();
+    File::OffsetType rewoundPos = posEnd;
+    for (auto i : order)
+    {
+        auto posAfterPatch = targetPositions[i] + patchSize;
+        rewound = internals->shift(rewound, rewoundPos - posAfterPatch, true);
+        rewoundPos = posAfterPatch;
+        patches[i] = internals->solvePatch(
+            getChecksum(targetPositions[i]),
+            getChecksum(posAfterPatch) ^ rewound);
+    }
+    return patches;
+}
+
+/**
+ * Copies the input to each of the outputs, outputting corresponding patch
+ * from computePatches() at given position. The input is read only once.
+ */
+void CRC::applyPatches(
+    const std::vector<CRC::Value> &patches,
+    File::OffsetType targetPos,
+    File &input,
+    const std::vector<File*> &outputs,
+    bool overwrite,
+    Progress &writeProgress) const
+{
+    if (patches.size() != outputs.size())
+        throw std::invalid_argument("Each output needs exactly one patch");
+
+    std::vector<std::vector<uint8_t>> patchBytes;
+    for (auto patch : patches)
+        patchBytes.push_back(internals->getPatchBytes(patch));
+    copyWithPatches(
+        patchBytes, targetPos, input, outputs, overwrite, writeProgress);
+}
+
+/**
+ * Computes patch that satisfies checksums of several algorithms at once,
+ * using only allowed bytes. The input is read only once for all of them.
+ * With restricted bytes the patch gets longer, which costs no extra reads.
+ */
+std::vector<uint8_t> CRC::computeMultiPatch(
+    const std::vector<const CRC*> &crcs,
+    const std::vector<CRC::Value> &targetChecksums,
+    File::OffsetType targetPos,
+    File &input,
+    bool overwrite,
+    const CRC::ByteSet &allowedBytes,
+    Progress &progress)
+{
+    //algorithms sharing parameters might need a few bytes more than the sum
+    //of their sizes before the equations become solvable
+    const size_t MaxExtraBytes = 8;
+
+    if (crcs.empty() || crcs.size() != targetChecksums.size())
+        throw std::invalid_argument("Each algorithm needs exactly one target");
+
+    std::vector<const Internals*> engines;
+    for (auto crc : crcs)
+        engines.push_back(crc->internals.get());
+    auto minPatchSize = getMultiPatchSize(crcs, allowedBytes);
+
+    uint8_t base;
+    std::vector<uint8_t> directions;
+    findByteSubspace(allowedBytes, base, directions);
 
-    //output patch
-    assert(internals->specs.numBytes < BufferSize);
-    for (size_t i = 0; i < internals->specs.numBytes; i++)
-        buffer[i] = static_cast<uint8_t>(patch >> (i << 3));
-    output.write(buffer.get(), internals->specs.numBytes);
+    auto posEnd = input.getSize();
+    std::vector<File::OffsetType> positions = {targetPos, posEnd};
     if (overwrite)
     {
-        pos += internals->specs.numBytes;
-        input.seek(pos, File::Origin::Start);
+        for (size_t extra = 0; extra <= MaxExtraBytes; extra++)
+            positions.push_back(std::min(
+                posEnd,
+                targetPos + static_cast<File::OffsetType>(
+                    minPatchSize + extra)));
     }
+    std::sort(positions.begin(), positions.end());
+    positions.erase(
+        std::unique(positions.begin(), positions.end()), positions.end());
+    auto checksums = Internals::computeCheckpoints(
+        engines, input, positions, progress);
+    auto getChecksum = [&](size_t engine, File::OffsetType pos)
+    {
+        auto it = std::lower_bound(positions.begin(), positions.end(), pos);
+        return checksums[engine][it - positions.begin()];
+    };
 
-    //output second half
-    while (pos < input.getSize())
+    for (auto patchSize = minPatchSize;
+        patchSize <= minPatchSize + MaxExtraBytes;
+        patchSize++)
     {
-        writeProgress.set(pos);
-        auto chunkSize = getChunkSize(pos, input.getSize());
-        input.read(buffer.get(), chunkSize);
-        output.write(buffer.get(), chunkSize);
-        pos += chunkSize;
+        File::OffsetType size = patchSize;
+        if (overwrite && targetPos + size > posEnd)
+            break;
+        auto outputSize = posEnd + (overwrite ? 0 : size);
+
+        //register of the output with zeros in place of the patch
+        std::vector<CRC::Value> deltas;
+        for (size_t e = 0; e < engines.size(); e++)
+        {
+            auto engine = engines[e];
+            auto target = targetChecksums[e] ^ engine->specs.finalXOR;
+            if (engine->specs.flags & CRC::Flags::UseFileSize)
+                target = engine->unwindFileSize(target, outputSize);
+
+            auto before = getChecksum(e, targetPos);
+            auto end = getChecksum(e, posEnd);
+            CRC::Value zeroed;
+            if (overwrite)
+            {
+                auto after = getChecksum(e, targetPos + size);
+                zeroed = end ^ engine->shift(
+                    after ^ engine->shift(before, size, false),
+                    posEnd - targetPos - size,
+                    false);
+            }
+            else
+            {
+                zeroed = end ^ engine->shift(
+                    before ^ engine->shift(before, size, false),
+                    posEnd - targetPos,
+                    false);
+            }
+            deltas.push_back(target ^ zeroed);
+        }
+
+        std::vector<Internals::FreeByte> freeBytes;
+        for (File::OffsetType i = 0; i < size; i++)
+        {
+            Internals::FreeByte freeByte;
+            freeByte.position = targetPos + i;
+            freeByte.base = base;
+            freeByte.directions = directions;
+            freeBytes.push_back(freeByte);
+        }
+
+        if (Internals::solveLinearPatch(
+            engines, deltas, outputSize, freeBytes))
+        {
+            std::vector<uint8_t> patch;
+            for (auto &freeByte : freeBytes)
+                patch.push_back(freeByte.value);
+            return patch;
+        }
     }
 
-    writeProgress.finish();
+    throw std::runtime_error("No patch satisfies all the checksums");
+}
+
+/**
+ * Returns the shortest patch computeMultiPatch() may produce. Each byte
+ * contributes as many bits as the largest affine subspace of the allowed
+ * bytes has dimensions.
+ */
+size_t CRC::getMultiPatchSize(
+    const std::vector<const CRC*> &crcs, const CRC::ByteSet &allowedBytes)
+{
+    uint8_t base;
+    std::vector<uint8_t> directions;
+    findByteSubspace(allowedBytes, base, directions);
+    if (directions.empty())
+        throw std::invalid_argument("Patch needs at least two allowed bytes");
+
+    size_t numBits = 0;
+    for (auto crc : crcs)
+        numBits += crc->getSpecs().numBytes * 8;
+    return (numBits + directions.size() - 1) / directions.size();
+}
+
+/**
+ * Copies the input to the output, outputting given patch bytes at given
+ * position along the way.
+ */
+void CRC::writePatch(
+    const std::vector<uint8_t> &patch,
+    File::OffsetType targetPos,
+    File &input,
+    File &output,
+    bool overwrite,
+    Progress &writeProgress)
+{
+    copyWithPatches(
+        {patch}, targetPos, input, {&output}, overwrite, writeProgress);
 }
 
 /**
@@ -154,10 +945,168 @@ CRC::Value CRC::computeChecksum(File &input, Progress &progress) const
 {
     CRC::Value checksum = internals->computePartialChecksum(
         input, 0, input.getSize(), internals->specs.initialXOR, progress);
+    return finalizeChecksum(checksum, input.getSize());
+}
 
+/**
+ * Computes the checksum of data held in memory.
+ */
+CRC::Value CRC::computeChecksum(const uint8_t *data, size_t size) const
+{
+    CRC::Value checksum = internals->feed(
+        internals->specs.initialXOR, data, size);
+    return finalizeChecksum(checksum, size);
+}
+
+/**
+ * Computes checksums of many small buffers at once. Buffers of similar
+ * size are grouped into lanes, which are fed in one interleaved loop so
+ * that table lookups of one buffer don't wait for another's.
+ */
+std::vector<CRC::Value> CRC::computeChecksums(
+    const std::vector<const uint8_t*> &data,
+    const std::vector<size_t> &sizes) const
+{
+    if (data.size() != sizes.size())
+        throw std::invalid_argument("Expected one size per buffer");
+
+    std::vector<size_t> order(data.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+        { return sizes[a] < sizes[b]; });
+
+    std::vector<CRC::Value> checksums(data.size());
+    for (size_t start = 0; start < order.size(); start += NumLanes)
+    {
+        auto end = std::min(start + NumLanes, order.size());
+        if (end - start < NumLanes)
+        {
+            for (size_t i = start; i < end; i++)
+                checksums[order[i]] = computeChecksum(
+                    data[order[i]], sizes[order[i]]);
+            continue;
+        }
+
+        //the first lane is the shortest, so all lanes have that much
+        auto commonSize = sizes[order[start]];
+        CRC::Value lanes[NumLanes];
+        const uint8_t *laneData[NumLanes];
+        for (size_t i = 0; i < NumLanes; i++)
+        {
+            lanes[i] = internals->specs.initialXOR;
+            laneData[i] = data[order[start + i]];
+        }
+        internals->feedLanes(lanes, laneData, commonSize);
+
+        for (size_t i = 0; i < NumLanes; i++)
+        {
+            auto index = order[start + i];
+            auto checksum = internals->feed(
+                lanes[i], data[index] + commonSize, sizes[index] - commonSize);
+            checksums[index] = finalizeChecksum(checksum, sizes[index]);
+        }
+    }
+    return checksums;
+}
+
+/**
+ * Computes the checksum of given file as if masked ranges were zeros, or
+ * weren't there at all. Neither are read; zeros are skipped over with the
+ * shift operator.
+ * NOTICE: Leaves internal file pointer position intact.
+ */
+CRC::Value CRC::computeMaskedChecksum(
+    File &input, const std::vector<CRC::Mask> &masks, Progress &progress) const
+{
+    auto sorted = masks;
+    std::sort(sorted.begin(), sorted.end(),
+        [](const CRC::Mask &a, const CRC::Mask &b)
+        { return a.offset < b.offset; });
+
+    File::OffsetType pos = 0;
+    File::OffsetType totalSize = input.getSize();
+    for (const auto &mask : sorted)
+    {
+        if (mask.offset < pos
+            || mask.size < 0
+            || mask.offset + mask.size > input.getSize())
+        {
+            throw std::invalid_argument(
+                "Masks must lie within the input and must not overlap");
+        }
+        pos = mask.offset + mask.size;
+        if (mask.skip)
+            totalSize -= mask.size;
+    }
+
+    CRC::Value checksum = internals->computeMaskedChecksum(
+        input, sorted, progress);
+    return finalizeChecksum(checksum, totalSize);
+}
+
+/**
+ * Returns offsets of all windows of given size whose checksum matches the
+ * target. The window slides over the input in O(1) per byte.
+ * NOTICE: Leaves internal file pointer position intact.
+ */
+std::vector<File::OffsetType> CRC::findWindows(
+    File &input,
+    File::OffsetType windowSize,
+    CRC::Value targetChecksum,
+    Progress &progress) const
+{
+    if (windowSize <= 0)
+        throw std::invalid_argument("Window size must be positive");
+    return internals->findWindows(
+        input, windowSize, targetChecksum, progress);
+}
+
+/**
+ * NOTICE: Leaves internal file pointer position intact.
+ */
+CRC::Value CRC::computePartialChecksum(
+    File &input,
+    File::OffsetType startPos,
+    File::OffsetType endPos,
+    CRC::Value initialState,
+    Progress &progress) const
+{
+    if (startPos < 0 || startPos > endPos || endPos > input.getSize())
+        throw std::invalid_argument("Invalid checksum range");
+    return internals->computePartialChecksum(
+        input, startPos, endPos, initialState, progress);
+}
+
+/**
+ * Feeds data held in memory into the CRC register.
+ */
+CRC::Value CRC::computePartialChecksum(
+    const uint8_t *data, size_t size, CRC::Value initialState) const
+{
+    return internals->feed(initialState, data, size);
+}
+
+/**
+ * Feeding data is affine in the register: starting from state instead of
+ * zero only adds state shifted over the data.
+ */
+CRC::Value CRC::combineStates(
+    CRC::Value state,
+    CRC::Value suffixState,
+    File::OffsetType suffixSize) const
+{
+    if (suffixSize < 0)
+        throw std::invalid_argument("Invalid suffix size");
+    return internals->shift(state, suffixSize, false) ^ suffixState;
+}
+
+CRC::Value CRC::finalizeChecksum(
+    CRC::Value checksum, File::OffsetType totalSize) const
+{
     if (internals->specs.flags & CRC::Flags::UseFileSize)
     {
-        auto fileSize = input.getSize();
+        auto fileSize = totalSize;
         while (fileSize)
         {
             checksum = internals->next(checksum, fileSize);
@@ -169,8 +1118,86 @@ CRC::Value CRC::computeChecksum(File &input, Progress &progress) const
         & getMask(internals->specs.numBytes << 3);
 }
 
+CRC::Stream::Stream(const CRC &crc)
+    : crc(crc), state(crc.getSpecs().initialXOR), size(0)
+{
+}
+
+CRC::Stream &CRC::Stream::update(const uint8_t *data, size_t size)
+{
+    state = crc.computePartialChecksum(data, size, state);
+    this->size += size;
+    return *this;
+}
+
+/**
+ * Appends data fed into the other stream, as if it was fed into this one.
+ * The other stream started from the initial XOR rather than from zero, so
+ * that is cancelled alongside this stream's register.
+ */
+CRC::Stream &CRC::Stream::combine(const CRC::Stream &other)
+{
+    if (&other.crc != &crc)
+        throw std::invalid_argument("Streams must share the same CRC");
+    state = crc.combineStates(
+        state ^ crc.getSpecs().initialXOR, other.state, other.size);
+    size += other.size;
+    return *this;
+}
+
+/**
+ * Same as feeding that many zero bytes, but takes logarithmic time.
+ */
+CRC::Stream &CRC::Stream::updateZeros(File::OffsetType size)
+{
+    state = crc.combineStates(state, 0, size);
+    this->size += size;
+    return *this;
+}
+
+CRC::Value CRC::Stream::finalize() const
+{
+    return crc.finalizeChecksum(state, size);
+}
+
+CRC::Value CRC::Stream::getState() const
+{
+    return state;
+}
+
+File::OffsetType CRC::Stream::getSize() const
+{
+    return size;
+}
+
 CRC::Internals::Internals(CRC &crc, const CRC::Specs &specs)
     : crc(crc), specs(specs)
+{
+    buildLookupTables();
+    buildZeroOperators();
+}
+
+CRC::Internals::Internals(
+    CRC &crc, const CRC::Specs &specs, const CRC::Tables &tables)
+    : crc(crc), specs(specs),
+        zeroOperators(MaxShiftBits), invZeroOperators(MaxShiftBits)
+{
+    memcpy(lookupTable, tables.lookup, sizeof(lookupTable));
+    memcpy(invLookupTable, tables.invLookup, sizeof(invLookupTable));
+    for (size_t k = 0; k < MaxShiftBits; k++)
+    {
+        memcpy(
+            zeroOperators[k].columns,
+            tables.zeroOperators[k],
+            sizeof(zeroOperators[k].columns));
+        memcpy(
+            invZeroOperators[k].columns,
+            tables.invZeroOperators[k],
+            sizeof(invZeroOperators[k].columns));
+    }
+}
+
+void CRC::Internals::buildLookupTables()
 {
     auto poly = specs.polynomial;
     auto polyRev = getPolynomialReverse(poly, specs.numBytes);
@@ -211,6 +1238,146 @@ CRC::Internals::Internals(CRC &crc, const CRC::Specs &specs)
     }
 }
 
+void CRC::Internals::buildZeroOperators()
+{
+    Operator zero, invZero;
+    for (size_t i = 0; i < 32; i++)
+    {
+        CRC::Value bit = i < specs.numBytes * 8 ? 1ull << i : 0;
+        zero.columns[i] = next(bit, 0);
+        invZero.columns[i] = prev(bit, 0);
+    }
+
+    for (size_t k = 0; k < MaxShiftBits; k++)
+    {
+        zeroOperators.push_back(zero);
+        invZeroOperators.push_back(invZero);
+        zero = zero.multiply(zero);
+        invZero = invZero.multiply(invZero);
+    }
+}
+
+Operator CRC::Internals::getShiftOperator(
+    uint64_t numBytes, bool inverse) const
+{
+    const auto &operators = inverse ? invZeroOperators : zeroOperators;
+    Operator result;
+    for (size_t i = 0; i < 32; i++)
+        result.columns[i] = i < specs.numBytes * 8 ? 1ull << i : 0;
+    for (size_t k = 0; numBytes; k++, numBytes >>= 1)
+        if (numBytes & 1)
+            result = operators[k].multiply(result);
+    return result;
+}
+
+/**
+ * Equivalent to feeding (or rewinding over) numBytes zero bytes.
+ */
+CRC::Value CRC::Internals::shift(
+    CRC::Value checksum, uint64_t numBytes, bool inverse) const
+{
+    //for short distances stepping is cheaper than applying operators
+    if (numBytes < 32)
+    {
+        for (; numBytes; numBytes--)
+            checksum = inverse ? prev(checksum, 0) : next(checksum, 0);
+        return checksum;
+    }
+
+    const auto &operators = inverse ? invZeroOperators : zeroOperators;
+    for (size_t k = 0; numBytes; k++, numBytes >>= 1)
+        if (numBytes & 1)
+            checksum = operators[k].apply(checksum);
+    return checksum;
+}
+
+/**
+ * Computes the register at each of given ascending positions in one pass.
+ * NOTICE: Leaves internal file pointer position intact.
+ */
+std::vector<CRC::Value> CRC::Internals::computeCheckpoints(
+    File &input,
+    const std::vector<File::OffsetType> &positions,
+    Progress &progress) const
+{
+    return computeCheckpoints({this}, input, positions, progress)[0];
+}
+
+/**
+ * Same as above, but for several algorithms sharing a single read.
+ */
+std::vector<std::vector<CRC::Value>> CRC::Internals::computeCheckpoints(
+    const std::vector<const Internals*> &engines,
+    File &input,
+    const std::vector<File::OffsetType> &positions,
+    Progress &progress)
+{
+    std::vector<std::vector<CRC::Value>> checksums(engines.size());
+    std::vector<CRC::Value> current;
+    for (auto engine : engines)
+        current.push_back(engine->specs.initialXOR);
+
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[input.getChunkSize()]);
+    File::OffsetType oldPos = input.tell();
+    File::OffsetType pos = 0;
+    auto holes = findHoles(
+        input, 0, positions.empty() ? 0 : positions.back());
+    auto hole = holes.begin();
+    input.seek(pos, File::Origin::Start);
+    progress.start(positions.empty() ? 0 : positions.back());
+
+    //checkpoints may be dense, so read whole chunks regardless of them
+    auto it = positions.begin();
+    auto record = [&]()
+    {
+        for (; it != positions.end() && *it == pos; ++it)
+            for (size_t i = 0; i < engines.size(); i++)
+                checksums[i].push_back(current[i]);
+    };
+    record();
+
+    while (it != positions.end())
+    {
+        progress.set(pos);
+        if (hole != holes.end() && hole->first <= pos)
+        {
+            auto stop = std::min(hole->second, *it);
+            for (size_t i = 0; i < engines.size(); i++)
+                current[i] = engines[i]->shift(current[i], stop - pos, false);
+            pos = stop;
+            if (pos == hole->second)
+                ++hole;
+            input.seek(pos, File::Origin::Start);
+            record();
+            continue;
+        }
+
+        auto chunkSize = getChunkSize(
+            input,
+            pos,
+            hole != holes.end() ? hole->first : positions.back());
+        input.read(buffer.get(), chunkSize);
+        auto chunkStart = pos;
+        auto chunkEnd = pos + static_cast<File::OffsetType>(chunkSize);
+        while (pos < chunkEnd)
+        {
+            assert(pos < *it);
+            auto stop = std::min(chunkEnd, *it);
+            for (size_t i = 0; i < engines.size(); i++)
+            {
+                current[i] = engines[i]->feed(
+                    current[i], buffer.get() + (pos - chunkStart), stop - pos);
+            }
+            pos = stop;
+            record();
+        }
+    }
+
+    progress.finish();
+    input.seek(oldPos, File::Origin::Start);
+    return checksums;
+}
+
 CRC::Value CRC::Internals::computePartialChecksum(
     File &input,
     File::OffsetType startPos,
@@ -223,19 +1390,82 @@ CRC::Value CRC::Internals::computePartialChecksum(
         return initialChecksum;
 
     CRC::Value checksum = initialChecksum;
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[BufferSize]);
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[input.getChunkSize()]);
     File::OffsetType oldPos = input.tell();
     File::OffsetType pos = startPos;
+    auto holes = findHoles(input, startPos, endPos);
+    auto hole = holes.begin();
     input.seek(pos, File::Origin::Start);
     progress.start(endPos - startPos);
 
     while (pos < endPos)
     {
         progress.set(pos - startPos);
-        auto chunkSize = getChunkSize(pos, endPos);
+        if (hole != holes.end() && hole->first == pos)
+        {
+            checksum = shift(checksum, hole->second - pos, false);
+            pos = hole->second;
+            input.seek(pos, File::Origin::Start);
+            ++hole;
+            continue;
+        }
+
+        auto chunkSize = getChunkSize(
+            input,
+            pos,
+            hole != holes.end() ? hole->first : endPos);
         input.read(buffer.get(), chunkSize);
-        for (size_t i = 0; i < chunkSize; i++)
-            checksum = next(checksum, buffer[i]);
+        checksum = feed(checksum, buffer.get(), chunkSize);
+        pos += chunkSize;
+    }
+
+    progress.finish();
+    input.seek(oldPos, File::Origin::Start);
+    return checksum;
+}
+
+CRC::Value CRC::Internals::computeMaskedChecksum(
+    File &input, const std::vector<CRC::Mask> &masks, Progress &progress) const
+{
+    CRC::Value checksum = specs.initialXOR;
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[input.getChunkSize()]);
+    File::OffsetType oldPos = input.tell();
+    File::OffsetType pos = 0;
+    File::OffsetType endPos = input.getSize();
+    progress.start(endPos);
+
+    auto holes = findHoles(input, 0, endPos);
+    auto hole = holes.begin();
+    auto it = masks.begin();
+    while (pos < endPos)
+    {
+        progress.set(pos);
+        if (it != masks.end() && it->offset == pos)
+        {
+            if (!it->skip)
+                checksum = shift(checksum, it->size, false);
+            pos += it->size;
+            ++it;
+            continue;
+        }
+
+        while (hole != holes.end() && hole->second <= pos)
+            ++hole;
+        auto nextStop = it != masks.end() ? it->offset : endPos;
+        if (hole != holes.end() && hole->first <= pos)
+        {
+            auto holeEnd = std::min(hole->second, nextStop);
+            checksum = shift(checksum, holeEnd - pos, false);
+            pos = holeEnd;
+            continue;
+        }
+        if (hole != holes.end())
+            nextStop = std::min(nextStop, hole->first);
+
+        auto chunkSize = getChunkSize(input, pos, nextStop);
+        input.seek(pos, File::Origin::Start);
+        input.read(buffer.get(), chunkSize);
+        checksum = feed(checksum, buffer.get(), chunkSize);
         pos += chunkSize;
     }
 
@@ -244,6 +1474,70 @@ CRC::Value CRC::Internals::computePartialChecksum(
     return checksum;
 }
 
+/**
+ * Feeding a byte is linear in both the register and the byte, so sliding
+ * the window by one byte means feeding the incoming byte, then cancelling
+ * the outgoing one (shifted over the whole window) and the initial XOR
+ * that was shifted once too many.
+ */
+std::vector<File::OffsetType> CRC::Internals::findWindows(
+    File &input,
+    File::OffsetType windowSize,
+    CRC::Value targetChecksum,
+    Progress &progress) const
+{
+    std::vector<File::OffsetType> offsets;
+    File::OffsetType endPos = input.getSize();
+    if (windowSize > endPos)
+        return offsets;
+
+    targetChecksum ^= specs.finalXOR;
+    if (specs.flags & CRC::Flags::UseFileSize)
+        targetChecksum = unwindFileSize(targetChecksum, windowSize);
+    targetChecksum &= getMask(specs.numBytes << 3);
+
+    CRC::Value outgoing[256];
+    for (size_t c = 0; c < 256; c++)
+        outgoing[c] = shift(next(0, c), windowSize, false);
+    CRC::Value initialShifted = shift(specs.initialXOR, windowSize, false);
+    CRC::Value correction = initialShifted ^ next(initialShifted, 0);
+
+    Progress dummyProgress;
+    CRC::Value checksum = computePartialChecksum(
+        input, 0, windowSize, specs.initialXOR, dummyProgress);
+    if (checksum == targetChecksum)
+        offsets.push_back(0);
+
+    std::unique_ptr<uint8_t[]> incoming(new uint8_t[input.getChunkSize()]);
+    std::unique_ptr<uint8_t[]> leaving(new uint8_t[input.getChunkSize()]);
+    File::OffsetType oldPos = input.tell();
+    File::OffsetType pos = windowSize;
+    progress.start(endPos);
+
+    while (pos < endPos)
+    {
+        progress.set(pos);
+        auto chunkSize = getChunkSize(input, pos, endPos);
+        input.seek(pos, File::Origin::Start);
+        input.read(incoming.get(), chunkSize);
+        input.seek(pos - windowSize, File::Origin::Start);
+        input.read(leaving.get(), chunkSize);
+        for (size_t i = 0; i < chunkSize; i++)
+        {
+            checksum = next(checksum, incoming[i])
+                ^ outgoing[leaving[i]]
+                ^ correction;
+            if (checksum == targetChecksum)
+                offsets.push_back(pos - windowSize + i + 1);
+        }
+        pos += chunkSize;
+    }
+
+    progress.finish();
+    input.seek(oldPos, File::Origin::Start);
+    return offsets;
+}
+
 CRC::Value CRC::Internals::computeReversePartialChecksum(
     File &input,
     File::OffsetType startPos,
@@ -256,20 +1550,32 @@ CRC::Value CRC::Internals::computeReversePartialChecksum(
         return initialChecksum;
 
     CRC::Value checksum = initialChecksum;
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[BufferSize]);
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[input.getChunkSize()]);
     File::OffsetType oldPos = input.tell();
     File::OffsetType pos = startPos;
-    progress.start(startPos);
+    auto holes = findHoles(input, endPos, startPos);
+    auto hole = holes.rbegin();
+    progress.start(startPos, Progress::Phase::Suffix);
 
     while (pos > endPos)
     {
         progress.set(startPos - pos);
-        auto chunkSize = getChunkSize(endPos, pos);
+        if (hole != holes.rend() && hole->second == pos)
+        {
+            checksum = shift(checksum, pos - hole->first, true);
+            pos = hole->first;
+            ++hole;
+            continue;
+        }
+
+        auto chunkSize = getChunkSize(
+            input,
+            hole != holes.rend() ? hole->second : endPos,
+            pos);
         pos -= chunkSize;
         input.seek(pos, File::Origin::Start);
         input.read(buffer.get(), chunkSize);
-        for (size_t i = 0, j = chunkSize - 1; i < chunkSize; i++, j--)
-            checksum = prev(checksum, buffer[j]);
+        checksum = unfeed(checksum, buffer.get(), chunkSize);
     }
 
     progress.finish();
@@ -288,20 +1594,9 @@ CRC::Value CRC::Internals::computePatch(
 
     if (specs.flags & CRC::Flags::UseFileSize)
     {
-        auto fileSize = inputFile.getSize() + (overwrite ? 0 : specs.numBytes);
-        auto fileSizeCopy = fileSize;
-        auto fileSizeByteCount = 0;
-        while (fileSizeCopy)
-        {
-            fileSizeByteCount ++;
-            fileSizeCopy >>= 8;
-        }
-        fileSize = swapEndian(fileSize, fileSizeByteCount);
-        while (fileSize)
-        {
-            targetChecksum = prev(targetChecksum, fileSize);
-            fileSize >>= 8;
-        }
+        targetChecksum = unwindFileSize(
+            targetChecksum,
+            inputFile.getSize() + (overwrite ? 0 : specs.numBytes));
     }
 
     auto posStart = 0;
@@ -315,18 +1610,387 @@ CRC::Value CRC::Internals::computePatch(
     CRC::Value checksum2 = computeReversePartialChecksum(
         inputFile, posEnd, posAfterPatch, targetChecksum, progress);
 
-    CRC::Value patch = checksum2;
+    return solvePatch(checksum1, checksum2);
+}
+
+/**
+ * Rather than replacing bytes, flips bits within the regions, so that the
+ * only thing to know about the input is its checksum. Column for each bit
+ * comes from the zeros operator, so region placement doesn't matter.
+ */
+std::vector<std::pair<File::OffsetType, uint8_t>>
+CRC::Internals::computeScatteredPatch(
+    CRC::Value targetChecksum,
+    const std::vector<CRC::Region> &regions,
+    File &inputFile,
+    Progress &progress) const
+{
+    //more bytes than there are checksum bits are unlikely to be of help
+    const File::OffsetType MaxBytesPerRegion = specs.numBytes * 8 * 8;
+
+    auto posEnd = inputFile.getSize();
+    CRC::Value checksum = computePartialChecksum(
+        inputFile, 0, posEnd, specs.initialXOR, progress);
+
+    targetChecksum ^= specs.finalXOR;
+    if (specs.flags & CRC::Flags::UseFileSize)
+        targetChecksum = unwindFileSize(targetChecksum, posEnd);
+
+    std::vector<FreeByte> freeBytes;
+    for (const auto &region : regions)
+    {
+        auto size = std::min(region.size, MaxBytesPerRegion);
+        for (File::OffsetType i = region.size - size; i < region.size; i++)
+        {
+            FreeByte freeByte;
+            freeByte.position = region.offset + i;
+            freeByte.base = 0;
+            for (size_t j = 0; j < 8; j++)
+                if (region.mask & (1 << j))
+                    freeByte.directions.push_back(1 << j);
+            freeBytes.push_back(freeByte);
+        }
+    }
+
+    if (!solveLinearPatch(
+        {this}, {targetChecksum ^ checksum}, posEnd, freeBytes))
+    {
+        throw std::runtime_error(
+            "Regions don't have enough free bits to reach the checksum");
+    }
+
+    std::vector<std::pair<File::OffsetType, uint8_t>> flips;
+    for (const auto &freeByte : freeBytes)
+        if (freeByte.value)
+            flips.push_back(std::make_pair(freeByte.position, freeByte.value));
+    std::sort(flips.begin(), flips.end());
+    return flips;
+}
+
+CRC::Internals::PatchContext CRC::Internals::computePatchContext(
+    File::OffsetType targetPos,
+    File &inputFile,
+    bool overwrite,
+    Progress &progress) const
+{
+    File::OffsetType posAfterPatch
+        = targetPos + (overwrite ? specs.numBytes : 0);
+    auto posEnd = inputFile.getSize();
+
+    auto checksums = computeCheckpoints(
+        inputFile,
+        {targetPos, posAfterPatch, posEnd},
+        progress);
+
+    PatchContext context;
+    context.before = checksums[0];
+    context.after = checksums[1];
+    context.end = checksums[2];
+    context.suffixInverse = getShiftOperator(posEnd - posAfterPatch, true);
+    context.outputSize = posEnd + (overwrite ? 0 : specs.numBytes);
+    return context;
+}
+
+/**
+ * Same as above, for data held in memory.
+ */
+CRC::Internals::PatchContext CRC::Internals::computePatchContext(
+    size_t targetPos,
+    const uint8_t *data,
+    size_t size,
+    bool overwrite) const
+{
+    size_t posAfterPatch = targetPos + (overwrite ? specs.numBytes : 0);
+
+    PatchContext context;
+    context.before = feed(specs.initialXOR, data, targetPos);
+    context.after = feed(
+        context.before, data + targetPos, posAfterPatch - targetPos);
+    context.end = feed(
+        context.after, data + posAfterPatch, size - posAfterPatch);
+    context.suffixInverse = getShiftOperator(size - posAfterPatch, true);
+    context.outputSize = size + (overwrite ? 0 : specs.numBytes);
+    return context;
+}
+
+/**
+ * Same as above, with the register carried over from preceding parts and
+ * the following parts appended through the shift operator.
+ */
+CRC::Internals::PatchContext CRC::Internals::computePartPatchContext(
+    const std::vector<File*> &parts,
+    size_t patchedPart,
+    File::OffsetType targetPos,
+    bool overwrite,
+    Progress &progress) const
+{
+    File::OffsetType totalSize = 0;
+    CRC::Value prefix = specs.initialXOR;
+    for (size_t i = 0; i < patchedPart; i++)
+    {
+        prefix = computePartialChecksum(
+            *parts[i], 0, parts[i]->getSize(), prefix, progress);
+        totalSize += parts[i]->getSize();
+    }
+
+    CRC::Value suffix = 0;
+    File::OffsetType suffixSize = 0;
+    for (size_t i = patchedPart + 1; i < parts.size(); i++)
+    {
+        auto size = parts[i]->getSize();
+        suffix = shift(suffix, size, false)
+            ^ computePartialChecksum(*parts[i], 0, size, 0, progress);
+        suffixSize += size;
+    }
+
+    auto &input = *parts[patchedPart];
+    auto context = computePatchContext(targetPos, input, overwrite, progress);
+
+    //checkpoints were fed from the initial XOR rather than from the prefix
+    auto offset = prefix ^ specs.initialXOR;
+    auto posAfterPatch = targetPos + (overwrite ? specs.numBytes : 0);
+    context.before ^= shift(offset, targetPos, false);
+    context.after ^= shift(offset, posAfterPatch, false);
+    context.end ^= shift(offset, input.getSize(), false);
+
+    context.end = shift(context.end, suffixSize, false) ^ suffix;
+    context.suffixInverse = getShiftOperator(
+        input.getSize() - posAfterPatch + suffixSize, true);
+    context.outputSize += totalSize + suffixSize;
+    return context;
+}
+
+/**
+ * Feeding data after the patch is affine in the register, so instead of
+ * rewinding through the data for each target, we rewind only the difference
+ * between the target and the checksum of unpatched input.
+ */
+CRC::Value CRC::Internals::computePatch(
+    CRC::Value targetChecksum, const PatchContext &context) const
+{
+    targetChecksum ^= specs.finalXOR;
+    if (specs.flags & CRC::Flags::UseFileSize)
+        targetChecksum = unwindFileSize(targetChecksum, context.outputSize);
+
+    CRC::Value checksumAfter = context.after
+        ^ context.suffixInverse.apply(targetChecksum ^ context.end);
+    return solvePatch(context.before, checksumAfter);
+}
+
+CRC::Value CRC::Internals::unwindFileSize(
+    CRC::Value targetChecksum, File::OffsetType fileSize) const
+{
+    size_t fileSizeByteCount = 0;
+    for (auto copy = fileSize; copy; copy >>= 8)
+        fileSizeByteCount++;
+    for (size_t i = fileSizeByteCount; i > 0; i--)
+        targetChecksum = prev(targetChecksum, fileSize >> ((i - 1) << 3));
+    return targetChecksum;
+}
+
+/**
+ * Computes numBytes-long patch that turns one register into another.
+ */
+CRC::Value CRC::Internals::solvePatch(
+    CRC::Value checksumBefore, CRC::Value checksumAfter) const
+{
+    CRC::Value patch = checksumAfter;
 
     if (specs.flags & CRC::Flags::BigEndian)
-        checksum1 = swapEndian(checksum1, specs.numBytes);
+        checksumBefore = swapEndian(checksumBefore, specs.numBytes);
     for (size_t i = 0, j = specs.numBytes - 1; i < specs.numBytes; i++, j--)
-        patch = prev(patch, checksum1 >> (j << 3));
+        patch = prev(patch, checksumBefore >> (j << 3));
     if (specs.flags & CRC::Flags::BigEndian)
         patch = swapEndian(patch, specs.numBytes);
 
     return patch;
 }
 
+
+std::vector<uint8_t> CRC::Internals::getPatchBytes(CRC::Value patch) const
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i < specs.numBytes; i++)
+        bytes.push_back(static_cast<uint8_t>(patch >> (i << 3)));
+    return bytes;
+}
+
+/**
+ * Since CRC is linear, flipping bits of the output changes the register
+ * by a fixed amount regardless of the rest of the data. Each delta is the
+ * register change needed by given algorithm, assuming the free bytes are
+ * all zero; this picks values of the free bytes that produce it for all
+ * the algorithms at once.
+ */
+bool CRC::Internals::solveLinearPatch(
+    const std::vector<const Internals*> &engines,
+    const std::vector<CRC::Value> &deltas,
+    File::OffsetType outputSize,
+    std::vector<FreeByte> &freeBytes)
+{
+    size_t numBits = 0;
+    for (auto engine : engines)
+        numBits += engine->specs.numBytes * 8;
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < freeBytes.size(); i++)
+        order.push_back(i);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+        { return freeBytes[a].position > freeBytes[b].position; });
+
+    //register change caused by each bit of a byte at current position,
+    //walking backwards from the end of the output
+    std::vector<std::vector<CRC::Value>> bitChanges;
+    for (auto engine : engines)
+    {
+        bitChanges.push_back(std::vector<CRC::Value>());
+        for (size_t j = 0; j < 8; j++)
+            bitChanges.back().push_back(engine->next(0, 1 << j));
+    }
+    File::OffsetType pos = outputSize - 1;
+
+    auto getChange = [&](size_t engine, uint8_t byte)
+    {
+        CRC::Value change = 0;
+        for (size_t j = 0; j < 8; j++)
+            if (byte & (1 << j))
+                change ^= bitChanges[engine][j];
+        return change;
+    };
+
+    Gf2Basis basis(numBits);
+    std::vector<std::pair<size_t, uint8_t>> used;
+    auto required = deltas;
+    for (auto i : order)
+    {
+        const auto &freeByte = freeBytes[i];
+        //shifts compose, so bytes that can't contribute are skipped for free
+        if (basis.isFull() && !freeByte.base)
+            continue;
+
+        for (size_t e = 0; e < engines.size(); e++)
+            for (auto &change : bitChanges[e])
+                change = engines[e]->shift(
+                    change, pos - freeByte.position, false);
+        pos = freeByte.position;
+
+        for (size_t e = 0; e < engines.size(); e++)
+            required[e] ^= getChange(e, freeByte.base);
+
+        for (auto direction : freeByte.directions)
+        {
+            if (basis.isFull())
+                break;
+            auto vector = Gf2Basis::createVector(numBits);
+            for (size_t e = 0, bit = 0; e < engines.size(); e++)
+            {
+                auto change = getChange(e, direction);
+                for (size_t j = 0; j < engines[e]->specs.numBytes * 8; j++)
+                    Gf2Basis::setBit(vector, bit++, (change >> j) & 1);
+            }
+            if (basis.add(vector))
+                used.push_back(std::make_pair(i, direction));
+        }
+    }
+
+    auto target = Gf2Basis::createVector(numBits);
+    for (size_t e = 0, bit = 0; e < engines.size(); e++)
+        for (size_t j = 0; j < engines[e]->specs.numBytes * 8; j++)
+            Gf2Basis::setBit(target, bit++, (required[e] >> j) & 1);
+
+    std::vector<size_t> indices;
+    if (!basis.solve(target, indices))
+        return false;
+
+    for (auto &freeByte : freeBytes)
+        freeByte.value = freeByte.base;
+    for (auto index : indices)
+        freeBytes[used[index].first].value ^= used[index].second;
+    return true;
+}
+
+/**
+ * Feeds given data into the register, jumping over long zero runs with
+ * the shift operator.
+ */
+CRC::Value CRC::Internals::feed(
+    CRC::Value checksum, const uint8_t *data, size_t size) const
+{
+    size_t pos = 0;
+    for (const auto &run : findZeroRuns(data, size))
+    {
+        for (; pos < run.first; pos++)
+            checksum = next(checksum, data[pos]);
+        checksum = shift(checksum, run.second - run.first, false);
+        pos = run.second;
+    }
+    for (; pos < size; pos++)
+        checksum = next(checksum, data[pos]);
+    return checksum;
+}
+
+/**
+ * Feeds NumLanes buffers of equal size into their own registers. Same as
+ * next(), but with the endianness check hoisted out of the loop and the
+ * lanes interleaved, so their lookups can overlap.
+ */
+void CRC::Internals::feedLanes(
+    CRC::Value *checksums, const uint8_t *const *data, size_t size) const
+{
+    static_assert(NumLanes == 4, "feedLanes() is unrolled for four lanes");
+    auto mask = getMask(specs.numBytes << 3);
+    CRC::Value c0 = checksums[0], c1 = checksums[1];
+    CRC::Value c2 = checksums[2], c3 = checksums[3];
+    const uint8_t *d0 = data[0], *d1 = data[1], *d2 = data[2], *d3 = data[3];
+
+    if (specs.flags & CRC::Flags::BigEndian)
+    {
+        auto top = specs.numBytes * 8 - 8;
+        for (size_t i = 0; i < size; i++)
+        {
+            c0 = ((c0 << 8) ^ lookupTable[((c0 >> top) ^ d0[i]) & 0xFF]) & mask;
+            c1 = ((c1 << 8) ^ lookupTable[((c1 >> top) ^ d1[i]) & 0xFF]) & mask;
+            c2 = ((c2 << 8) ^ lookupTable[((c2 >> top) ^ d2[i]) & 0xFF]) & mask;
+            c3 = ((c3 << 8) ^ lookupTable[((c3 >> top) ^ d3[i]) & 0xFF]) & mask;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            c0 = ((c0 >> 8) ^ lookupTable[(c0 ^ d0[i]) & 0xFF]) & mask;
+            c1 = ((c1 >> 8) ^ lookupTable[(c1 ^ d1[i]) & 0xFF]) & mask;
+            c2 = ((c2 >> 8) ^ lookupTable[(c2 ^ d2[i]) & 0xFF]) & mask;
+            c3 = ((c3 >> 8) ^ lookupTable[(c3 ^ d3[i]) & 0xFF]) & mask;
+        }
+    }
+
+    checksums[0] = c0;
+    checksums[1] = c1;
+    checksums[2] = c2;
+    checksums[3] = c3;
+}
+
+/**
+ * Rewinds the register over given data, which is the inverse of feed().
+ */
+CRC::Value CRC::Internals::unfeed(
+    CRC::Value checksum, const uint8_t *data, size_t size) const
+{
+    auto runs = findZeroRuns(data, size);
+    size_t pos = size;
+    for (auto run = runs.rbegin(); run != runs.rend(); ++run)
+    {
+        for (; pos > run->second; pos--)
+            checksum = prev(checksum, data[pos - 1]);
+        checksum = shift(checksum, run->second - run->first, true);
+        pos = run->first;
+    }
+    for (; pos > 0; pos--)
+        checksum = prev(checksum, data[pos - 1]);
+    return checksum;
+}
+
 CRC::Value CRC::Internals::next(CRC::Value prevChecksum, uint8_t c) const
 {
     if (specs.flags & CRC::Flags::BigEndian)
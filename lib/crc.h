@@ -1,6 +1,9 @@
 #ifndef CRC_H
 #define CRC_H
+#include <bitset>
 #include <functional>
+#include <utility>
+#include <vector>
 #include "file.h"
 #include "progress.h"
 
@@ -14,6 +17,11 @@ class CRC final
          */
         typedef uint32_t Value;
 
+        /**
+         * Set of byte values, indexed by value.
+         */
+        typedef std::bitset<256> ByteSet;
+
         enum Flags
         {
             BigEndian   = 1,
@@ -31,13 +39,128 @@ class CRC final
             int flags;
         } Specs;
 
+        /**
+         * Everything that the engine precomputes from the specs: byte
+         * lookup tables, and operators that feed (or rewind over) 2^k zero
+         * bytes. Builtin algorithms get them generated at build time.
+         */
+        typedef struct
+        {
+            Value lookup[256];
+            Value invLookup[256];
+            Value zeroOperators[64][32];
+            Value invZeroOperators[64][32];
+        } Tables;
+
+        /**
+         * Part of the input that a scattered patch may change. Only bits
+         * set in mask are changed in each byte of the region.
+         */
+        typedef struct
+        {
+            File::OffsetType offset;
+            File::OffsetType size;
+            uint8_t mask;
+        } Region;
+
+        /**
+         * Part of the input that checksum computation treats as zeros, or
+         * leaves out entirely if skip is set.
+         */
+        typedef struct
+        {
+            File::OffsetType offset;
+            File::OffsetType size;
+            bool skip;
+        } Mask;
+
+        /**
+         * Checksum of data that arrives in pieces. A stream belongs to one
+         * thread, but any number of streams may share one CRC.
+         */
+        class Stream final
+        {
+            public:
+                Stream(const CRC &crc);
+
+                Stream &update(const uint8_t *data, size_t size);
+                Stream &updateZeros(File::OffsetType size);
+                Stream &combine(const Stream &other);
+
+                Value finalize() const;
+                Value getState() const;
+                File::OffsetType getSize() const;
+
+            private:
+                const CRC &crc;
+                Value state;
+                File::OffsetType size;
+        };
+
     public:
         CRC(const Specs &specs);
+        CRC(const Specs &specs, const Tables &tables);
         ~CRC();
 
         const Specs &getSpecs() const;
+        void getTables(Tables &tables) const;
 
         Value computeChecksum(File &inputFile, Progress &progress) const;
+        Value computeChecksum(const uint8_t *data, size_t size) const;
+
+        std::vector<Value> computeChecksums(
+            const std::vector<const uint8_t*> &data,
+            const std::vector<size_t> &sizes) const;
+
+        std::vector<File::OffsetType> findWindows(
+            File &inputFile,
+            File::OffsetType windowSize,
+            Value targetChecksum,
+            Progress &progress) const;
+
+        Value computeMaskedChecksum(
+            File &inputFile,
+            const std::vector<Mask> &masks,
+            Progress &progress) const;
+
+        /**
+         * Feeds given range of the input into the CRC register. The result
+         * is the raw register (before final XOR and file size folding), so
+         * it can be passed back as initialState to resume the computation
+         * once more data is available. Use getSpecs().initialXOR to start.
+         */
+        Value computePartialChecksum(
+            File &inputFile,
+            File::OffsetType startPosition,
+            File::OffsetType endPosition,
+            Value initialState,
+            Progress &progress) const;
+
+        Value computePartialChecksum(
+            const uint8_t *data,
+            size_t size,
+            Value initialState) const;
+
+        /**
+         * Register after feeding data of given size, whose own register
+         * (fed from zero) is suffixState, into state.
+         */
+        Value combineStates(
+            Value state,
+            Value suffixState,
+            File::OffsetType suffixSize) const;
+
+        /**
+         * Turns raw register into the final checksum of totalSize bytes.
+         */
+        Value finalizeChecksum(Value state, File::OffsetType totalSize) const;
+
+        std::vector<uint8_t> computePatch(
+            Value targetChecksum,
+            const uint8_t *data,
+            size_t size,
+            size_t targetPosition,
+            bool overwrite) const;
 
         void applyPatch(
             Value targetChecksum,
@@ -46,8 +169,85 @@ class CRC final
             File &outputFile,
             bool overwrite,
             Progress &writeProgress,
+            Progress &checksumProgress,
+            bool verify = false) const;
+
+        Value computePartPatch(
+            Value targetChecksum,
+            const std::vector<File*> &parts,
+            size_t patchedPart,
+            File::OffsetType targetPosition,
+            bool overwrite,
+            Progress &progress) const;
+
+        void applyPartPatch(
+            Value targetChecksum,
+            const std::vector<File*> &parts,
+            size_t patchedPart,
+            File::OffsetType targetPosition,
+            File &outputFile,
+            bool overwrite,
+            Progress &writeProgress,
+            Progress &checksumProgress) const;
+
+        std::vector<std::pair<File::OffsetType, uint8_t>>
+            computeScatteredPatch(
+                Value targetChecksum,
+                const std::vector<Region> &regions,
+                File &inputFile,
+                Progress &progress) const;
+
+        void applyScatteredPatch(
+            Value targetChecksum,
+            const std::vector<Region> &regions,
+            File &inputFile,
+            File &outputFile,
+            Progress &writeProgress,
             Progress &checksumProgress) const;
 
+        std::vector<Value> computePatches(
+            const std::vector<Value> &targetChecksums,
+            File::OffsetType targetPosition,
+            File &inputFile,
+            bool overwrite,
+            Progress &progress) const;
+
+        std::vector<Value> computePatchesAtPositions(
+            Value targetChecksum,
+            const std::vector<File::OffsetType> &targetPositions,
+            File &inputFile,
+            bool overwrite,
+            Progress &progress) const;
+
+        void applyPatches(
+            const std::vector<Value> &patches,
+            File::OffsetType targetPosition,
+            File &inputFile,
+            const std::vector<File*> &outputFiles,
+            bool overwrite,
+            Progress &writeProgress) const;
+
+        static std::vector<uint8_t> computeMultiPatch(
+            const std::vector<const CRC*> &crcs,
+            const std::vector<Value> &targetChecksums,
+            File::OffsetType targetPosition,
+            File &inputFile,
+            bool overwrite,
+            const ByteSet &allowedBytes,
+            Progress &progress);
+
+        static size_t getMultiPatchSize(
+            const std::vector<const CRC*> &crcs,
+            const ByteSet &allowedBytes);
+
+        static void writePatch(
+            const std::vector<uint8_t> &patch,
+            File::OffsetType targetPosition,
+            File &inputFile,
+            File &outputFile,
+            bool overwrite,
+            Progress &writeProgress);
+
     private:
         struct Internals;
         std::unique_ptr<Internals> internals;
@@ -1,67 +1,202 @@
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
 #include "crc_factories.h"
+#include "crc_tables.h"
+
+namespace
+{
+    CRC::Specs getCRC32Specs()
+    {
+        CRC::Specs specs = {};
+        specs.name       = "CRC32";
+        specs.numBytes   = 4;
+        specs.polynomial = 0x04C11DB7;
+        specs.initialXOR = 0xFFFFFFFF;
+        specs.finalXOR   = 0xFFFFFFFF;
+        specs.test       = 0xCBF43926;
+        return specs;
+    }
+
+    CRC::Specs getCRC32POSIXSpecs()
+    {
+        CRC::Specs specs = {};
+        specs.name       = "CRC32POSIX";
+        specs.numBytes   = 4;
+        specs.polynomial = 0x04C11DB7;
+        specs.initialXOR = 0x00000000;
+        specs.finalXOR   = 0xFFFFFFFF;
+        specs.flags      = CRC::Flags::BigEndian | CRC::Flags::UseFileSize;
+        specs.test       = 0x377A6011;
+        return specs;
+    }
+
+    CRC::Specs getCRC16CCITTSpecs()
+    {
+        CRC::Specs specs = {};
+        specs.name       = "CRC16CCITT";
+        specs.numBytes   = 2;
+        specs.polynomial = 0x1021;
+        specs.initialXOR = 0x0000;
+        specs.finalXOR   = 0x0000;
+        specs.test       = 0x2189;
+        return specs;
+    }
+
+    CRC::Specs getCRC16XMODEMSpecs()
+    {
+        CRC::Specs specs = {};
+        specs.name       = "CRC16XMODEM";
+        specs.numBytes   = 2;
+        specs.polynomial = 0x1021;
+        specs.initialXOR = 0x0000;
+        specs.finalXOR   = 0x0000;
+        specs.test       = 0x31C3;
+        specs.flags      = CRC::Flags::BigEndian;
+        return specs;
+    }
+
+    CRC::Specs getCRC16IBMSpecs()
+    {
+        CRC::Specs specs = {};
+        specs.name       = "CRC16IBM";
+        specs.numBytes   = 2;
+        specs.polynomial = 0x8005;
+        specs.initialXOR = 0x0000;
+        specs.finalXOR   = 0x0000;
+        specs.test       = 0xBB3D;
+        return specs;
+    }
+
+    typedef std::unique_ptr<CRC> (*Factory)();
+
+    /**
+     * Engines built so far, shared by everyone who asks for the same name.
+     */
+    struct Registry
+    {
+        Registry() : factories({
+            {"CRC32", createCRC32},
+            {"CRC32POSIX", createCRC32POSIX},
+            {"CRC16CCITT", createCRC16CCITT},
+            {"CRC16XMODEM", createCRC16XMODEM},
+            {"CRC16IBM", createCRC16IBM}})
+        {
+        }
+
+        const std::unordered_map<std::string, Factory> factories;
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<CRC>> engines;
+    };
+
+    Registry &getRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    CRC::Value reflect(CRC::Value value, size_t numBits)
+    {
+        CRC::Value result = 0;
+        for (size_t i = 0; i < numBits; i++)
+            if (value & (1ull << i))
+                result |= 1ull << (numBits - 1 - i);
+        return result;
+    }
+}
 
 std::unique_ptr<CRC> createCRC32()
 {
-    CRC::Specs specs = {};
-    specs.name       = "CRC32";
-    specs.numBytes   = 4;
-    specs.polynomial = 0x04C11DB7;
-    specs.initialXOR = 0xFFFFFFFF;
-    specs.finalXOR   = 0xFFFFFFFF;
-    specs.test       = 0xCBF43926;
-    return std::unique_ptr<CRC>(new CRC(specs));
+    return std::unique_ptr<CRC>(new CRC(getCRC32Specs(), CRC32Tables));
 }
 
 std::unique_ptr<CRC> createCRC32POSIX()
 {
-    CRC::Specs specs = {};
-    specs.name       = "CRC32POSIX";
-    specs.numBytes   = 4;
-    specs.polynomial = 0x04C11DB7;
-    specs.initialXOR = 0x00000000;
-    specs.finalXOR   = 0xFFFFFFFF;
-    specs.flags      = CRC::Flags::BigEndian | CRC::Flags::UseFileSize;
-    specs.test       = 0x377A6011;
-    return std::unique_ptr<CRC>(new CRC(specs));
+    return std::unique_ptr<CRC>(
+        new CRC(getCRC32POSIXSpecs(), CRC32POSIXTables));
 }
 
 std::unique_ptr<CRC> createCRC16CCITT()
 {
-    CRC::Specs specs = {};
-    specs.name       = "CRC16CCITT";
-    specs.numBytes   = 2;
-    specs.polynomial = 0x1021;
-    specs.initialXOR = 0x0000;
-    specs.finalXOR   = 0x0000;
-    specs.test       = 0x2189;
-    return std::unique_ptr<CRC>(new CRC(specs));
+    return std::unique_ptr<CRC>(
+        new CRC(getCRC16CCITTSpecs(), CRC16CCITTTables));
 }
 
 std::unique_ptr<CRC> createCRC16XMODEM()
 {
-    CRC::Specs specs = {};
-    specs.name       = "CRC16XMODEM";
-    specs.numBytes   = 2;
-    specs.polynomial = 0x1021;
-    specs.initialXOR = 0x0000;
-    specs.finalXOR   = 0x0000;
-    specs.test       = 0x31C3;
-    specs.flags      = CRC::Flags::BigEndian;
-    return std::unique_ptr<CRC>(new CRC(specs));
+    return std::unique_ptr<CRC>(
+        new CRC(getCRC16XMODEMSpecs(), CRC16XMODEMTables));
 }
 
 std::unique_ptr<CRC> createCRC16IBM()
 {
+    return std::unique_ptr<CRC>(new CRC(getCRC16IBMSpecs(), CRC16IBMTables));
+}
+
+/**
+ * Unlike builtin algorithms, custom ones build their tables on creation.
+ */
+std::unique_ptr<CRC> createCustomCRC(
+    size_t numBits,
+    CRC::Value polynomial,
+    CRC::Value initialXOR,
+    CRC::Value finalXOR,
+    bool reflected)
+{
+    if (numBits == 0 || numBits > 32 || numBits % 8)
+        throw std::invalid_argument("Width must be 8, 16, 24 or 32 bits");
+    auto mask = static_cast<CRC::Value>((1ull << numBits) - 1);
+    if ((polynomial & mask) != polynomial)
+        throw std::invalid_argument("Polynomial doesn't fit the width");
+    if (!(polynomial & 1))
+        throw std::invalid_argument("Polynomial must be odd");
+    if ((initialXOR & mask) != initialXOR || (finalXOR & mask) != finalXOR)
+        throw std::invalid_argument("XOR values don't fit the width");
+
+    std::ostringstream name;
+    name << "custom-" << numBits << std::hex
+        << "-" << polynomial
+        << "-" << initialXOR
+        << "-" << finalXOR
+        << (reflected ? "-refin" : "");
+
     CRC::Specs specs = {};
-    specs.name       = "CRC16IBM";
-    specs.numBytes   = 2;
-    specs.polynomial = 0x8005;
-    specs.initialXOR = 0x0000;
-    specs.finalXOR   = 0x0000;
-    specs.test       = 0xBB3D;
+    specs.name       = name.str();
+    specs.numBytes   = numBits / 8;
+    specs.polynomial = polynomial;
+    //reflected registers hold the initial value mirrored
+    specs.initialXOR = reflected ? reflect(initialXOR, numBits) : initialXOR;
+    specs.finalXOR   = finalXOR;
+    specs.flags      = reflected ? 0 : CRC::Flags::BigEndian;
     return std::unique_ptr<CRC>(new CRC(specs));
 }
 
+std::vector<CRC::Specs> getBuiltinSpecs()
+{
+    return {
+        getCRC32Specs(),
+        getCRC32POSIXSpecs(),
+        getCRC16CCITTSpecs(),
+        getCRC16XMODEMSpecs(),
+        getCRC16IBMSpecs(),
+    };
+}
+
+std::shared_ptr<CRC> findBuiltinCRC(const std::string &name)
+{
+    auto &registry = getRegistry();
+    auto factory = registry.factories.find(name);
+    if (factory == registry.factories.end())
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto &engine = registry.engines[name];
+    if (engine == nullptr)
+        engine = factory->second();
+    return engine;
+}
+
 std::vector<std::shared_ptr<CRC>> createAllCRC()
 {
     std::vector<std::shared_ptr<CRC>> crcs;
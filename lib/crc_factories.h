@@ -1,14 +1,39 @@
 #ifndef CRC_FACTORIES_H
 #define CRC_FACTORIES_H
 #include <memory>
+#include <string>
 #include <vector>
 #include "crc.h"
 
 std::unique_ptr<CRC> createCRC32();
 std::unique_ptr<CRC> createCRC32POSIX();
 std::unique_ptr<CRC> createCRC16CCITT();
-std::unique_ptr<CRC> createCRC16MODEM();
+std::unique_ptr<CRC> createCRC16XMODEM();
 std::unique_ptr<CRC> createCRC16IBM();
 std::vector<std::shared_ptr<CRC>> createAllCRC();
 
+/**
+ * Algorithm with user supplied parameters, in the usual catalogue form:
+ * polynomial without the top bit, initial value as if not reflected. Its
+ * name spells the parameters out, so that saved states can tell them.
+ */
+std::unique_ptr<CRC> createCustomCRC(
+    size_t numBits,
+    CRC::Value polynomial,
+    CRC::Value initialXOR,
+    CRC::Value finalXOR,
+    bool reflected);
+
+/**
+ * Specs of builtin algorithms, default first. Cheap, as no engine is
+ * built for them.
+ */
+std::vector<CRC::Specs> getBuiltinSpecs();
+
+/**
+ * Builds the engine of given builtin algorithm on first use and shares
+ * it afterwards. Returns nullptr for unknown names.
+ */
+std::shared_ptr<CRC> findBuiltinCRC(const std::string &name);
+
 #endif
@@ -1,5 +1,72 @@
+#include <atomic>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 #include "file.h"
+#include "profile.h"
+#if HAVE_SEEK_DATA || HAVE_FTRUNCATE || HAVE_POSIX_FADVISE
+    #include <unistd.h>
+#endif
+#if HAVE_POSIX_FADVISE
+    #include <fcntl.h>
+#endif
+#if HAVE_FSTAT
+    #include <sys/stat.h>
+#endif
+
+namespace
+{
+    //touched ranges are dropped from the page cache once they grow that big
+    const File::OffsetType DropGranularity = 16 << 20;
+
+    std::atomic<uint8_t> cachePolicy(
+        static_cast<uint8_t>(File::CachePolicy::Default));
+
+    struct
+    {
+        std::atomic<uint64_t> numOpens;
+        std::atomic<uint64_t> numReads;
+        std::atomic<uint64_t> bytesRead;
+        std::atomic<uint64_t> numWrites;
+        std::atomic<uint64_t> bytesWritten;
+        std::atomic<uint64_t> numSeeks;
+        std::atomic<uint64_t> numHoleQueries;
+        std::atomic<uint64_t> numSyncs;
+        std::atomic<uint64_t> numDropRequests;
+        std::atomic<uint64_t> bytesDropped;
+    } counters;
+
+    void count(std::atomic<uint64_t> &counter, uint64_t value = 1)
+    {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Applies to files opened from now on.
+ */
+void File::setCachePolicy(CachePolicy policy)
+{
+    cachePolicy = static_cast<uint8_t>(policy);
+}
+
+File::Stats File::getStats()
+{
+    Stats stats;
+    stats.numOpens = counters.numOpens;
+    stats.numReads = counters.numReads;
+    stats.bytesRead = counters.bytesRead;
+    stats.numWrites = counters.numWrites;
+    stats.bytesWritten = counters.bytesWritten;
+    stats.numSeeks = counters.numSeeks;
+    stats.numHoleQueries = counters.numHoleQueries;
+    stats.numSyncs = counters.numSyncs;
+    stats.numDropRequests = counters.numDropRequests;
+    stats.bytesDropped = counters.bytesDropped;
+    return stats;
+}
 
 std::unique_ptr<File> File::fromFileHandle(FILE *fileHandle)
 {
@@ -21,6 +88,7 @@ std::unique_ptr<File> File::fromFileName(const std::string &fileName, int mode)
         modeString += "b";
 
     FILE *fileHandle = fopen(fileName.c_str(), modeString.c_str());
+    count(counters.numOpens);
     if (fileHandle == nullptr)
     {
         throw std::runtime_error("Couldn't open file for " +
@@ -29,8 +97,33 @@ std::unique_ptr<File> File::fromFileName(const std::string &fileName, int mode)
     return fromFileHandle(fileHandle);
 }
 
-File::File(FILE *fileHandle) : fileHandle(fileHandle)
+/**
+ * Takes its chunk and buffer sizes from the tuning of the filesystem the
+ * file lives on.
+ */
+File::File(FILE *fileHandle)
+    : fileHandle(fileHandle),
+        device(0),
+        noCache(cachePolicy == static_cast<uint8_t>(CachePolicy::NoCache)),
+        touchedWritten(false),
+        touchedStart(0),
+        touchedEnd(0)
 {
+    #if HAVE_FSTAT
+        struct stat info;
+        if (fstat(fileno(fileHandle), &info) == 0)
+            device = info.st_dev;
+    #endif
+    auto tuning = getActiveTuning(device);
+    chunkSize = tuning.chunkSize;
+    if (tuning.bufferSize > 0)
+        setvbuf(fileHandle, nullptr, _IOFBF, tuning.bufferSize);
+
+    #if HAVE_POSIX_FADVISE
+        if (noCache)
+            posix_fadvise(fileno(fileHandle), 0, 0, POSIX_FADV_SEQUENTIAL);
+    #endif
+
     try
     {
         seek(0, Origin::End);
@@ -45,9 +138,66 @@ File::File(FILE *fileHandle) : fileHandle(fileHandle)
 
 File::~File()
 {
+    if (noCache)
+        dropTouched();
     fclose(fileHandle);
 }
 
+/**
+ * Keeps track of the range read or written since the last drop. Reads go
+ * forwards or backwards, so the range may grow either way.
+ */
+void File::touch(OffsetType start, OffsetType end, bool written)
+{
+    if (!noCache)
+        return;
+    if (touchedStart == touchedEnd)
+        touchedStart = touchedEnd = start;
+    else if (start != touchedEnd && end != touchedStart)
+    {
+        dropTouched();
+        touchedStart = touchedEnd = start;
+    }
+
+    if (start < touchedStart)
+        touchedStart = start;
+    if (end > touchedEnd)
+        touchedEnd = end;
+    touchedWritten |= written;
+    if (touchedEnd - touchedStart >= DropGranularity)
+        dropTouched();
+}
+
+/**
+ * Dirty pages can't be dropped, so written data is synced first.
+ */
+void File::dropTouched()
+{
+    #if HAVE_POSIX_FADVISE
+        if (touchedStart != touchedEnd)
+        {
+            int fd = fileno(fileHandle);
+            if (touchedWritten)
+            {
+                fflush(fileHandle);
+                fdatasync(fd);
+                count(counters.numSyncs);
+            }
+            if (posix_fadvise(
+                fd,
+                touchedStart,
+                touchedEnd - touchedStart,
+                POSIX_FADV_DONTNEED) == 0)
+            {
+                count(counters.numDropRequests);
+                count(counters.bytesDropped, touchedEnd - touchedStart);
+            }
+        }
+    #endif
+    touchedWritten = false;
+    touchedStart = touchedEnd = 0;
+}
+
 File &File::seek(OffsetType offset, Origin origin)
 {
     if (getSize() == -1)
@@ -91,6 +241,7 @@ File &File::seek(OffsetType offset, Origin origin)
     #else
         auto ret = fseek(fileHandle, destination, type);
     #endif
+    count(counters.numSeeks);
     if (ret != 0)
         throw std::runtime_error("Stream is unseekable");
     return *this;
@@ -129,6 +280,9 @@ File &File::read(unsigned char *buffer, size_t size)
         throw std::runtime_error("Can't read bytes at "
             + std::to_string(tell()));
     }
+    count(counters.numReads);
+    count(counters.bytesRead, size);
+    touch(newPos - static_cast<OffsetType>(size), newPos, false);
 
     return *this;
 }
@@ -142,6 +296,10 @@ File &File::write(const unsigned char *buffer, size_t size)
 {
     if (fwrite(buffer, sizeof(unsigned char), size, fileHandle) != size)
         throw std::runtime_error("Can't write bytes");
+    count(counters.numWrites);
+    count(counters.bytesWritten, size);
+    if (noCache)
+        touch(tell() - static_cast<OffsetType>(size), tell(), true);
 
     if (fileSize >= 0 && fileSize < tell())
         fileSize = tell();
@@ -149,7 +307,97 @@ File &File::write(const unsigned char *buffer, size_t size)
     return *this;
 }
 
+/**
+ * Writes size zero bytes. Past the end of file, they're left as a hole
+ * where the platform allows, so that sparse files stay sparse.
+ */
+File &File::writeZeros(OffsetType size)
+{
+    #if HAVE_FTRUNCATE
+        if (getSize() >= 0 && tell() >= getSize() && size > 0)
+        {
+            auto end = tell() + size;
+            fflush(fileHandle);
+            if (ftruncate(fileno(fileHandle), end) != 0)
+                throw std::runtime_error("Can't write bytes");
+            fileSize = end;
+            return seek(end, Origin::Start);
+        }
+    #endif
+
+    unsigned char buffer[4096];
+    memset(buffer, 0, sizeof(buffer));
+    while (size > 0)
+    {
+        auto chunkSize = size < static_cast<OffsetType>(sizeof(buffer))
+            ? static_cast<size_t>(size)
+            : sizeof(buffer);
+        write(buffer, chunkSize);
+        size -= chunkSize;
+    }
+    return *this;
+}
+
+/**
+ * Returns where the next data at or after given offset starts, which is
+ * the offset itself unless it lies in a hole of a sparse file.
+ */
+File::OffsetType File::findData(OffsetType offset) const
+{
+    #if HAVE_SEEK_DATA
+        if (getSize() >= 0)
+        {
+            //leave the descriptor where stdio expects it
+            int fd = fileno(fileHandle);
+            auto oldPos = lseek(fd, 0, SEEK_CUR);
+            count(counters.numHoleQueries);
+            auto ret = lseek(fd, offset, SEEK_DATA);
+            bool noMoreData = ret == -1 && errno == ENXIO;
+            lseek(fd, oldPos, SEEK_SET);
+            if (noMoreData)
+                return getSize();
+            if (ret != -1)
+                return ret;
+        }
+    #endif
+    return offset;
+}
+
+/**
+ * Returns where the next hole at or after given offset starts, or the file
+ * size if there are no more holes. Streams of unknown size have no holes,
+ * so the rest of them is all data.
+ */
+File::OffsetType File::findHole(OffsetType offset) const
+{
+    #if HAVE_SEEK_DATA
+        if (getSize() >= 0)
+        {
+            int fd = fileno(fileHandle);
+            auto oldPos = lseek(fd, 0, SEEK_CUR);
+            count(counters.numHoleQueries);
+            auto ret = lseek(fd, offset, SEEK_HOLE);
+            lseek(fd, oldPos, SEEK_SET);
+            if (ret != -1)
+                return ret < getSize() ? ret : getSize();
+        }
+    #endif
+    return getSize() >= 0
+        ? getSize()
+        : std::numeric_limits<OffsetType>::max();
+}
+
 File::OffsetType File::getSize() const
 {
     return fileSize;
 }
+
+uint64_t File::getDevice() const
+{
+    return device;
+}
+
+size_t File::getChunkSize() const
+{
+    return chunkSize;
+}
@@ -1,5 +1,7 @@
 #ifndef FILE_H
 #define FILE_H
+#include <cstdint>
+#include <cstdio>
 #include <string>
 #include <memory>
 #include "config.h"
@@ -28,11 +30,43 @@ class File
             Binary = 4
         };
 
+        /**
+         * NoCache drops data from the page cache once it's been read or
+         * written, so that bulk runs don't evict other programs' data.
+         */
+        enum class CachePolicy : uint8_t
+        {
+            Default,
+            NoCache
+        };
+
+        /**
+         * Counters of what all files did so far. Reads and writes go
+         * through stdio, so each one costs at most a few system calls;
+         * the rest are system calls of their own.
+         */
+        typedef struct
+        {
+            uint64_t numOpens;
+            uint64_t numReads;
+            uint64_t bytesRead;
+            uint64_t numWrites;
+            uint64_t bytesWritten;
+            uint64_t numSeeks;
+            uint64_t numHoleQueries;
+            uint64_t numSyncs;
+            uint64_t numDropRequests;
+            uint64_t bytesDropped;
+        } Stats;
+
     public:
         static std::unique_ptr<File> fromFileHandle(FILE *fileHandle);
         static std::unique_ptr<File> fromFileName(
             const std::string &fileName, int mode);
 
+        static void setCachePolicy(CachePolicy policy);
+        static Stats getStats();
+
         ~File();
 
         OffsetType getSize() const;
@@ -42,13 +76,30 @@ class File
         File &read(unsigned char *buffer, size_t size);
         File &write(const char *buffer, size_t size);
         File &write(const unsigned char *buffer, size_t size);
+        File &writeZeros(OffsetType size);
+
+        OffsetType findData(OffsetType offset) const;
+        OffsetType findHole(OffsetType offset) const;
+
+        uint64_t getDevice() const;
+        size_t getChunkSize() const;
 
     private:
         File(FILE *fileHandle);
 
+        void touch(OffsetType start, OffsetType end, bool written);
+        void dropTouched();
+
     private:
         FILE *fileHandle;
         OffsetType fileSize;
+        uint64_t device;
+        size_t chunkSize;
+
+        bool noCache;
+        bool touchedWritten;
+        OffsetType touchedStart;
+        OffsetType touchedEnd;
 };
 
 #endif
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+# Generates crc_tables.h: lookup tables and zero operators of the builtin
+# algorithms, so that creating their engines costs no table building.
+# Must mirror CRC::Internals::buildLookupTables() and buildZeroOperators();
+# the "Generated tables match computed ones" test checks that it does.
+import sys
+
+MAX_SHIFT_BITS = 64
+VALUE_MASK = 0xFFFFFFFF
+
+# name, number of bytes, polynomial, big endian; see crc_factories.cc
+ALGORITHMS = [
+    ('CRC32', 4, 0x04C11DB7, False),
+    ('CRC32POSIX', 4, 0x04C11DB7, True),
+    ('CRC16CCITT', 2, 0x1021, False),
+    ('CRC16XMODEM', 2, 0x1021, True),
+    ('CRC16IBM', 2, 0x8005, False),
+]
+
+
+def reverse_bits(value, num_bits):
+    rev = 0
+    for i in range(num_bits):
+        if value & (1 << i):
+            rev |= 1 << (num_bits - 1 - i)
+    return rev
+
+
+def swap_endian(value, num_bytes):
+    result = 0
+    for _ in range(num_bytes):
+        result = (result << 8) | (value & 0xFF)
+        value >>= 8
+    return result
+
+
+def build_lookup_tables(num_bytes, poly, big_endian):
+    poly_rev = reverse_bits(poly, num_bytes * 8)
+    mask = 1 << (num_bytes * 8 - 1)
+    table, inv_table = [], []
+    for n in range(256):
+        t = [n, n]
+        t[not big_endian] = swap_endian(n, num_bytes)
+        for _ in range(8):
+            if big_endian:
+                t[0] = (t[0] << 1) ^ poly if t[0] & mask else t[0] << 1
+                t[1] = ((t[1] ^ poly) >> 1) | mask if t[1] & 1 else t[1] >> 1
+            else:
+                t[0] = (t[0] >> 1) ^ poly_rev if t[0] & 1 else t[0] >> 1
+                t[1] = ((t[1] ^ poly_rev) << 1) | 1 if t[1] & mask \
+                    else t[1] << 1
+            t = [value & VALUE_MASK for value in t]
+        if big_endian:
+            t[1] ^= swap_endian(n, num_bytes)
+        table.append(t[0])
+        inv_table.append(t[1])
+    return table, inv_table
+
+
+def build_zero_operators(num_bytes, big_endian, table, inv_table):
+    shift = num_bytes * 8 - 8
+    reg_mask = (1 << (num_bytes * 8)) - 1
+
+    def next_zero(value):
+        if big_endian:
+            index = (value >> shift) & 0xFF
+            return ((value << 8) ^ table[index]) & reg_mask
+        return ((value >> 8) ^ table[value & 0xFF]) & reg_mask
+
+    def prev_zero(value):
+        if big_endian:
+            return (inv_table[value & 0xFF]
+                ^ (value << shift) ^ (value >> 8)) & reg_mask
+        index = (value >> shift) & 0xFF
+        return ((value << 8) ^ inv_table[index]) & reg_mask
+
+    def apply(operator, value):
+        result = 0
+        i = 0
+        while value:
+            if value & 1:
+                result ^= operator[i]
+            value >>= 1
+            i += 1
+        return result
+
+    def multiply(a, b):
+        return [apply(a, column) for column in b]
+
+    bits = [1 << i if i < num_bytes * 8 else 0 for i in range(32)]
+    zero = [next_zero(bit) for bit in bits]
+    inv_zero = [prev_zero(bit) for bit in bits]
+    operators, inv_operators = [], []
+    for _ in range(MAX_SHIFT_BITS):
+        operators.append(zero)
+        inv_operators.append(inv_zero)
+        zero = multiply(zero, zero)
+        inv_zero = multiply(inv_zero, inv_zero)
+    return operators, inv_operators
+
+
+def write_values(out, values, indent):
+    for i in range(0, len(values), 6):
+        line = ', '.join('0x%08X' % value for value in values[i:i + 6])
+        out.write(indent + line + (',' if i + 6 < len(values) else '') + '\n')
+
+
+def write_matrix(out, rows, indent):
+    for i, row in enumerate(rows):
+        out.write(indent + '{\n')
+        write_values(out, row, indent + '    ')
+        out.write(indent + ('},' if i + 1 < len(rows) else '}') + '\n')
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit('Usage: gen_crc_tables.py OUTPUT')
+
+    with open(sys.argv[1], 'w') as out:
+        out.write('//generated by gen_crc_tables.py, do not edit\n')
+        out.write('#ifndef CRC_TABLES_H\n#define CRC_TABLES_H\n')
+        out.write('#include "crc.h"\n')
+        for name, num_bytes, poly, big_endian in ALGORITHMS:
+            table, inv_table = build_lookup_tables(num_bytes, poly, big_endian)
+            operators, inv_operators = build_zero_operators(
+                num_bytes, big_endian, table, inv_table)
+            out.write('\nconst CRC::Tables %sTables =\n{\n' % name)
+            for part in [table, inv_table]:
+                out.write('    {\n')
+                write_values(out, part, '        ')
+                out.write('    },\n')
+            for i, part in enumerate([operators, inv_operators]):
+                out.write('    {\n')
+                write_matrix(out, part, '        ')
+                out.write('    }' + (',' if i == 0 else '') + '\n')
+            out.write('};\n')
+        out.write('\n#endif\n')
+
+
+if __name__ == '__main__':
+    main()
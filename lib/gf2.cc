@@ -0,0 +1,117 @@
+#include <stdexcept>
+#include "gf2.h"
+
+namespace
+{
+    size_t getNumWords(size_t numBits)
+    {
+        return (numBits + 63) / 64;
+    }
+
+    void xorVector(Gf2Basis::Vector &target, const Gf2Basis::Vector &source)
+    {
+        for (size_t i = 0; i < target.size(); i++)
+            target[i] ^= source[i];
+    }
+
+    bool isZero(const Gf2Basis::Vector &vector)
+    {
+        for (auto word : vector)
+            if (word)
+                return false;
+        return true;
+    }
+}
+
+Gf2Basis::Gf2Basis(size_t numBits) : numBits(numBits)
+{
+}
+
+Gf2Basis::Vector Gf2Basis::createVector(size_t numBits)
+{
+    return Vector(getNumWords(numBits), 0);
+}
+
+bool Gf2Basis::getBit(const Vector &vector, size_t bit)
+{
+    return (vector[bit / 64] >> (bit % 64)) & 1;
+}
+
+void Gf2Basis::setBit(Vector &vector, size_t bit, bool value)
+{
+    if (value)
+        vector[bit / 64] |= 1ull << (bit % 64);
+    else
+        vector[bit / 64] &= ~(1ull << (bit % 64));
+}
+
+void Gf2Basis::reduce(Vector &vector, Vector &combination) const
+{
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (getBit(vector, pivots[i]))
+        {
+            xorVector(vector, rows[i]);
+            xorVector(combination, combinations[i]);
+        }
+    }
+}
+
+bool Gf2Basis::add(const Vector &vector)
+{
+    if (vector.size() != getNumWords(numBits))
+        throw std::invalid_argument("Vector size mismatch");
+    if (isFull())
+        return false;
+
+    auto row = vector;
+    auto combination = createVector(numBits);
+    setBit(combination, rows.size(), true);
+    reduce(row, combination);
+    if (isZero(row))
+        return false;
+
+    size_t pivot = 0;
+    while (!getBit(row, pivot))
+        pivot++;
+
+    //keep the rows fully reduced, so that reduce() works in one sweep
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (getBit(rows[i], pivot))
+        {
+            xorVector(rows[i], row);
+            xorVector(combinations[i], combination);
+        }
+    }
+
+    rows.push_back(row);
+    combinations.push_back(combination);
+    pivots.push_back(pivot);
+    return true;
+}
+
+size_t Gf2Basis::getRank() const
+{
+    return rows.size();
+}
+
+bool Gf2Basis::isFull() const
+{
+    return rows.size() == numBits;
+}
+
+bool Gf2Basis::solve(const Vector &target, std::vector<size_t> &indices) const
+{
+    auto row = target;
+    auto combination = createVector(numBits);
+    reduce(row, combination);
+    if (!isZero(row))
+        return false;
+
+    indices.clear();
+    for (size_t i = 0; i < rows.size(); i++)
+        if (getBit(combination, i))
+            indices.push_back(i);
+    return true;
+}
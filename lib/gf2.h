@@ -0,0 +1,47 @@
+#ifndef GF2_H
+#define GF2_H
+#include <cstdint>
+#include <vector>
+
+/**
+ * Incrementally built basis of vectors over GF(2). Remembers which of the
+ * added vectors make up each basis vector, so that any vector in their span
+ * can be expressed as a sum of the added vectors.
+ */
+class Gf2Basis final
+{
+    public:
+        typedef std::vector<uint64_t> Vector;
+
+    public:
+        Gf2Basis(size_t numBits);
+
+        static Vector createVector(size_t numBits);
+        static bool getBit(const Vector &vector, size_t bit);
+        static void setBit(Vector &vector, size_t bit, bool value);
+
+        /**
+         * Returns false if the vector is dependent on the ones added so
+         * far, in which case it is not kept. Kept vectors are numbered
+         * in the order they were added.
+         */
+        bool add(const Vector &vector);
+        size_t getRank() const;
+        bool isFull() const;
+
+        /**
+         * Finds which of the kept vectors sum up to the target.
+         * Returns false if the target is outside of their span.
+         */
+        bool solve(const Vector &target, std::vector<size_t> &indices) const;
+
+    private:
+        void reduce(Vector &vector, Vector &combination) const;
+
+        size_t numBits;
+        std::vector<Vector> rows;
+        std::vector<Vector> combinations;
+        std::vector<size_t> pivots;
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cstdio>
+#include "job.h"
+
+CancellationToken::CancellationToken()
+    : cancelled(false), deadline(Clock::duration::max().count())
+{
+}
+
+void CancellationToken::cancel()
+{
+    cancelled.store(true, std::memory_order_relaxed);
+}
+
+void CancellationToken::setDeadline(Clock::time_point deadline)
+{
+    this->deadline.store(
+        deadline.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool CancellationToken::isCancelled() const
+{
+    if (cancelled.load(std::memory_order_relaxed))
+        return true;
+    auto deadline = this->deadline.load(std::memory_order_relaxed);
+    return deadline != Clock::duration::max().count()
+        && Clock::now().time_since_epoch().count() >= deadline;
+}
+
+void CancellationToken::check() const
+{
+    if (cancelled.load(std::memory_order_relaxed))
+        throw JobCancelled("Job was cancelled");
+    if (isCancelled())
+        throw JobCancelled("Job ran past its deadline");
+}
+
+ThreadPool::ThreadPool(size_t numThreads) : stopping(false)
+{
+    for (size_t i = 0; i < std::max<size_t>(numThreads, 1); i++)
+        threads.emplace_back(&ThreadPool::run, this);
+}
+
+/**
+ * Lets the queued tasks finish first.
+ */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+}
+
+ThreadPool &ThreadPool::getShared()
+{
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+void ThreadPool::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wakeUp.notify_one();
+}
+
+void ThreadPool::run()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+Job::Job(std::function<void()> done)
+    : result(promise.get_future().share()), done(done)
+{
+    checksumProgress.setCancellationToken(&token);
+    writeProgress.setCancellationToken(&token);
+}
+
+std::shared_ptr<Job> Job::computeChecksum(
+    std::shared_ptr<const CRC> crc,
+    const std::string &inputPath,
+    std::function<void()> done)
+{
+    std::shared_ptr<Job> job(new Job(done));
+    ThreadPool::getShared().post([job, crc, inputPath]()
+    {
+        job->run([&]()
+        {
+            auto inputFile = File::fromFileName(
+                inputPath, File::Mode::Read | File::Mode::Binary);
+            return crc->computeChecksum(*inputFile, job->checksumProgress);
+        });
+    });
+    return job;
+}
+
+std::shared_ptr<Job> Job::resumeChecksum(
+    std::shared_ptr<const CRC> crc,
+    const std::string &inputPath,
+    ChecksumState &state,
+    std::function<void()> done)
+{
+    std::shared_ptr<Job> job(new Job(done));
+    auto statePtr = &state;
+    ThreadPool::getShared().post([job, crc, inputPath, statePtr]()
+    {
+        job->run([&]()
+        {
+            auto inputFile = File::fromFileName(
+                inputPath, File::Mode::Read | File::Mode::Binary);
+            return updateChecksumState(
+                *crc, *inputFile, *statePtr, job->checksumProgress);
+        });
+    });
+    return job;
+}
+
+std::shared_ptr<Job> Job::applyPatch(
+    std::shared_ptr<const CRC> crc,
+    CRC::Value targetChecksum,
+    File::OffsetType targetPosition,
+    const std::string &inputPath,
+    const std::string &outputPath,
+    bool overwrite,
+    bool verify,
+    std::function<void()> done)
+{
+    return applyPatch(
+        crc,
+        targetChecksum,
+        [targetPosition](File::OffsetType) { return targetPosition; },
+        inputPath,
+        outputPath,
+        overwrite,
+        verify,
+        done);
+}
+
+std::shared_ptr<Job> Job::applyPatch(
+    std::shared_ptr<const CRC> crc,
+    CRC::Value targetChecksum,
+    const std::function<File::OffsetType(File::OffsetType)>
+        &getTargetPosition,
+    const std::string &inputPath,
+    const std::string &outputPath,
+    bool overwrite,
+    bool verify,
+    std::function<void()> done)
+{
+    std::shared_ptr<Job> job(new Job(done));
+    ThreadPool::getShared().post([=]()
+    {
+        job->run([&]()
+        {
+            auto inputFile = File::fromFileName(
+                inputPath, File::Mode::Read | File::Mode::Binary);
+            auto targetPosition = getTargetPosition(inputFile->getSize());
+            std::unique_ptr<File> outputFile;
+            try
+            {
+                outputFile = File::fromFileName(
+                    outputPath, File::Mode::Write | File::Mode::Binary);
+                crc->applyPatch(
+                    targetChecksum,
+                    targetPosition,
+                    *inputFile,
+                    *outputFile,
+                    overwrite,
+                    job->writeProgress,
+                    job->checksumProgress,
+                    verify);
+            }
+            catch (...)
+            {
+                if (outputFile != nullptr)
+                {
+                    outputFile.reset();
+                    std::remove(outputPath.c_str());
+                }
+                throw;
+            }
+            return targetChecksum;
+        });
+    });
+    return job;
+}
+
+void Job::cancel()
+{
+    token.cancel();
+}
+
+void Job::setDeadline(CancellationToken::Clock::time_point deadline)
+{
+    token.setDeadline(deadline);
+}
+
+bool Job::isDone() const
+{
+    return waitFor(std::chrono::milliseconds(0));
+}
+
+bool Job::waitFor(std::chrono::milliseconds timeout) const
+{
+    return result.wait_for(timeout) == std::future_status::ready;
+}
+
+CRC::Value Job::get() const
+{
+    return result.get();
+}
+
+Progress &Job::getChecksumProgress()
+{
+    return checksumProgress;
+}
+
+Progress &Job::getWriteProgress()
+{
+    return writeProgress;
+}
+
+/**
+ * Jobs cancelled while still queued don't even open their files.
+ */
+void Job::run(const std::function<CRC::Value()> &work)
+{
+    try
+    {
+        token.check();
+        promise.set_value(work());
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+    }
+    if (done)
+        done();
+}
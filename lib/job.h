@@ -0,0 +1,156 @@
+#ifndef JOB_H
+#define JOB_H
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "checksum_state.h"
+#include "crc.h"
+
+/**
+ * Thrown out of the work loops of a cancelled or overdue job.
+ */
+class JobCancelled : public std::runtime_error
+{
+    public:
+        JobCancelled(const std::string &msg) : std::runtime_error(msg) { }
+};
+
+/**
+ * Checked by the work loops once per chunk, through Progress::set().
+ */
+class CancellationToken final
+{
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        CancellationToken();
+
+        void cancel();
+        void setDeadline(Clock::time_point deadline);
+
+        bool isCancelled() const;
+        void check() const;
+
+    private:
+        std::atomic<bool> cancelled;
+        std::atomic<Clock::rep> deadline;
+};
+
+class ThreadPool final
+{
+    public:
+        ThreadPool(size_t numThreads);
+        ~ThreadPool();
+
+        /**
+         * Pool with a thread per core, shared by all jobs.
+         */
+        static ThreadPool &getShared();
+
+        void post(std::function<void()> task);
+
+    private:
+        void run();
+
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::deque<std::function<void()>> tasks;
+        bool stopping;
+        std::vector<std::thread> threads;
+};
+
+/**
+ * Handle to work running on the shared thread pool. Dropping the handle
+ * doesn't stop the work; cancel() does, as soon as the current chunk is
+ * processed.
+ */
+class Job final
+{
+    public:
+        /**
+         * Given done gets called on the pool thread once the result is
+         * ready, for callers that can't block on get().
+         */
+        static std::shared_ptr<Job> computeChecksum(
+            std::shared_ptr<const CRC> crc,
+            const std::string &inputPath,
+            std::function<void()> done = nullptr);
+
+        /**
+         * Same as above, reading only what state doesn't cover yet. The
+         * state is brought up to date in place, so it must outlive the job.
+         */
+        static std::shared_ptr<Job> resumeChecksum(
+            std::shared_ptr<const CRC> crc,
+            const std::string &inputPath,
+            ChecksumState &state,
+            std::function<void()> done = nullptr);
+
+        /**
+         * Writes the patched input to outputPath. If the job fails or gets
+         * cancelled, the partial output is removed. With verify set, it
+         * also fails if the written bytes don't match the target.
+         */
+        static std::shared_ptr<Job> applyPatch(
+            std::shared_ptr<const CRC> crc,
+            CRC::Value targetChecksum,
+            File::OffsetType targetPosition,
+            const std::string &inputPath,
+            const std::string &outputPath,
+            bool overwrite,
+            bool verify = false,
+            std::function<void()> done = nullptr);
+
+        /**
+         * Same as above, with the position worked out from the size of
+         * the input once it's open, so that the caller doesn't have to
+         * touch the file.
+         */
+        static std::shared_ptr<Job> applyPatch(
+            std::shared_ptr<const CRC> crc,
+            CRC::Value targetChecksum,
+            const std::function<File::OffsetType(File::OffsetType)>
+                &getTargetPosition,
+            const std::string &inputPath,
+            const std::string &outputPath,
+            bool overwrite,
+            bool verify = false,
+            std::function<void()> done = nullptr);
+
+        void cancel();
+        void setDeadline(CancellationToken::Clock::time_point deadline);
+
+        bool isDone() const;
+        bool waitFor(std::chrono::milliseconds timeout) const;
+
+        /**
+         * Waits for the job, then returns the checksum of the input or of
+         * the patched output, or rethrows what made the job fail.
+         */
+        CRC::Value get() const;
+
+        Progress &getChecksumProgress();
+        Progress &getWriteProgress();
+
+    private:
+        Job(std::function<void()> done);
+        void run(const std::function<CRC::Value()> &work);
+
+        CancellationToken token;
+        Progress checksumProgress;
+        Progress writeProgress;
+        std::promise<CRC::Value> promise;
+        std::shared_future<CRC::Value> result;
+        std::function<void()> done;
+};
+
+#endif
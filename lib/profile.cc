@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include "profile.h"
+
+namespace
+{
+    const char *Magic = "crcmanip-profile";
+    const int Version = 1;
+
+    //anything outside is more likely a typo than a measurement
+    const size_t MinIoSize = 4 << 10;
+    const size_t MaxIoSize = 64 << 20;
+    const unsigned MaxQueueDepth = 4096;
+
+    std::mutex activeProfileMutex;
+    std::unique_ptr<Profile> activeProfile;
+
+    bool readTuning(std::istream &stream, Tuning &tuning)
+    {
+        stream >> tuning.chunkSize >> tuning.bufferSize >> tuning.queueDepth;
+        return stream && tuning.chunkSize > 0 && tuning.queueDepth > 0;
+    }
+
+    bool isSane(const Tuning &tuning)
+    {
+        return tuning.chunkSize >= MinIoSize
+            && tuning.chunkSize <= MaxIoSize
+            && (tuning.bufferSize == 0
+                || (tuning.bufferSize >= MinIoSize
+                    && tuning.bufferSize <= MaxIoSize))
+            && tuning.queueDepth <= MaxQueueDepth;
+    }
+
+    void writeTuning(std::ostream &stream, const Tuning &tuning)
+    {
+        stream << tuning.chunkSize << " "
+            << tuning.bufferSize << " "
+            << tuning.queueDepth << "\n";
+    }
+}
+
+const Tuning &Profile::getTuning(uint64_t device) const
+{
+    auto it = filesystems.find(device);
+    return it == filesystems.end() ? defaults : it->second;
+}
+
+Profile getBuiltinProfile()
+{
+    Profile profile;
+    profile.defaults.chunkSize = 8192;
+    profile.defaults.bufferSize = 0;
+    profile.defaults.queueDepth = 64;
+    return profile;
+}
+
+std::string getDefaultProfilePath()
+{
+    auto path = std::getenv("CRCMANIP_PROFILE");
+    if (path != nullptr && *path)
+        return path;
+    auto home = std::getenv("HOME");
+    if (home == nullptr)
+        home = std::getenv("USERPROFILE");
+    return std::string(home != nullptr ? home : ".") + "/.crcmanip-profile";
+}
+
+bool loadProfile(const std::string &path, Profile &profile)
+{
+    std::ifstream stream(path);
+    if (!stream)
+        return false;
+
+    std::string magic;
+    int version;
+    stream >> magic >> version;
+    if (!stream || magic != Magic || version != Version)
+        throw std::runtime_error("Invalid profile: " + path);
+
+    profile = getBuiltinProfile();
+    std::string key;
+    while (stream >> key)
+    {
+        bool ok;
+        Tuning tuning;
+        if (key == "default")
+        {
+            ok = readTuning(stream, tuning);
+            if (ok && isSane(tuning))
+                profile.defaults = tuning;
+        }
+        else if (key == "fs")
+        {
+            uint64_t device;
+            ok = (stream >> device) && readTuning(stream, tuning);
+            if (ok && isSane(tuning))
+                profile.filesystems[device] = tuning;
+        }
+        else
+            ok = false;
+        if (!ok)
+            throw std::runtime_error("Invalid profile: " + path);
+    }
+    return true;
+}
+
+void saveProfile(const std::string &path, const Profile &profile)
+{
+    //write aside and rename, like the checksum state
+    auto tmpPath = path + ".tmp";
+    {
+        std::ofstream stream(tmpPath);
+        stream << Magic << " " << Version << "\n";
+        stream << "default ";
+        writeTuning(stream, profile.defaults);
+        for (auto &it : profile.filesystems)
+        {
+            stream << "fs " << it.first << " ";
+            writeTuning(stream, it.second);
+        }
+        if (!stream)
+            throw std::runtime_error("Can't write profile: " + path);
+    }
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(path.c_str());
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("Can't write profile: " + path);
+    }
+}
+
+Tuning getActiveTuning(uint64_t device)
+{
+    std::lock_guard<std::mutex> lock(activeProfileMutex);
+    if (activeProfile == nullptr)
+        activeProfile.reset(new Profile(getBuiltinProfile()));
+    return activeProfile->getTuning(device);
+}
+
+void setActiveProfile(const Profile &profile)
+{
+    std::lock_guard<std::mutex> lock(activeProfileMutex);
+    activeProfile.reset(new Profile(profile));
+}
+
+/**
+ * A broken profile shouldn't stop files from opening, so it's ignored.
+ */
+void activateDefaultProfile()
+{
+    Profile profile = getBuiltinProfile();
+    try
+    {
+        if (loadProfile(getDefaultProfilePath(), profile))
+            setActiveProfile(profile);
+    }
+    catch (std::runtime_error &)
+    {
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * I/O settings that suit one filesystem best.
+ */
+typedef struct
+{
+    //how much the checksum and copy loops read at once
+    size_t chunkSize;
+    //stdio buffer of each file; zero leaves the libc default
+    size_t bufferSize;
+    //how many small files are read at once
+    unsigned queueDepth;
+} Tuning;
+
+/**
+ * Settings found by crcmanip tune on this machine, per filesystem, keyed
+ * by device number. Filesystems that weren't tuned get the defaults.
+ */
+struct Profile
+{
+    Tuning defaults;
+    std::map<uint64_t, Tuning> filesystems;
+
+    const Tuning &getTuning(uint64_t device) const;
+};
+
+Profile getBuiltinProfile();
+
+/**
+ * CRCMANIP_PROFILE if set, ~/.crcmanip-profile otherwise.
+ */
+std::string getDefaultProfilePath();
+
+/**
+ * Returns false if the profile file doesn't exist yet. Settings with sizes
+ * out of any sane range are skipped, leaving the builtin ones in place.
+ */
+bool loadProfile(const std::string &path, Profile &profile);
+void saveProfile(const std::string &path, const Profile &profile);
+
+/**
+ * Profile that File consults when opening files; the builtin one unless
+ * programs set another, so that libraries and tests don't depend on what
+ * was tuned on the machine.
+ */
+Tuning getActiveTuning(uint64_t device);
+void setActiveProfile(const Profile &profile);
+
+/**
+ * Activates the profile at the default path, if there's a valid one.
+ */
+void activateDefaultProfile();
+
+#endif
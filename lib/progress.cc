@@ -1,37 +1,112 @@
+#include <algorithm>
+#include "job.h"
 #include "progress.h"
 
-void Progress::start(uint64_t max)
+Progress::Progress()
+    : current(0), max(0), phase(Phase::Idle), lastPercentage(-1.0),
+        token(nullptr), phaseStats()
 {
-    this->max = max;
+}
+
+void Progress::setCancellationToken(const CancellationToken *token)
+{
+    this->token = token;
+}
+
+void Progress::checkCancelled() const
+{
+    token->check();
+}
+
+void Progress::start(uint64_t max, Phase phase)
+{
+    this->current.store(0, std::memory_order_relaxed);
+    this->max.store(max, std::memory_order_relaxed);
+    this->phase.store(phase, std::memory_order_release);
+    startTime = std::chrono::steady_clock::now();
     if (started != nullptr)
         started();
-    if (changed != nullptr)
-        changed(lastPercentage = 0.0);
 }
 
 void Progress::finish()
 {
-    if (changed != nullptr)
-        changed(lastPercentage = 100.0);
+    auto &stats = phaseStats[static_cast<size_t>(getPhase())];
+    stats.seconds += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - startTime).count();
+    stats.bytes += max.load(std::memory_order_relaxed);
+    stats.numRuns++;
+
+    current.store(max.load(std::memory_order_relaxed));
+    phase.store(Phase::Idle, std::memory_order_release);
     if (finished != nullptr)
         finished();
 }
 
-void Progress::set(int current)
+/**
+ * Meant to be called from a single thread, usually the UI one.
+ */
+void Progress::poll()
+{
+    if (changed == nullptr)
+        return;
+
+    auto max = this->max.load(std::memory_order_relaxed);
+    auto current = this->current.load(std::memory_order_relaxed);
+    double percentage = max == 0
+        ? 0.0
+        : std::min(100.0, current * 100.0 / static_cast<double>(max));
+    double delta = lastPercentage - percentage;
+    if (delta > 0.1 || delta < -0.1)
+    {
+        changed(percentage);
+        lastPercentage = percentage;
+    }
+}
+
+Progress::Phase Progress::getPhase() const
+{
+    return phase.load(std::memory_order_acquire);
+}
+
+uint64_t Progress::getCurrent() const
+{
+    return current.load(std::memory_order_relaxed);
+}
+
+uint64_t Progress::getMax() const
+{
+    return max.load(std::memory_order_relaxed);
+}
+
+Progress::PhaseStats Progress::getPhaseStats(Phase phase) const
+{
+    return phaseStats[static_cast<size_t>(phase)];
+}
+
+ProgressObserver::ProgressObserver(
+    const std::vector<Progress*> &progresses,
+    std::chrono::milliseconds interval)
+    : progresses(progresses), interval(interval), stopping(false),
+        thread(&ProgressObserver::run, this)
+{
+}
+
+ProgressObserver::~ProgressObserver()
 {
-    if (changed != nullptr)
     {
-        if (max == 0)
-            changed(0.0);
-        else
-        {
-            double percentage = current * 100.0 / static_cast<double>(max);
-            double delta = lastPercentage - percentage;
-            if (delta > 0.1 || delta < -0.1)
-            {
-                changed(percentage);
-                lastPercentage = percentage;
-            }
-        }
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
     }
+    wakeUp.notify_one();
+    thread.join();
+    for (auto progress : progresses)
+        progress->poll();
+}
+
+void ProgressObserver::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wakeUp.wait_for(lock, interval, [this] { return stopping; }))
+        for (auto progress : progresses)
+            progress->poll();
 }
@@ -1,22 +1,110 @@
 #ifndef PROGRESS_H
 #define PROGRESS_H
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CancellationToken;
 
 class Progress
 {
     public:
+        /**
+         * Prefix and suffix phases read the input forwards and backwards,
+         * copy phase writes the output.
+         */
+        enum class Phase : uint8_t
+        {
+            Idle,
+            Prefix,
+            Suffix,
+            Copy
+        };
+
+        /**
+         * Time spent in a phase and bytes gone through, summed over all
+         * the times it ran. Meant to be read once the work is done.
+         */
+        typedef struct
+        {
+            double seconds;
+            uint64_t bytes;
+            uint64_t numRuns;
+        } PhaseStats;
+
         std::function<void(double percentage)> changed;
         std::function<void()> started;
         std::function<void()> finished;
 
     public:
-        void start(uint64_t max);
-        void set(int step);
+        Progress();
+
+        void start(uint64_t max, Phase phase = Phase::Prefix);
         void finish();
 
+        /**
+         * Called from the hot loops, so all it does is publish the position
+         * and see if the work should stop; changed is invoked by whoever
+         * samples it with poll().
+         */
+        void set(uint64_t current)
+        {
+            this->current.store(current, std::memory_order_relaxed);
+            if (token != nullptr)
+                checkCancelled();
+        }
+
+        /**
+         * Makes set() throw JobCancelled once the token is cancelled.
+         */
+        void setCancellationToken(const CancellationToken *token);
+
+        void poll();
+
+        Phase getPhase() const;
+        uint64_t getCurrent() const;
+        uint64_t getMax() const;
+        PhaseStats getPhaseStats(Phase phase) const;
+
     private:
+        std::atomic<uint64_t> current;
+        std::atomic<uint64_t> max;
+        std::atomic<Phase> phase;
         double lastPercentage;
-        uint64_t max;
+        const CancellationToken *token;
+        std::chrono::steady_clock::time_point startTime;
+        PhaseStats phaseStats[static_cast<size_t>(Phase::Copy) + 1];
+
+        void checkCancelled() const;
+};
+
+/**
+ * Polls given progresses at a fixed rate on its own thread until it's
+ * destroyed, which polls them one last time.
+ */
+class ProgressObserver final
+{
+    public:
+        ProgressObserver(
+            const std::vector<Progress*> &progresses,
+            std::chrono::milliseconds interval
+                = std::chrono::milliseconds(100));
+        ~ProgressObserver();
+
+    private:
+        void run();
+
+        std::vector<Progress*> progresses;
+        std::chrono::milliseconds interval;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        bool stopping;
+        std::thread thread;
 };
 
 #endif
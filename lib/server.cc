@@ -0,0 +1,749 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "crc_factories.h"
+#include "server.h"
+#include "util.h"
+#if HAVE_UNIX_SOCKETS
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace
+{
+    //requests are a handful of short fields; anything bigger is garbage
+    const size_t MaxMessageSize = 1 << 16;
+
+    //clients past either limit aren't read from until they catch up
+    const size_t MaxPendingRequests = 1024;
+    const size_t MaxOutgoingSize = 1 << 20;
+
+    const std::chrono::milliseconds ProgressInterval(100);
+
+    std::runtime_error systemError(const std::string &what)
+    {
+        return std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    std::string formatChecksum(CRC::Value checksum, size_t numDigits)
+    {
+        std::ostringstream s;
+        s << std::hex
+            << std::uppercase
+            << std::setw(numDigits)
+            << std::setfill('0')
+            << checksum;
+        return s.str();
+    }
+
+    CRC::Value parseChecksum(const std::string &str, size_t numDigits)
+    {
+        if (str.empty()
+            || str.size() > numDigits
+            || str.find_first_not_of("0123456789abcdefABCDEF")
+                != std::string::npos)
+        {
+            throw std::invalid_argument("Invalid checksum: " + str);
+        }
+        return std::stoull(str, nullptr, 16);
+    }
+
+    std::string getPhaseName(Progress::Phase phase)
+    {
+        static const char *phaseNames[] = {"", "prefix", "suffix", "copy"};
+        return phaseNames[static_cast<int>(phase)];
+    }
+
+    std::string formatPercentage(const Progress &progress)
+    {
+        auto max = progress.getMax();
+        std::ostringstream s;
+        s << std::fixed
+            << std::setprecision(2)
+            << (max ? progress.getCurrent() * 100.0 / max : 0.0);
+        return s.str();
+    }
+}
+
+std::string encodeMessage(const std::vector<std::string> &fields)
+{
+    std::string payload;
+    for (size_t i = 0; i < fields.size(); i++)
+        payload += (i ? "\n" : "") + fields[i];
+    if (payload.size() > MaxMessageSize)
+        throw std::invalid_argument("Message is too long");
+
+    std::string message;
+    for (size_t i = 0; i < 4; i++)
+        message.push_back(static_cast<char>(payload.size() >> (i << 3)));
+    return message + payload;
+}
+
+bool decodeMessage(std::string &buffer, std::vector<std::string> &fields)
+{
+    if (buffer.size() < 4)
+        return false;
+    size_t size = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+        auto byte = static_cast<uint8_t>(buffer[i]);
+        size |= static_cast<size_t>(byte) << (i << 3);
+    }
+    if (size > MaxMessageSize)
+        throw std::runtime_error("Message is too long");
+    if (buffer.size() < 4 + size)
+        return false;
+
+    fields.clear();
+    size_t start = 4;
+    while (true)
+    {
+        auto end = buffer.find('\n', start);
+        if (end == std::string::npos || end >= 4 + size)
+        {
+            fields.push_back(buffer.substr(start, 4 + size - start));
+            break;
+        }
+        fields.push_back(buffer.substr(start, end - start));
+        start = end + 1;
+    }
+    buffer.erase(0, 4 + size);
+    return true;
+}
+
+#if HAVE_UNIX_SOCKETS
+    namespace
+    {
+        #ifdef MSG_NOSIGNAL
+            const int SendFlags = MSG_NOSIGNAL;
+        #else
+            const int SendFlags = 0;
+        #endif
+
+        sockaddr_un getAddress(const std::string &socketPath)
+        {
+            sockaddr_un address = {};
+            if (socketPath.size() >= sizeof(address.sun_path))
+                throw std::invalid_argument("Socket path is too long");
+            address.sun_family = AF_UNIX;
+            std::strcpy(address.sun_path, socketPath.c_str());
+            return address;
+        }
+
+        bool setNonBlocking(int fd)
+        {
+            int flags = fcntl(fd, F_GETFL);
+            return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+        }
+
+        int connectTo(const std::string &socketPath)
+        {
+            auto address = getAddress(socketPath);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                throw systemError("Couldn't create socket");
+            if (::connect(
+                fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)))
+            {
+                auto error = systemError("Couldn't connect to " + socketPath);
+                ::close(fd);
+                throw error;
+            }
+            return fd;
+        }
+
+        bool isListening(const std::string &socketPath)
+        {
+            auto address = getAddress(socketPath);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                throw systemError("Couldn't create socket");
+            bool listening = ::connect(
+                fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))
+                == 0;
+            ::close(fd);
+            return listening;
+        }
+
+        /**
+         * A socket file left behind by a server that died is replaced; one
+         * that still accepts connections, or any other file, is not.
+         */
+        int listenOn(const std::string &socketPath)
+        {
+            struct stat info;
+            if (::lstat(socketPath.c_str(), &info) == 0)
+            {
+                if (!S_ISSOCK(info.st_mode))
+                    throw std::runtime_error(socketPath + " isn't a socket");
+                if (isListening(socketPath))
+                {
+                    throw std::runtime_error(
+                        "Another server is listening on " + socketPath);
+                }
+                ::unlink(socketPath.c_str());
+            }
+
+            auto address = getAddress(socketPath);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                throw systemError("Couldn't create socket");
+            if (::bind(
+                    fd,
+                    reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address))
+                || ::listen(fd, SOMAXCONN)
+                || !setNonBlocking(fd))
+            {
+                auto error = systemError("Couldn't listen on " + socketPath);
+                ::close(fd);
+                throw error;
+            }
+            return fd;
+        }
+
+        void wakeUp(int fd)
+        {
+            //a full pipe already has a wake-up pending
+            char byte = 0;
+            if (::write(fd, &byte, 1) < 0)
+                return;
+        }
+
+        void respond(
+            std::string &outgoing, const std::vector<std::string> &fields)
+        {
+            outgoing += encodeMessage(fields);
+        }
+    }
+
+    /**
+     * Closed once the server and the callbacks of all its jobs are done
+     * with it, so that no callback writes to a reused descriptor.
+     */
+    struct Server::WakeUpPipe
+    {
+        int fds[2];
+
+        WakeUpPipe()
+        {
+            if (::pipe(fds))
+                throw systemError("Couldn't create pipe");
+            if (!setNonBlocking(fds[0]) || !setNonBlocking(fds[1]))
+            {
+                auto error = systemError("Couldn't set up pipe");
+                ::close(fds[0]);
+                ::close(fds[1]);
+                throw error;
+            }
+        }
+
+        ~WakeUpPipe()
+        {
+            ::close(fds[0]);
+            ::close(fds[1]);
+        }
+    };
+
+    ServerClient::ServerClient(const std::string &socketPath)
+        : socket(connectTo(socketPath))
+    {
+    }
+
+    ServerClient::~ServerClient()
+    {
+        ::close(socket);
+    }
+
+    void ServerClient::send(const std::vector<std::string> &fields)
+    {
+        auto message = encodeMessage(fields);
+        for (size_t pos = 0; pos < message.size(); )
+        {
+            auto sent = ::send(
+                socket, message.data() + pos, message.size() - pos, SendFlags);
+            if (sent < 0 && errno != EINTR)
+                throw systemError("Couldn't send request");
+            if (sent > 0)
+                pos += sent;
+        }
+    }
+
+    std::vector<std::string> ServerClient::receive()
+    {
+        std::vector<std::string> fields;
+        while (!decodeMessage(buffer, fields))
+        {
+            char chunk[4096];
+            auto received = ::recv(socket, chunk, sizeof(chunk), 0);
+            if (received == 0)
+                throw std::runtime_error("Server closed the connection");
+            if (received < 0 && errno != EINTR)
+                throw systemError("Couldn't receive response");
+            if (received > 0)
+                buffer.append(chunk, received);
+        }
+        return fields;
+    }
+
+    void ServerClient::finishSending()
+    {
+        if (::shutdown(socket, SHUT_WR))
+            throw systemError("Couldn't shut down the connection");
+    }
+
+    Server::Server(const std::string &socketPath, size_t maxActiveJobs)
+        : socketPath(socketPath),
+            maxActiveJobs(maxActiveJobs
+                ? maxActiveJobs
+                : std::max<size_t>(std::thread::hardware_concurrency(), 1)),
+            numActiveJobs(0),
+            wakeUpPipe(std::make_shared<WakeUpPipe>()),
+            lastServedSocket(-1),
+            stopping(false)
+    {
+        listener = listenOn(socketPath);
+    }
+
+    /**
+     * Jobs still running update files on behalf of clients that are about
+     * to be dropped, so they're cancelled and waited for.
+     */
+    Server::~Server()
+    {
+        for (auto &client : clients)
+        {
+            for (auto &active : client.second.active)
+            {
+                active.job->cancel();
+                abandonedJobs.push_back(active.job);
+            }
+            ::close(client.first);
+        }
+        for (auto &job : abandonedJobs)
+        {
+            job->cancel();
+            while (!job->waitFor(std::chrono::milliseconds(100)))
+                continue;
+        }
+
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+    }
+
+    void Server::stop()
+    {
+        stopping.store(true);
+        wakeUp(wakeUpPipe->fds[1]);
+    }
+
+    void Server::run()
+    {
+        while (!stopping.load())
+        {
+            std::vector<pollfd> fds;
+            fds.push_back({wakeUpPipe->fds[0], POLLIN, 0});
+            fds.push_back({listener, POLLIN, 0});
+            for (auto &client : clients)
+            {
+                short events = 0;
+                if (isAcceptingRequests(client.second))
+                    events |= POLLIN;
+                if (!client.second.outgoing.empty())
+                    events |= POLLOUT;
+                fds.push_back({client.first, events, 0});
+            }
+
+            //progress is sampled only while there's some to report
+            int timeout = numActiveJobs
+                ? static_cast<int>(ProgressInterval.count())
+                : -1;
+            if (::poll(fds.data(), fds.size(), timeout) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw systemError("Couldn't wait for requests");
+            }
+
+            if (fds[0].revents & POLLIN)
+            {
+                char buffer[256];
+                while (::read(wakeUpPipe->fds[0], buffer, sizeof(buffer)) > 0)
+                    continue;
+            }
+            if (fds[1].revents & POLLIN)
+                acceptClient();
+
+            for (size_t i = 2; i < fds.size(); i++)
+            {
+                auto client = clients.find(fds[i].fd);
+                if (client == clients.end())
+                    continue;
+                //hanging up entirely, unlike shutting down the sending
+                //side, leaves nobody to respond to
+                bool ok = !(fds[i].revents & (POLLHUP | POLLERR));
+                if (ok && (fds[i].revents & POLLIN))
+                    ok = readFromClient(client->first, client->second);
+                if (ok && (fds[i].revents & POLLOUT))
+                    ok = writeToClient(client->first, client->second);
+                if (!ok)
+                    dropClient(client->first);
+            }
+
+            reportJobs();
+            startJobs();
+
+            //most responses fit in the socket buffer right away
+            for (auto client = clients.begin(); client != clients.end(); )
+            {
+                auto socket = client->first;
+                auto &state = client->second;
+                bool ok = state.outgoing.empty()
+                    || writeToClient(socket, state);
+                bool finished = state.doneSending
+                    && state.pending.empty()
+                    && state.active.empty()
+                    && state.outgoing.empty();
+                ++client;
+                if (!ok || finished)
+                    dropClient(socket);
+            }
+        }
+    }
+
+    void Server::acceptClient()
+    {
+        while (true)
+        {
+            int socket = ::accept(listener, nullptr, nullptr);
+            if (socket < 0)
+                return;
+            if (!setNonBlocking(socket))
+            {
+                ::close(socket);
+                continue;
+            }
+            clients[socket] = Client();
+        }
+    }
+
+    bool Server::isAcceptingRequests(const Client &client) const
+    {
+        return !client.doneSending
+            && client.pending.size() < MaxPendingRequests
+            && client.outgoing.size() < MaxOutgoingSize;
+    }
+
+    /**
+     * Reads until the socket runs dry or the client has enough queued.
+     * Returns false if the connection failed or the client broke the
+     * protocol.
+     */
+    bool Server::readFromClient(int socket, Client &client)
+    {
+        while (isAcceptingRequests(client))
+        {
+            char chunk[4096];
+            auto received = ::recv(socket, chunk, sizeof(chunk), 0);
+            if (received == 0)
+            {
+                client.doneSending = true;
+                break;
+            }
+            if (received < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    return false;
+                break;
+            }
+            client.incoming.append(chunk, received);
+
+            try
+            {
+                std::vector<std::string> fields;
+                while (decodeMessage(client.incoming, fields))
+                {
+                    if (fields.size() < 2)
+                    {
+                        respond(
+                            client.outgoing,
+                            {fields[0], "error", "No command"});
+                    }
+                    else
+                        client.pending.push_back(fields);
+                }
+            }
+            catch (std::runtime_error &)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Server::writeToClient(int socket, Client &client)
+    {
+        size_t pos = 0;
+        while (pos < client.outgoing.size())
+        {
+            auto sent = ::send(
+                socket,
+                client.outgoing.data() + pos,
+                client.outgoing.size() - pos,
+                SendFlags);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    return false;
+                break;
+            }
+            pos += sent;
+        }
+        client.outgoing.erase(0, pos);
+        return true;
+    }
+
+    /**
+     * Work nobody waits for anymore is cancelled; patch jobs remove their
+     * partial outputs on the way out.
+     */
+    void Server::dropClient(int socket)
+    {
+        auto &client = clients[socket];
+        for (auto &active : client.active)
+        {
+            active.job->cancel();
+            abandonedJobs.push_back(active.job);
+        }
+        ::close(socket);
+        clients.erase(socket);
+    }
+
+    /**
+     * Hands free slots to clients in turn, one request at a time, starting
+     * after the one served last.
+     */
+    void Server::startJobs()
+    {
+        while (numActiveJobs < maxActiveJobs)
+        {
+            auto client = clients.upper_bound(lastServedSocket);
+            size_t numChecked = 0;
+            for (; numChecked < clients.size(); numChecked++)
+            {
+                if (client == clients.end())
+                    client = clients.begin();
+                if (!client->second.pending.empty())
+                    break;
+                ++client;
+            }
+            if (numChecked == clients.size())
+                return;
+
+            lastServedSocket = client->first;
+            auto fields = client->second.pending.front();
+            client->second.pending.pop_front();
+            startJob(client->second, fields);
+        }
+    }
+
+    void Server::startJob(
+        Client &client, const std::vector<std::string> &fields)
+    {
+        const auto &id = fields[0];
+        const auto &command = fields[1];
+        auto sharedPipe = wakeUpPipe;
+        auto done = [sharedPipe]() { wakeUp(sharedPipe->fds[1]); };
+
+        try
+        {
+            auto algorithm = fields.size() > 2 ? fields[2] : "";
+            auto crc = findBuiltinCRC(algorithm);
+            if (crc == nullptr)
+                throw std::invalid_argument("Unknown algorithm: " + algorithm);
+            auto numBytes = crc->getSpecs().numBytes;
+
+            std::shared_ptr<Job> job;
+            if (command == "calc" && fields.size() == 4)
+                job = Job::computeChecksum(crc, fields[3], done);
+            else if (command == "patch"
+                && (fields.size() == 8 || fields.size() == 9))
+            {
+                if (fields[7] != "insert" && fields[7] != "overwrite")
+                {
+                    throw std::invalid_argument(
+                        "Mode must be insert or overwrite");
+                }
+                if (fields.size() == 9 && fields[8] != "verify")
+                    throw std::invalid_argument("Unknown flag: " + fields[8]);
+                bool overwrite = fields[7] == "overwrite";
+                auto checksum = parseChecksum(fields[5], numBytes * 2);
+
+                //the input is only opened by the job, so that a slow
+                //filesystem doesn't hold up everyone else
+                bool autoPosition = fields[6].empty();
+                File::OffsetType userPosition = autoPosition
+                    ? 0
+                    : parseInteger(
+                        "position",
+                        fields[6],
+                        10,
+                        std::numeric_limits<File::OffsetType>::min(),
+                        std::numeric_limits<File::OffsetType>::max());
+                auto getPosition = [=](File::OffsetType fileSize)
+                {
+                    return autoPosition
+                        ? computeAutoPosition(fileSize, numBytes, overwrite)
+                        : shiftUserPosition(
+                            userPosition, fileSize, numBytes, overwrite);
+                };
+
+                job = Job::applyPatch(
+                    crc,
+                    checksum,
+                    getPosition,
+                    fields[3],
+                    fields[4],
+                    overwrite,
+                    fields.size() == 9,
+                    done);
+            }
+            else
+                throw std::invalid_argument("Malformed request: " + command);
+
+            ActiveJob active;
+            active.id = id;
+            active.job = job;
+            active.numDigits = numBytes * 2;
+            client.active.push_back(active);
+            numActiveJobs++;
+        }
+        catch (std::exception &e)
+        {
+            respond(client.outgoing, {id, "error", e.what()});
+        }
+    }
+
+    /**
+     * Sends the results of finished jobs, and where the rest have got to
+     * if they've been at it for a while.
+     */
+    void Server::reportJobs()
+    {
+        auto now = std::chrono::steady_clock::now();
+        bool reportProgress = now - lastProgressReport >= ProgressInterval;
+        if (reportProgress)
+            lastProgressReport = now;
+
+        for (auto &client : clients)
+        {
+            auto &active = client.second.active;
+            for (auto it = active.begin(); it != active.end(); )
+            {
+                if (it->job->isDone())
+                {
+                    try
+                    {
+                        respond(client.second.outgoing, {
+                            it->id,
+                            "ok",
+                            formatChecksum(it->job->get(), it->numDigits)});
+                    }
+                    catch (std::exception &e)
+                    {
+                        respond(
+                            client.second.outgoing,
+                            {it->id, "error", e.what()});
+                    }
+                    it = active.erase(it);
+                    numActiveJobs--;
+                    continue;
+                }
+
+                auto &progress
+                    = it->job->getWriteProgress().getPhase()
+                        != Progress::Phase::Idle
+                    ? it->job->getWriteProgress()
+                    : it->job->getChecksumProgress();
+                if (reportProgress
+                    && progress.getPhase() != Progress::Phase::Idle)
+                {
+                    auto phase = getPhaseName(progress.getPhase());
+                    auto percentage = formatPercentage(progress);
+                    if (phase + " " + percentage != it->lastProgress)
+                    {
+                        respond(
+                            client.second.outgoing,
+                            {it->id, "progress", phase, percentage});
+                        it->lastProgress = phase + " " + percentage;
+                    }
+                }
+                ++it;
+            }
+        }
+
+        for (auto it = abandonedJobs.begin(); it != abandonedJobs.end(); )
+        {
+            if ((*it)->isDone())
+            {
+                it = abandonedJobs.erase(it);
+                numActiveJobs--;
+            }
+            else
+                ++it;
+        }
+    }
+#else
+    ServerClient::ServerClient(const std::string &)
+    {
+        throw std::runtime_error("Unix sockets aren't supported here");
+    }
+
+    ServerClient::~ServerClient()
+    {
+    }
+
+    void ServerClient::send(const std::vector<std::string> &)
+    {
+    }
+
+    std::vector<std::string> ServerClient::receive()
+    {
+        return {};
+    }
+
+    void ServerClient::finishSending()
+    {
+    }
+
+    Server::Server(const std::string &, size_t)
+    {
+        throw std::runtime_error("Unix sockets aren't supported here");
+    }
+
+    Server::~Server()
+    {
+    }
+
+    void Server::run()
+    {
+    }
+
+    void Server::stop()
+    {
+    }
+#endif
@@ -0,0 +1,133 @@
+#ifndef SERVER_H
+#define SERVER_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "job.h"
+
+/**
+ * Every message in either direction is a 4-byte little endian length
+ * followed by that many bytes of newline separated fields. Requests start
+ * with an id of the client's choosing, which the responses carry back:
+ *
+ *   ID calc ALG INFILE
+ *   ID patch ALG INFILE OUTFILE CHECKSUM POSITION insert|overwrite [verify]
+ *
+ * POSITION works like --position of the command line; it's left empty for
+ * the end of the input. Each request gets any number of the first of these
+ * responses, then one of the others:
+ *
+ *   ID progress PHASE PERCENTAGE
+ *   ID ok CHECKSUM
+ *   ID error MESSAGE
+ *
+ * Once the client shuts down its sending side, the server hangs up after
+ * the last response.
+ */
+std::string encodeMessage(const std::vector<std::string> &fields);
+
+/**
+ * Takes the first complete message off the front of buffer. Returns false
+ * if there is none yet.
+ */
+bool decodeMessage(std::string &buffer, std::vector<std::string> &fields);
+
+/**
+ * Blocking connection to a server, mainly for scripts and tests.
+ */
+class ServerClient final
+{
+    public:
+        ServerClient(const std::string &socketPath);
+        ~ServerClient();
+
+        void send(const std::vector<std::string> &fields);
+        std::vector<std::string> receive();
+
+        /**
+         * Tells the server no more requests are coming. Responses to the
+         * ones sent so far still arrive, then the server hangs up.
+         */
+        void finishSending();
+
+    private:
+        int socket;
+        std::string buffer;
+};
+
+/**
+ * Long-lived service that keeps the engines built between requests, so
+ * that callers making many small requests pay for neither process startup
+ * nor table building. Requests run as jobs on the shared thread pool; when
+ * there are more of them than free slots, clients take turns, so one that
+ * queues thousands doesn't hold up the rest.
+ */
+class Server final
+{
+    public:
+        /**
+         * With maxActiveJobs of 0, there's a slot per core.
+         */
+        Server(const std::string &socketPath, size_t maxActiveJobs = 0);
+        ~Server();
+
+        /**
+         * Serves until stop() is called.
+         */
+        void run();
+
+        /**
+         * Safe to call from other threads and from signal handlers.
+         */
+        void stop();
+
+    private:
+        struct ActiveJob
+        {
+            std::string id;
+            std::shared_ptr<Job> job;
+            size_t numDigits;
+            std::string lastProgress;
+        };
+
+        //shared with the jobs' callbacks, which may outlive the server
+        struct WakeUpPipe;
+
+        struct Client
+        {
+            std::string incoming;
+            std::string outgoing;
+            std::deque<std::vector<std::string>> pending;
+            std::vector<ActiveJob> active;
+            //shut down its sending side, but may still wait for responses
+            bool doneSending = false;
+        };
+
+        void acceptClient();
+        bool isAcceptingRequests(const Client &client) const;
+        bool readFromClient(int socket, Client &client);
+        bool writeToClient(int socket, Client &client);
+        void dropClient(int socket);
+        void startJobs();
+        void startJob(Client &client, const std::vector<std::string> &fields);
+        void reportJobs();
+
+        std::string socketPath;
+        size_t maxActiveJobs;
+        size_t numActiveJobs;
+        int listener;
+        std::shared_ptr<WakeUpPipe> wakeUpPipe;
+        std::map<int, Client> clients;
+        int lastServedSocket;
+        //jobs of clients that went away, cancelled but still winding down
+        std::vector<std::shared_ptr<Job>> abandonedJobs;
+        std::chrono::steady_clock::time_point lastProgressReport;
+        std::atomic<bool> stopping;
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <condition_variable>
+#include <iomanip>
+#include <istream>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include "job.h"
+#include "sfv.h"
+
+namespace
+{
+    const size_t ChecksumDigits = 8;
+
+    /**
+     * Unreadable files count as the biggest, so that they fail first.
+     */
+    std::vector<File::OffsetType> getSizes(
+        const std::vector<std::string> &paths)
+    {
+        std::vector<File::OffsetType> sizes;
+        for (auto &path : paths)
+        {
+            try
+            {
+                sizes.push_back(File::fromFileName(
+                    path, File::Mode::Read | File::Mode::Binary)->getSize());
+            }
+            catch (std::runtime_error &)
+            {
+                sizes.push_back(std::numeric_limits<File::OffsetType>::max());
+            }
+        }
+        return sizes;
+    }
+
+    std::vector<size_t> orderBySize(const std::vector<File::OffsetType> &sizes)
+    {
+        std::vector<size_t> order;
+        for (size_t i = 0; i < sizes.size(); i++)
+            order.push_back(i);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+            { return sizes[a] > sizes[b]; });
+        return order;
+    }
+
+    /**
+     * Completion count shared with the jobs, which may outlive the caller
+     * if it bails out with an exception.
+     */
+    struct Completions
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        size_t count = 0;
+    };
+
+    struct RunningJob
+    {
+        size_t index;
+        std::shared_ptr<Job> job;
+        bool usesState;
+    };
+}
+
+std::vector<SfvEntry> readSfv(std::istream &stream)
+{
+    std::vector<SfvEntry> entries;
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(stream, line); lineNumber++)
+    {
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        line.erase(0, line.find_first_not_of(" \t"));
+        if (line.empty() || line[0] == ';')
+            continue;
+
+        auto separator = line.find_last_of(" \t");
+        auto checksum = separator == std::string::npos
+            ? ""
+            : line.substr(separator + 1);
+        if (checksum.empty()
+            || checksum.size() > ChecksumDigits
+            || checksum.find_first_not_of("0123456789abcdefABCDEF")
+                != std::string::npos)
+        {
+            throw std::runtime_error(
+                "Invalid SFV line " + std::to_string(lineNumber));
+        }
+
+        SfvEntry entry;
+        entry.path = line.substr(0, separator);
+        entry.path.erase(entry.path.find_last_not_of(" \t") + 1);
+        entry.checksum = std::stoul(checksum, nullptr, 16);
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+void writeSfv(std::ostream &stream, const std::vector<SfvEntry> &entries)
+{
+    std::ios oldState(nullptr);
+    oldState.copyfmt(stream);
+    for (auto &entry : entries)
+    {
+        stream << entry.path << " "
+            << std::hex
+            << std::uppercase
+            << std::setw(ChecksumDigits)
+            << std::setfill('0')
+            << entry.checksum
+            << "\n";
+        stream.copyfmt(oldState);
+    }
+}
+
+void computeFileChecksums(
+    std::shared_ptr<const CRC> crc,
+    const std::vector<std::string> &paths,
+    size_t maxJobs,
+    std::map<std::string, ChecksumState> *states,
+    const std::function<bool(size_t index, const FileChecksum &result)>
+        &handleResult)
+{
+    auto sizes = getSizes(paths);
+    auto order = orderBySize(sizes);
+
+    //an unchanged tail doesn't prove the rest is unchanged, so only states
+    //of files that grew since are trusted
+    if (states)
+    {
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            auto state = states->find(paths[i]);
+            if (state != states->end() && state->second.size >= sizes[i])
+                states->erase(state);
+        }
+    }
+
+    auto completions = std::make_shared<Completions>();
+    auto done = [completions]()
+    {
+        std::lock_guard<std::mutex> lock(completions->mutex);
+        completions->count++;
+        completions->changed.notify_one();
+    };
+
+    std::vector<RunningJob> running;
+    size_t next = 0;
+    size_t numCollected = 0;
+    bool stopping = false;
+    try
+    {
+        while (!running.empty() || (!stopping && next < order.size()))
+        {
+            for (; !stopping && next < order.size()
+                && running.size() < std::max<size_t>(maxJobs, 1); next++)
+            {
+                //a path listed twice mustn't have its state updated twice
+                //at once
+                RunningJob job;
+                job.index = order[next];
+                auto &path = paths[job.index];
+                job.usesState = states && std::none_of(
+                    running.begin(), running.end(), [&](const RunningJob &other)
+                    { return other.usesState && paths[other.index] == path; });
+                job.job = job.usesState
+                    ? Job::resumeChecksum(crc, path, (*states)[path], done)
+                    : Job::computeChecksum(crc, path, done);
+                running.push_back(job);
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(completions->mutex);
+                completions->changed.wait(lock, [&]()
+                    { return completions->count > numCollected; });
+            }
+
+            for (auto it = running.begin(); it != running.end(); )
+            {
+                if (!it->job->isDone())
+                {
+                    ++it;
+                    continue;
+                }
+
+                FileChecksum result;
+                result.checksum = 0;
+                try
+                {
+                    result.checksum = it->job->get();
+                }
+                catch (std::exception &e)
+                {
+                    result.error = e.what();
+                    if (it->usesState)
+                        states->erase(paths[it->index]);
+                }
+                if (!stopping && !handleResult(it->index, result))
+                {
+                    stopping = true;
+                    for (auto &job : running)
+                        job.job->cancel();
+                }
+                it = running.erase(it);
+                numCollected++;
+            }
+        }
+    }
+    catch (...)
+    {
+        //running jobs update the caller's states
+        for (auto &job : running)
+            job.job->cancel();
+        for (auto &job : running)
+            while (!job.job->waitFor(std::chrono::milliseconds(100)))
+                continue;
+        throw;
+    }
+}
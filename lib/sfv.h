@@ -0,0 +1,57 @@
+#ifndef SFV_H
+#define SFV_H
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "checksum_state.h"
+#include "crc.h"
+
+/**
+ * One line of a simple file verification (.sfv) list: a file name and its
+ * CRC32, relative to the list's directory unless it's absolute.
+ */
+struct SfvEntry
+{
+    std::string path;
+    CRC::Value checksum;
+};
+
+/**
+ * Skips blank lines and comments, which start with a semicolon. Names may
+ * contain spaces; the checksum is whatever follows the last one.
+ */
+std::vector<SfvEntry> readSfv(std::istream &stream);
+void writeSfv(std::ostream &stream, const std::vector<SfvEntry> &entries);
+
+/**
+ * Outcome of checksumming one of many files; error is empty on success.
+ */
+struct FileChecksum
+{
+    CRC::Value checksum;
+    std::string error;
+};
+
+/**
+ * Checksums files on the shared thread pool, at most maxJobs at a time.
+ * Biggest files go first, so that none of them is left running alone at
+ * the end. Each result is passed to handleResult on the calling thread as
+ * soon as it's in, along with the index of its path; returning false from
+ * it cancels the rest.
+ * With states given, files that grew since their states were saved are
+ * only read past what the states cover; others are read whole. The states
+ * are brought up to date; states of files that couldn't be read are
+ * dropped.
+ */
+void computeFileChecksums(
+    std::shared_ptr<const CRC> crc,
+    const std::vector<std::string> &paths,
+    size_t maxJobs,
+    std::map<std::string, ChecksumState> *states,
+    const std::function<bool(size_t index, const FileChecksum &result)>
+        &handleResult);
+
+#endif
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include "file.h"
+#include "profile.h"
+#include "small_files.h"
+#if HAVE_IO_URING
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace
+{
+    void readSmallFile(
+        const std::string &path, size_t maxSize, SmallFile &file)
+    {
+        file.content.clear();
+        try
+        {
+            auto input = File::fromFileName(
+                path, File::Mode::Read | File::Mode::Binary);
+            auto size = input->getSize();
+            if (size < 0 || size > static_cast<File::OffsetType>(maxSize))
+            {
+                file.status = SmallFile::Status::TooBig;
+                return;
+            }
+            file.content.resize(size);
+            input->read(file.content.data(), file.content.size());
+            file.status = SmallFile::Status::Read;
+        }
+        catch (std::runtime_error &)
+        {
+            file.content.clear();
+            file.status = SmallFile::Status::Failed;
+        }
+    }
+
+    #if HAVE_IO_URING
+        /**
+         * Minimal io_uring over raw system calls. Each file takes a chain
+         * of three requests: open into a registered slot, read and close,
+         * so a whole batch of files costs a single system call.
+         */
+        class Ring final
+        {
+            public:
+                Ring(unsigned numSlots);
+                ~Ring();
+
+                bool isReady() const;
+                bool readFiles(
+                    const std::vector<std::string> &paths,
+                    size_t start,
+                    size_t end,
+                    size_t maxSize,
+                    std::vector<SmallFile> &files);
+
+                unsigned getNumSlots() const;
+
+            private:
+                bool supportsDirectDescriptors() const;
+                io_uring_sqe *getSqe();
+                bool submit(unsigned numSubmitted);
+                void abandon(
+                    size_t start, size_t end, std::vector<SmallFile> &files);
+
+                int fd;
+                unsigned numSlots;
+                io_uring_params params;
+                void *sqRing;
+                void *cqRing;
+                size_t sqRingSize;
+                size_t cqRingSize;
+                io_uring_sqe *sqes;
+                unsigned pendingTail;
+                unsigned *sqTail;
+                unsigned *sqMask;
+                unsigned *sqArray;
+                unsigned *cqHead;
+                unsigned *cqTail;
+                unsigned *cqMask;
+                io_uring_cqe *cqes;
+        };
+
+        Ring::Ring(unsigned numSlots)
+            : numSlots(numSlots), sqRing(MAP_FAILED), cqRing(MAP_FAILED),
+                sqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+        {
+            memset(&params, 0, sizeof(params));
+            fd = syscall(__NR_io_uring_setup, numSlots * 3, &params);
+            if (fd < 0)
+                return;
+
+            sqRingSize = params.sq_off.array
+                + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes
+                + params.cq_entries * sizeof(io_uring_cqe);
+            bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (singleMap)
+                sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+            sqRing = mmap(
+                nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            cqRing = singleMap ? sqRing : mmap(
+                nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            sqes = static_cast<io_uring_sqe*>(mmap(
+                nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_SQES));
+
+            std::vector<int> slots(numSlots, -1);
+            if (sqRing == MAP_FAILED
+                || cqRing == MAP_FAILED
+                || sqes == MAP_FAILED
+                || !supportsDirectDescriptors()
+                || syscall(
+                    __NR_io_uring_register,
+                    fd,
+                    IORING_REGISTER_FILES,
+                    slots.data(),
+                    numSlots) < 0)
+            {
+                close(fd);
+                fd = -1;
+                return;
+            }
+
+            auto sq = static_cast<char*>(sqRing);
+            auto cq = static_cast<char*>(cqRing);
+            sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            pendingTail = *sqTail;
+            sqMask = reinterpret_cast<unsigned*>(
+                sq + params.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask = reinterpret_cast<unsigned*>(
+                cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        Ring::~Ring()
+        {
+            if (sqes != MAP_FAILED)
+                munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+            if (cqRing != MAP_FAILED && cqRing != sqRing)
+                munmap(cqRing, cqRingSize);
+            if (sqRing != MAP_FAILED)
+                munmap(sqRing, sqRingSize);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        bool Ring::isReady() const
+        {
+            return fd >= 0;
+        }
+
+        unsigned Ring::getNumSlots() const
+        {
+            return numSlots;
+        }
+
+        /**
+         * Kernels before 5.15 know the opcodes, but ignore file_index, so
+         * opens would leak descriptors and closes would hit descriptor 0.
+         * Direct descriptors came along with linkat, which is what gives
+         * them away.
+         */
+        bool Ring::supportsDirectDescriptors() const
+        {
+            const unsigned MaxOps = 256;
+            std::vector<uint8_t> buffer(
+                sizeof(io_uring_probe) + MaxOps * sizeof(io_uring_probe_op));
+            auto probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+            if (syscall(
+                __NR_io_uring_register,
+                fd,
+                IORING_REGISTER_PROBE,
+                probe,
+                MaxOps) < 0)
+            {
+                return false;
+            }
+
+            auto isSupported = [&](unsigned op)
+            {
+                return op <= probe->last_op
+                    && op < probe->ops_len
+                    && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+            };
+            return isSupported(IORING_OP_OPENAT)
+                && isSupported(IORING_OP_READ)
+                && isSupported(IORING_OP_CLOSE)
+                && isSupported(IORING_OP_LINKAT);
+        }
+
+        /**
+         * Returns the next free request; it's handed to the kernel once
+         * submitAndWait() publishes it.
+         */
+        io_uring_sqe *Ring::getSqe()
+        {
+            unsigned index = pendingTail++ & *sqMask;
+            io_uring_sqe *sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            return sqe;
+        }
+
+        /**
+         * Returns false if the kernel refused; some of the requests may
+         * have been submitted by then.
+         */
+        bool Ring::submit(unsigned numSubmitted)
+        {
+            __atomic_store_n(sqTail, pendingTail, __ATOMIC_RELEASE);
+            unsigned toSubmit = numSubmitted;
+            while (toSubmit)
+            {
+                auto ret = syscall(
+                    __NR_io_uring_enter,
+                    fd,
+                    toSubmit,
+                    numSubmitted,
+                    IORING_ENTER_GETEVENTS,
+                    nullptr,
+                    0);
+                if (ret < 0 && errno != EINTR && errno != EAGAIN)
+                    return false;
+                if (ret > 0)
+                    toSubmit -= ret;
+            }
+            return true;
+        }
+
+        /**
+         * Requests still in flight may write into the buffers of given
+         * files at any time, so the buffers are never freed, and the ring
+         * isn't used again.
+         */
+        void Ring::abandon(
+            size_t start, size_t end, std::vector<SmallFile> &files)
+        {
+            for (size_t i = start; i < end; i++)
+            {
+                new std::vector<uint8_t>(std::move(files[i].content));
+                files[i].content.clear();
+                files[i].status = SmallFile::Status::Failed;
+            }
+            close(fd);
+            fd = -1;
+        }
+
+        /**
+         * Files whose chain failed are marked as such; it's up to the
+         * caller to retry them the portable way, since that's also what
+         * happens when the kernel doesn't know some of the requests.
+         * Returns false if the ring broke down, in which case all of given
+         * files are marked failed.
+         */
+        bool Ring::readFiles(
+            const std::vector<std::string> &paths,
+            size_t start,
+            size_t end,
+            size_t maxSize,
+            std::vector<SmallFile> &files)
+        {
+            const unsigned OpsPerFile = 3;
+            for (size_t i = start; i < end; i++)
+            {
+                unsigned slot = i - start;
+                files[i].content.resize(maxSize + 1);
+                files[i].status = SmallFile::Status::Failed;
+
+                auto openOp = getSqe();
+                openOp->opcode = IORING_OP_OPENAT;
+                openOp->fd = AT_FDCWD;
+                openOp->addr = reinterpret_cast<uint64_t>(paths[i].c_str());
+                //direct descriptors never reach the fd table, so no O_CLOEXEC
+                openOp->open_flags = O_RDONLY;
+                openOp->file_index = slot + 1;
+                openOp->flags = IOSQE_IO_LINK;
+                openOp->user_data = i * OpsPerFile;
+
+                //hard link, so that short reads don't cancel the close
+                auto readOp = getSqe();
+                readOp->opcode = IORING_OP_READ;
+                readOp->fd = slot;
+                readOp->addr = reinterpret_cast<uint64_t>(
+                    files[i].content.data());
+                readOp->len = maxSize + 1;
+                readOp->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+                readOp->user_data = i * OpsPerFile + 1;
+
+                auto closeOp = getSqe();
+                closeOp->opcode = IORING_OP_CLOSE;
+                closeOp->file_index = slot + 1;
+                closeOp->user_data = i * OpsPerFile + 2;
+            }
+
+            unsigned numOps = (end - start) * OpsPerFile;
+            unsigned numDone = 0;
+            if (!submit(numOps))
+            {
+                abandon(start, end, files);
+                return false;
+            }
+            while (numDone < numOps)
+            {
+                unsigned head = *cqHead;
+                unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+                if (head == tail)
+                {
+                    if (syscall(
+                        __NR_io_uring_enter, fd, 0, 1,
+                        IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+                        && errno != EINTR
+                        && errno != EAGAIN
+                        && errno != EBUSY)
+                    {
+                        abandon(start, end, files);
+                        return false;
+                    }
+                    continue;
+                }
+
+                for (; head != tail; head++, numDone++)
+                {
+                    const auto &cqe = cqes[head & *cqMask];
+                    if (cqe.user_data % OpsPerFile != 1)
+                        continue;
+                    auto &file = files[cqe.user_data / OpsPerFile];
+                    if (cqe.res < 0)
+                        continue;
+                    if (static_cast<size_t>(cqe.res) > maxSize)
+                    {
+                        file.content.clear();
+                        file.status = SmallFile::Status::TooBig;
+                        continue;
+                    }
+                    file.content.resize(cqe.res);
+                    file.status = SmallFile::Status::Read;
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            }
+            return true;
+        }
+    #endif
+}
+
+/**
+ * On Linux, files are read in batches through io_uring; elsewhere, or if
+ * the kernel refuses some of it, they're read one by one.
+ */
+std::vector<SmallFile> readSmallFiles(
+    const std::vector<std::string> &paths, size_t maxSize)
+{
+    std::vector<SmallFile> files(paths.size());
+    for (auto &file : files)
+        file.status = SmallFile::Status::Failed;
+
+    #if HAVE_IO_URING
+        //queue depth that suits the filesystem of the first file
+        struct stat info;
+        uint64_t device = !paths.empty() && stat(paths[0].c_str(), &info) == 0
+            ? info.st_dev
+            : 0;
+        Ring ring(getActiveTuning(device).queueDepth);
+        for (size_t start = 0; ring.isReady() && start < paths.size();
+            start += ring.getNumSlots())
+        {
+            auto end = std::min(start + ring.getNumSlots(), paths.size());
+            if (!ring.readFiles(paths, start, end, maxSize, files))
+                break;
+        }
+    #endif
+
+    for (size_t i = 0; i < paths.size(); i++)
+        if (files[i].status == SmallFile::Status::Failed)
+            readSmallFile(paths[i], maxSize, files[i]);
+    return files;
+}
@@ -0,0 +1,30 @@
+#ifndef SMALL_FILES_H
+#define SMALL_FILES_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Whole content of a file read by readSmallFiles().
+ */
+struct SmallFile
+{
+    enum class Status : uint8_t
+    {
+        Read,
+        TooBig,
+        Failed
+    };
+
+    Status status;
+    std::vector<uint8_t> content;
+};
+
+/**
+ * Reads files of up to maxSize bytes whole. Bigger files are reported as
+ * TooBig and left for the caller to stream.
+ */
+std::vector<SmallFile> readSmallFiles(
+    const std::vector<std::string> &paths, size_t maxSize);
+
+#endif
@@ -0,0 +1,73 @@
+#include "stats.h"
+
+namespace
+{
+    void addPhaseStats(
+        Progress::PhaseStats &target, const Progress::PhaseStats &source)
+    {
+        target.seconds += source.seconds;
+        target.bytes += source.bytes;
+        target.numRuns += source.numRuns;
+    }
+}
+
+StatsCollector::StatsCollector()
+    : startTime(std::chrono::steady_clock::now()),
+        startFileStats(File::getStats())
+{
+}
+
+Stats StatsCollector::collect(
+    const std::vector<const Progress*> &progresses) const
+{
+    Stats stats = Stats();
+    stats.backend = getBackendName();
+    stats.seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - startTime).count();
+
+    for (auto progress : progresses)
+    {
+        addPhaseStats(
+            stats.prefix, progress->getPhaseStats(Progress::Phase::Prefix));
+        addPhaseStats(
+            stats.suffix, progress->getPhaseStats(Progress::Phase::Suffix));
+        addPhaseStats(
+            stats.copy, progress->getPhaseStats(Progress::Phase::Copy));
+    }
+
+    auto fileStats = File::getStats();
+    stats.file.numOpens = fileStats.numOpens - startFileStats.numOpens;
+    stats.file.numReads = fileStats.numReads - startFileStats.numReads;
+    stats.file.bytesRead = fileStats.bytesRead - startFileStats.bytesRead;
+    stats.file.numWrites = fileStats.numWrites - startFileStats.numWrites;
+    stats.file.bytesWritten
+        = fileStats.bytesWritten - startFileStats.bytesWritten;
+    stats.file.numSeeks = fileStats.numSeeks - startFileStats.numSeeks;
+    stats.file.numHoleQueries
+        = fileStats.numHoleQueries - startFileStats.numHoleQueries;
+    stats.file.numSyncs = fileStats.numSyncs - startFileStats.numSyncs;
+    stats.file.numDropRequests
+        = fileStats.numDropRequests - startFileStats.numDropRequests;
+    stats.file.bytesDropped
+        = fileStats.bytesDropped - startFileStats.bytesDropped;
+    return stats;
+}
+
+std::string getBackendName()
+{
+    std::string name = "table";
+    #if defined(__SSE2__)
+        name += "+sse2";
+    #endif
+    name += ", stdio";
+    #if HAVE_SEEK_DATA
+        name += "+holes";
+    #endif
+    #if HAVE_POSIX_FADVISE
+        name += "+fadvise";
+    #endif
+    #if HAVE_IO_URING
+        name += "+io_uring";
+    #endif
+    return name;
+}
@@ -0,0 +1,44 @@
+#ifndef STATS_H
+#define STATS_H
+#include <chrono>
+#include <string>
+#include <vector>
+#include "file.h"
+#include "progress.h"
+
+/**
+ * Where the time of a checksum or patch run went.
+ */
+struct Stats
+{
+    std::string backend;
+    double seconds;
+    Progress::PhaseStats prefix;
+    Progress::PhaseStats suffix;
+    Progress::PhaseStats copy;
+    File::Stats file;
+};
+
+/**
+ * Measures from its construction until collect(). File counters are
+ * process wide, so runs measured at the same time count each other's file
+ * work too.
+ */
+class StatsCollector final
+{
+    public:
+        StatsCollector();
+
+        Stats collect(const std::vector<const Progress*> &progresses) const;
+
+    private:
+        std::chrono::steady_clock::time_point startTime;
+        File::Stats startFileStats;
+};
+
+/**
+ * Checksum kernel and I/O features this build uses.
+ */
+std::string getBackendName();
+
+#endif
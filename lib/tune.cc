@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+#include "crc_factories.h"
+#include "small_files.h"
+#include "tune.h"
+#if HAVE_POSIX_FADVISE
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace
+{
+    const File::OffsetType CorpusSize = 32 << 20;
+    const size_t NumSmallFiles = 512;
+    const size_t SmallFileSize = 512;
+    const int NumRounds = 3;
+
+    typedef std::chrono::steady_clock Clock;
+
+    void writeCorpus(const std::string &path, File::OffsetType size)
+    {
+        std::vector<uint8_t> chunk(1 << 16);
+        uint64_t seed = 0x9E3779B97F4A7C15ull;
+        auto file = File::fromFileName(
+            path, File::Mode::Write | File::Mode::Binary);
+        for (File::OffsetType pos = 0; pos < size; pos += chunk.size())
+        {
+            for (auto &byte : chunk)
+            {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                byte = seed;
+            }
+            auto chunkSize = std::min<File::OffsetType>(
+                chunk.size(), size - pos);
+            file->write(chunk.data(), chunkSize);
+        }
+    }
+
+    /**
+     * Dirty pages can't be dropped, so the file is synced first.
+     */
+    void dropFromCache(const std::string &path)
+    {
+        #if HAVE_POSIX_FADVISE
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1)
+                return;
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        #else
+            (void)path;
+        #endif
+    }
+
+    /**
+     * Best of a few rounds, so that a hiccup doesn't pick the winner. The
+     * files read are dropped from the page cache before each round, or
+     * we'd be timing memory rather than the filesystem.
+     */
+    double measure(
+        const std::vector<std::string> &paths,
+        const std::function<void()> &work)
+    {
+        double best = 0;
+        for (int round = 0; round < NumRounds; round++)
+        {
+            for (auto &path : paths)
+                dropFromCache(path);
+            auto start = Clock::now();
+            work();
+            double seconds = std::chrono::duration<double>(
+                Clock::now() - start).count();
+            if (round == 0 || seconds < best)
+                best = seconds;
+        }
+        return best;
+    }
+
+    /**
+     * Removes given files once out of scope, whichever way tuning ends.
+     */
+    class TempFiles final
+    {
+        public:
+            ~TempFiles()
+            {
+                for (auto &path : paths)
+                    std::remove(path.c_str());
+            }
+
+            std::string add(const std::string &path)
+            {
+                paths.push_back(path);
+                return path;
+            }
+
+        private:
+            std::vector<std::string> paths;
+    };
+
+    void useTuning(uint64_t device, const Tuning &tuning)
+    {
+        Profile profile = getBuiltinProfile();
+        profile.filesystems[device] = tuning;
+        setActiveProfile(profile);
+    }
+}
+
+/**
+ * Checksums read forwards; patches read backwards from the end of file to
+ * the patch, then copy the input forwards, so both are timed.
+ */
+Tuning tuneFilesystem(const std::string &dir, uint64_t &device)
+{
+    TempFiles tempFiles;
+    auto corpusPath = tempFiles.add(dir + "/crcmanip-tune.bin");
+    auto outputPath = tempFiles.add(dir + "/crcmanip-tune-out.bin");
+    writeCorpus(corpusPath, CorpusSize);
+    device = File::fromFileName(
+        corpusPath, File::Mode::Read | File::Mode::Binary)->getDevice();
+
+    std::shared_ptr<CRC> crc(createCRC32());
+    Progress progress;
+    Tuning best = getBuiltinProfile().defaults;
+    double bestTime = -1;
+    for (size_t bufferSize : {0, 64 << 10, 1 << 20})
+    {
+        for (size_t chunkSize : {8 << 10, 64 << 10, 256 << 10, 1 << 20})
+        {
+            Tuning tuning = best;
+            tuning.chunkSize = chunkSize;
+            tuning.bufferSize = bufferSize;
+            useTuning(device, tuning);
+            auto time = measure({corpusPath}, [&]()
+                {
+                    auto input = File::fromFileName(
+                        corpusPath, File::Mode::Read | File::Mode::Binary);
+                    crc->computeChecksum(*input, progress);
+                });
+            time += measure({corpusPath}, [&]()
+                {
+                    auto input = File::fromFileName(
+                        corpusPath, File::Mode::Read | File::Mode::Binary);
+                    auto output = File::fromFileName(
+                        outputPath, File::Mode::Write | File::Mode::Binary);
+                    crc->applyPatch(
+                        0, 0, *input, *output, true, progress, progress);
+                });
+            if (bestTime < 0 || time < bestTime)
+            {
+                best = tuning;
+                bestTime = time;
+            }
+        }
+    }
+    //the corpus takes up the most space, so it doesn't wait for the rest
+    std::remove(outputPath.c_str());
+    std::remove(corpusPath.c_str());
+
+    #if HAVE_IO_URING
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < NumSmallFiles; i++)
+        {
+            paths.push_back(tempFiles.add(
+                dir + "/crcmanip-tune-" + std::to_string(i) + ".bin"));
+            writeCorpus(paths.back(), SmallFileSize);
+        }
+
+        bestTime = -1;
+        for (unsigned queueDepth : {8, 32, 64, 128, 256})
+        {
+            Tuning tuning = best;
+            tuning.queueDepth = queueDepth;
+            useTuning(device, tuning);
+            auto time = measure(paths, [&]()
+                { readSmallFiles(paths, SmallFileSize); });
+            if (bestTime < 0 || time < bestTime)
+            {
+                best = tuning;
+                bestTime = time;
+            }
+        }
+    #endif
+
+    useTuning(device, best);
+    return best;
+}
@@ -0,0 +1,15 @@
+#ifndef TUNE_H
+#define TUNE_H
+#include <string>
+#include "profile.h"
+
+/**
+ * Times checksums, patches and small file reads in given directory with
+ * several chunk sizes, buffer sizes and queue depths, and returns the fastest
+ * combination along with the device number of the filesystem. It goes
+ * through the active profile, so it shouldn't overlap with other work,
+ * and leaves the winner active.
+ */
+Tuning tuneFilesystem(const std::string &dir, uint64_t &device);
+
+#endif
@@ -1,12 +1,15 @@
+#include <algorithm>
+#include <stdexcept>
 #include "util.h"
 
 namespace
 {
     void validatePosition(
-        File::OffsetType position, size_t crcSize, File::OffsetType totalSize)
+        File::OffsetType position,
+        File::OffsetType crcSize,
+        File::OffsetType totalSize)
     {
-        if (position < 0 ||
-            position + static_cast<File::OffsetType>(crcSize) > totalSize)
+        if (position < 0 || position + crcSize > totalSize)
         {
             throw std::invalid_argument(
                 "Patch position is located outside available input");
@@ -47,9 +50,99 @@ File::OffsetType shiftUserPosition(
     if (!overwrite)
         totalSize += crcSize;
 
-    while (targetPosition < 0)
-        targetPosition += fileSize;
+    //wraps around as many times as it takes
+    if (targetPosition < 0)
+    {
+        if (fileSize <= 0)
+            throw std::invalid_argument("Input is empty");
+        targetPosition = (targetPosition % fileSize + fileSize) % fileSize;
+    }
 
     validatePosition(targetPosition, crcSize, totalSize);
     return targetPosition;
 }
+
+void validateRegions(
+    const std::vector<CRC::Region> &regions, File::OffsetType fileSize)
+{
+    if (regions.empty())
+        throw std::invalid_argument("No patch regions given");
+
+    auto sorted = regions;
+    std::sort(sorted.begin(), sorted.end(),
+        [](const CRC::Region &a, const CRC::Region &b)
+        { return a.offset < b.offset; });
+
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        if (sorted[i].size <= 0 || !sorted[i].mask)
+            throw std::invalid_argument("Patch region is empty");
+        validatePosition(sorted[i].offset, sorted[i].size, fileSize);
+        if (i > 0 && sorted[i - 1].offset + sorted[i - 1].size
+            > sorted[i].offset)
+        {
+            throw std::invalid_argument("Patch regions overlap");
+        }
+    }
+}
+
+int64_t parseInteger(
+    const std::string &name,
+    const std::string &str,
+    int base,
+    int64_t min,
+    int64_t max)
+{
+    auto digits = base == 16 ? "0123456789abcdefABCDEF" : "0123456789";
+    size_t start = base == 10 && !str.empty() && str[0] == '-' ? 1 : 0;
+    if (str.size() <= start
+        || str.find_first_not_of(digits, start) != std::string::npos)
+    {
+        throw std::invalid_argument("Invalid " + name + ": " + str);
+    }
+
+    long long value;
+    try
+    {
+        value = std::stoll(str, nullptr, base);
+    }
+    catch (std::out_of_range &)
+    {
+        throw std::invalid_argument(name + " is out of range: " + str);
+    }
+    if (value < min || value > max)
+        throw std::invalid_argument(name + " is out of range: " + str);
+    return value;
+}
+
+CRC::ByteSet parseByteSet(const std::string &spec)
+{
+    std::string chars = spec;
+    if (spec == "printable")
+        chars = " -~";
+    else if (spec == "alnum")
+        chars = "a-zA-Z0-9";
+    else if (spec == "hex")
+        chars = "0-9a-fA-F";
+    else if (spec == "base64")
+        chars = "A-Za-z0-9+/";
+
+    CRC::ByteSet set;
+    for (size_t i = 0; i < chars.size(); i++)
+    {
+        uint8_t first = chars[i], last = chars[i];
+        if (i + 2 < chars.size() && chars[i + 1] == '-')
+        {
+            last = chars[i + 2];
+            i += 2;
+        }
+        if (first > last)
+            throw std::invalid_argument("Invalid character range");
+        for (size_t c = first; c <= last; c++)
+            set.set(c);
+    }
+
+    if (set.count() < 2)
+        throw std::invalid_argument("Character set needs at least two bytes");
+    return set;
+}
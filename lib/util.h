@@ -1,5 +1,9 @@
 #ifndef UTIL_H
 #define UTIL_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "crc.h"
 #include "file.h"
 
 File::OffsetType computeAutoPosition(
@@ -11,4 +15,27 @@ File::OffsetType shiftUserPosition(
     size_t crcSize,
     bool overwrite);
 
+/**
+ * Makes sure scattered patch regions lie within the file and don't overlap.
+ */
+void validateRegions(
+    const std::vector<CRC::Region> &regions, File::OffsetType fileSize);
+
+/**
+ * Parses a decimal integer, or a hexadecimal one with base 16. Unlike
+ * std::stoll, it takes nothing but digits, and its errors name the value.
+ */
+int64_t parseInteger(
+    const std::string &name,
+    const std::string &str,
+    int base,
+    int64_t min,
+    int64_t max);
+
+/**
+ * Parses a named byte class (printable, alnum, hex, base64) or a set of
+ * characters with optional ranges, like "a-z0-9_".
+ */
+CRC::ByteSet parseByteSet(const std::string &spec);
+
 #endif
@@ -0,0 +1,26 @@
+#include "catch.hh"
+#include "lib/util.h"
+
+TEST_CASE("Parsing named byte sets works", "[byteset]")
+{
+    REQUIRE(parseByteSet("printable").count() == 95);
+    REQUIRE(parseByteSet("alnum").count() == 62);
+    REQUIRE(parseByteSet("hex").count() == 22);
+    REQUIRE(parseByteSet("base64").count() == 64);
+    REQUIRE(parseByteSet("base64")['+']);
+    REQUIRE(!parseByteSet("printable")['\n']);
+}
+
+TEST_CASE("Parsing custom byte sets works", "[byteset]")
+{
+    auto set = parseByteSet("a-c_-");
+    REQUIRE(set.count() == 5);
+    REQUIRE(set['a']);
+    REQUIRE(set['b']);
+    REQUIRE(set['c']);
+    REQUIRE(set['_']);
+    REQUIRE(set['-']);
+    REQUIRE_THROWS(parseByteSet("z-a"));
+    REQUIRE_THROWS(parseByteSet("x"));
+    REQUIRE_THROWS(parseByteSet(""));
+}
@@ -0,0 +1,140 @@
+#include <cstdio>
+#include <string>
+#include "catch.hh"
+#include "lib/checksum_state.h"
+#include "lib/crc_factories.h"
+
+namespace
+{
+    void writeFile(const std::string &path, const std::string &content)
+    {
+        auto f = File::fromFileName(
+            path, File::Mode::Write | File::Mode::Binary);
+        f->write(content.data(), content.size());
+    }
+
+    CRC::Value computeChecksum(const CRC &crc, const std::string &path)
+    {
+        Progress progress;
+        auto f = File::fromFileName(
+            path, File::Mode::Read | File::Mode::Binary);
+        return crc.computeChecksum(*f, progress);
+    }
+
+    CRC::Value updateState(
+        const CRC &crc,
+        const std::string &path,
+        ChecksumState &state,
+        bool &resumed)
+    {
+        Progress progress;
+        auto f = File::fromFileName(
+            path, File::Mode::Read | File::Mode::Binary);
+        return updateChecksumState(crc, *f, state, progress, &resumed);
+    }
+}
+
+TEST_CASE("Resuming checksum of appended file works", "[state]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            ChecksumState state = {};
+            bool resumed;
+            std::string content(70000, 'a');
+
+            writeFile("test.txt", content);
+            REQUIRE(updateState(*crc, "test.txt", state, resumed)
+                == computeChecksum(*crc, "test.txt"));
+            REQUIRE(!resumed);
+
+            content += "appended content";
+            writeFile("test.txt", content);
+            REQUIRE(updateState(*crc, "test.txt", state, resumed)
+                == computeChecksum(*crc, "test.txt"));
+            REQUIRE(resumed);
+            REQUIRE(state.size == static_cast<File::OffsetType>(
+                content.size()));
+
+            std::remove("test.txt");
+        }
+    }
+}
+
+TEST_CASE("Checksum state detects rewritten files", "[state]")
+{
+    auto crc = createCRC32();
+    ChecksumState state = {};
+    bool resumed;
+
+    writeFile("test.txt", "123456789");
+    updateState(*crc, "test.txt", state, resumed);
+
+    writeFile("test.txt", "12345678X and more");
+    REQUIRE(updateState(*crc, "test.txt", state, resumed)
+        == computeChecksum(*crc, "test.txt"));
+    REQUIRE(!resumed);
+
+    writeFile("test.txt", "123");
+    REQUIRE(updateState(*crc, "test.txt", state, resumed)
+        == computeChecksum(*crc, "test.txt"));
+    REQUIRE(!resumed);
+
+    std::remove("test.txt");
+}
+
+TEST_CASE("Checksum state survives saving and loading", "[state]")
+{
+    ChecksumState state = {};
+    state.algorithm = "CRC32";
+    state.state = 0xDECEA5ED;
+    state.size = 0x123456789ll;
+    state.tailSize = 65536;
+    state.tailFingerprint = 0xCBF29CE484222325ull;
+    saveChecksumState("test.state", state);
+
+    ChecksumState loaded = {};
+    REQUIRE(loadChecksumState("test.state", loaded));
+    REQUIRE(loaded.algorithm == state.algorithm);
+    REQUIRE(loaded.state == state.state);
+    REQUIRE(loaded.size == state.size);
+    REQUIRE(loaded.tailSize == state.tailSize);
+    REQUIRE(loaded.tailFingerprint == state.tailFingerprint);
+    std::remove("test.state");
+
+    REQUIRE(!loadChecksumState("test.state", loaded));
+}
+
+TEST_CASE("Checksum states of many files survive saving and loading",
+    "[state]")
+{
+    std::map<std::string, ChecksumState> states;
+    states["some file.txt"].algorithm = "CRC32";
+    states["some file.txt"].state = 0xDECEA5ED;
+    states["some file.txt"].size = 0x123456789ll;
+    states["dir/other.txt"].algorithm = "CRC16IBM";
+    states["dir/other.txt"].tailSize = 123;
+    states["dir/other.txt"].tailFingerprint = 0xCBF29CE484222325ull;
+    saveChecksumStates("test.state", states);
+
+    std::map<std::string, ChecksumState> loaded;
+    REQUIRE(loadChecksumStates("test.state", loaded));
+    REQUIRE(loaded.size() == 2);
+    for (auto &state : states)
+    {
+        auto &other = loaded[state.first];
+        REQUIRE(other.algorithm == state.second.algorithm);
+        REQUIRE(other.state == state.second.state);
+        REQUIRE(other.size == state.second.size);
+        REQUIRE(other.tailSize == state.second.tailSize);
+        REQUIRE(other.tailFingerprint == state.second.tailFingerprint);
+    }
+    std::remove("test.state");
+
+    REQUIRE(!loadChecksumStates("test.state", loaded));
+    saveChecksumState("test.state", states["dir/other.txt"]);
+    REQUIRE_THROWS_AS(
+        loadChecksumStates("test.state", loaded), std::runtime_error);
+    std::remove("test.state");
+}
@@ -1,5 +1,10 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
 #include "catch.hh"
 #include "lib/crc_factories.h"
+#include "lib/util.h"
 #include "test_crc_support.h"
 
 namespace
@@ -17,6 +22,62 @@ TEST_CASE("CRC computing works", "[crc]")
             testComputing(*crc, crc->getSpecs().test);
 }
 
+TEST_CASE("Generated tables match computed ones", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            std::unique_ptr<CRC::Tables> generated(new CRC::Tables);
+            std::unique_ptr<CRC::Tables> computed(new CRC::Tables);
+            crc->getTables(*generated);
+            CRC(crc->getSpecs()).getTables(*computed);
+            REQUIRE(memcmp(
+                generated.get(), computed.get(), sizeof(CRC::Tables)) == 0);
+        }
+    }
+}
+
+TEST_CASE("Builtin engines are built once and shared", "[crc]")
+{
+    for (auto &specs : getBuiltinSpecs())
+    {
+        auto crc = findBuiltinCRC(specs.name);
+        REQUIRE(crc != nullptr);
+        REQUIRE(crc->getSpecs().test == specs.test);
+        REQUIRE(findBuiltinCRC(specs.name) == crc);
+    }
+    REQUIRE(findBuiltinCRC("CRC64") == nullptr);
+}
+
+TEST_CASE("CRC with custom parameters works", "[crc]")
+{
+    //width, polynomial, init, xorout, reflected, check value
+    const CRC::Value catalogue[][6] = {
+        {8, 0x07, 0x00, 0x00, false, 0xF4},
+        {8, 0x31, 0x00, 0x00, true, 0xA1},
+        {16, 0x1021, 0xFFFF, 0x0000, false, 0x29B1},
+        {16, 0x1021, 0xB2AA, 0x0000, true, 0x63D0},
+        {24, 0x864CFB, 0xB704CE, 0x000000, false, 0x21CF02},
+        {32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF, true, 0xE3069283},
+    };
+    for (auto &params : catalogue)
+    {
+        auto crc = createCustomCRC(
+            params[0], params[1], params[2], params[3], params[4]);
+        SECTION(crc->getSpecs().name)
+        {
+            testComputing(*crc, params[5]);
+            testInserting(*crc, params[5]);
+            testOverwriting(*crc, params[5]);
+        }
+    }
+
+    REQUIRE_THROWS(createCustomCRC(12, 0x80F, 0, 0, false));
+    REQUIRE_THROWS(createCustomCRC(16, 0x11021, 0, 0, false));
+    REQUIRE_THROWS(createCustomCRC(16, 0x1020, 0, 0, false));
+}
+
 TEST_CASE("CRC patch appending works", "[crc]")
 {
     for (auto &crc : createAllCRC())
@@ -37,3 +98,467 @@ TEST_CASE("CRC patch overwriting works", "[crc]")
         SECTION(crc->getSpecs().name)
             testOverwriting(*crc, getTestChecksum(crc->getSpecs().numBytes));
 }
+
+TEST_CASE("CRC batch patch inserting works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+        SECTION(crc->getSpecs().name)
+            testBatchPatching(*crc, false);
+}
+
+TEST_CASE("CRC batch patch overwriting works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+        SECTION(crc->getSpecs().name)
+            testBatchPatching(*crc, true);
+}
+
+TEST_CASE("CRC patch position sweep works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto checksum = getTestChecksum(crc->getSpecs().numBytes);
+            testPositionSweep(*crc, checksum, false);
+            testPositionSweep(*crc, checksum, true);
+        }
+    }
+}
+
+TEST_CASE("CRC patching several algorithms at once works", "[crc]")
+{
+    //polynomials of CRC16 variants share the (x+1) factor, so not every
+    //pair of their checksums is reachable; CRC32 pairs with anything
+    auto crc1 = createCRC32();
+    for (auto &crc2 : createAllCRC())
+    {
+        if (crc2->getSpecs().name == crc1->getSpecs().name)
+            continue;
+        SECTION(crc2->getSpecs().name)
+        {
+            std::vector<const CRC*> pair = {crc1.get(), crc2.get()};
+            std::vector<CRC::Value> checksums = {
+                getTestChecksum(crc1->getSpecs().numBytes),
+                getTestChecksum(crc2->getSpecs().numBytes) ^ 0x1234};
+            testMultiPatching(pair, checksums, false);
+            testMultiPatching(pair, checksums, true);
+        }
+    }
+}
+
+TEST_CASE("CRC patching contradicting checksums fails", "[crc]")
+{
+    auto crc = createCRC32();
+    REQUIRE_THROWS(testMultiPatching({crc.get(), crc.get()}, {1, 2}, false));
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
+
+TEST_CASE("CRC patching with restricted bytes works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        for (auto &charset : {"printable", "hex", "base64", "a-z", "01"})
+        {
+            SECTION(crc->getSpecs().name + " " + charset)
+            {
+                auto checksum = getTestChecksum(crc->getSpecs().numBytes);
+                auto allowedBytes = parseByteSet(charset);
+                testMultiPatching(
+                    {crc.get()}, {checksum}, false, allowedBytes);
+                testMultiPatching(
+                    {crc.get()}, {checksum}, true, allowedBytes);
+            }
+        }
+    }
+}
+
+TEST_CASE("CRC multi-part patching works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto checksum = getTestChecksum(crc->getSpecs().numBytes);
+            for (size_t part = 0; part < 3; part++)
+            {
+                testPartPatching(*crc, checksum, part, false);
+                testPartPatching(*crc, checksum, part, true);
+            }
+        }
+    }
+}
+
+TEST_CASE("CRC patching of sparse files works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto checksum = getTestChecksum(crc->getSpecs().numBytes);
+            testSparsePatching(*crc, checksum, false);
+            testSparsePatching(*crc, checksum, true);
+        }
+    }
+}
+
+TEST_CASE("CRC computing and patching over zero runs works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto checksum = getTestChecksum(crc->getSpecs().numBytes);
+            testZeroRuns(*crc, checksum);
+        }
+    }
+}
+
+TEST_CASE("CRC computing from memory works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto data = reinterpret_cast<const uint8_t*>("123456789");
+            REQUIRE(crc->computeChecksum(data, 9) == crc->getSpecs().test);
+            testBufferComputing(*crc);
+        }
+    }
+}
+
+TEST_CASE("CRC batch computing of small buffers works", "[crc]")
+{
+    std::string content(1 << 16, '\0');
+    for (size_t i = 0; i < content.size(); i++)
+        content[i] = static_cast<char>(i * 2654435761u >> 24);
+    auto base = reinterpret_cast<const uint8_t*>(content.data());
+
+    std::vector<const uint8_t*> data;
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < 103; i++)
+    {
+        data.push_back(base + i * 61);
+        sizes.push_back(i * 37 % 4096);
+    }
+
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto checksums = crc->computeChecksums(data, sizes);
+            REQUIRE(checksums.size() == data.size());
+            for (size_t i = 0; i < data.size(); i++)
+            {
+                REQUIRE(
+                    checksums[i] == crc->computeChecksum(data[i], sizes[i]));
+            }
+        }
+    }
+}
+
+TEST_CASE("CRC patching in memory works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto checksum = getTestChecksum(crc->getSpecs().numBytes);
+            testBufferPatching(*crc, checksum, false);
+            testBufferPatching(*crc, checksum, true);
+        }
+    }
+}
+
+TEST_CASE("CRC streams can share one CRC across threads", "[crc]")
+{
+    auto crc = createCRC32();
+    std::string content(1 << 20, '\0');
+    for (size_t i = 0; i < content.size(); i++)
+        content[i] = static_cast<char>(i * 2654435761u >> 24);
+    auto data = reinterpret_cast<const uint8_t*>(content.data());
+    auto expected = crc->computeChecksum(data, content.size());
+
+    std::vector<CRC::Value> results(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        threads.push_back(std::thread([&, i]()
+        {
+            CRC::Stream stream(*crc);
+            for (size_t pos = 0; pos < content.size(); pos += 4096)
+                stream.update(data + pos, 4096);
+            results[i] = stream.finalize();
+        }));
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    for (auto result : results)
+        REQUIRE(result == expected);
+}
+
+TEST_CASE("CRC streams skip zeros like they feed them", "[crc]")
+{
+    std::string zeros(100000, '\0');
+    auto data = reinterpret_cast<const uint8_t*>(zeros.data());
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            for (size_t size : {0, 1, 7, 4096, 100000})
+            {
+                CRC::Stream fed(*crc), skipped(*crc);
+                fed.update(data, 5).update(data, size);
+                skipped.update(data, 5).updateZeros(size);
+                REQUIRE(skipped.getSize() == fed.getSize());
+                REQUIRE(skipped.finalize() == fed.finalize());
+            }
+        }
+    }
+}
+
+TEST_CASE("CRC verified patching works", "[crc]")
+{
+    {
+        auto f = File::fromFileName(
+            "test-in.txt", File::Mode::Write | File::Mode::Binary);
+        f->write("abcdef", 6);
+        f->writeZeros(1 << 20);
+        f->write("ghijkl", 6);
+    }
+
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto checksum = getTestChecksum(crc->getSpecs().numBytes);
+            for (bool overwrite : {false, true})
+            {
+                Progress writeProgress, checksumProgress;
+                {
+                    auto input = File::fromFileName(
+                        "test-in.txt", File::Mode::Read | File::Mode::Binary);
+                    auto output = File::fromFileName(
+                        "test-out.txt",
+                        File::Mode::Write | File::Mode::Binary);
+                    crc->applyPatch(
+                        checksum,
+                        3,
+                        *input,
+                        *output,
+                        overwrite,
+                        writeProgress,
+                        checksumProgress,
+                        true);
+                }
+                auto output = File::fromFileName(
+                    "test-out.txt", File::Mode::Read | File::Mode::Binary);
+                REQUIRE(crc->computeChecksum(*output, checksumProgress)
+                    == checksum);
+            }
+        }
+    }
+
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
+
+TEST_CASE("CRC verified patching notices changed input", "[crc]")
+{
+    //big enough that the copy can't be served from a stale read buffer
+    std::string content(1 << 20, 'a');
+    {
+        auto f = File::fromFileName(
+            "test-in.txt", File::Mode::Write | File::Mode::Binary);
+        f->write(content.data(), content.size());
+    }
+
+    auto crc = createCRC32();
+    Progress writeProgress, checksumProgress;
+    //the input changes after the patch is computed, but before it's copied
+    checksumProgress.finished = [&]()
+    {
+        content[0] = 'b';
+        auto f = File::fromFileName(
+            "test-in.txt", File::Mode::Write | File::Mode::Binary);
+        f->write(content.data(), content.size());
+    };
+    auto input = File::fromFileName(
+        "test-in.txt", File::Mode::Read | File::Mode::Binary);
+    auto output = File::fromFileName(
+        "test-out.txt", File::Mode::Write | File::Mode::Binary);
+    REQUIRE_THROWS(crc->applyPatch(
+        0x12345678,
+        content.size(),
+        *input,
+        *output,
+        false,
+        writeProgress,
+        checksumProgress,
+        true));
+
+    input.reset();
+    output.reset();
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
+
+TEST_CASE("CRC rolling window search works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            testWindowSearch(*crc, 1);
+            testWindowSearch(*crc, 7);
+            testWindowSearch(*crc, 16);
+            testWindowSearch(*crc, 300);
+            testWindowSearch(*crc, 20000);
+        }
+    }
+}
+
+TEST_CASE("CRC states combine like concatenated data", "[crc]")
+{
+    Progress progress;
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            {
+                auto inFile = File::fromFileName(
+                    "test-in.txt", File::Mode::Write);
+                inFile->write("123456789", 9);
+            }
+            auto inFile = File::fromFileName(
+                "test-in.txt", File::Mode::Read | File::Mode::Binary);
+            auto initial = crc->getSpecs().initialXOR;
+            auto whole = crc->computePartialChecksum(
+                *inFile, 0, 9, initial, progress);
+            auto prefix = crc->computePartialChecksum(
+                *inFile, 0, 4, initial, progress);
+            auto suffix = crc->computePartialChecksum(
+                *inFile, 4, 9, 0, progress);
+            REQUIRE(crc->combineStates(prefix, suffix, 5) == whole);
+            inFile.reset();
+            std::remove("test-in.txt");
+        }
+    }
+}
+
+TEST_CASE("CRC masked computing works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            testMaskedComputing(*crc, {});
+            testMaskedComputing(*crc, {{0, 4, false}});
+            testMaskedComputing(*crc, {{0, 4, true}});
+            testMaskedComputing(
+                *crc, {{9000, 20000, false}, {3, 100, true}});
+            testMaskedComputing(
+                *crc, {{100, 10000, true}, {20000, 10, false}});
+        }
+    }
+}
+
+TEST_CASE("CRC masked computing rejects overlapping masks", "[crc]")
+{
+    Progress progress;
+    auto crc = createCRC32();
+    {
+        auto inFile = File::fromFileName("test-in.txt", File::Mode::Write);
+        inFile->write("0123456789", 10);
+    }
+    auto inFile = File::fromFileName(
+        "test-in.txt", File::Mode::Read | File::Mode::Binary);
+    REQUIRE_THROWS(crc->computeMaskedChecksum(
+        *inFile, {{0, 6, false}, {5, 5, true}}, progress));
+    REQUIRE_THROWS(crc->computeMaskedChecksum(
+        *inFile, {{5, 6, false}}, progress));
+    REQUIRE_NOTHROW(crc->computeMaskedChecksum(
+        *inFile, {{0, 5, false}, {5, 5, true}}, progress));
+    inFile.reset();
+    std::remove("test-in.txt");
+}
+
+TEST_CASE("CRC scattered patching works", "[crc]")
+{
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            auto checksum = getTestChecksum(crc->getSpecs().numBytes);
+            testScatteredPatching(*crc, checksum, {{0, 4, 0xFF}});
+            testScatteredPatching(
+                *crc,
+                checksum,
+                {{3, 2, 0xFF}, {5000, 2, 0x0F}, {9000, 3, 0xF0}});
+            testScatteredPatching(*crc, checksum, {{100, 5000, 0x01}});
+        }
+    }
+}
+
+TEST_CASE("CRC scattered patching fails without enough bits", "[crc]")
+{
+    auto crc = createCRC32();
+    REQUIRE_THROWS(testScatteredPatching(*crc, 0, {{0, 3, 0xFF}}));
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
+
+/**
+ * Hidden; run with crcmanip-tests [benchmark]. Compares a zero-heavy corpus
+ * (like a disk image) with dense data of the same size.
+ */
+TEST_CASE("CRC zero run benchmark", "[.benchmark]")
+{
+    const size_t corpusSize = 64 << 20;
+    const size_t blockSize = 1 << 20;
+    const size_t dataSize = 64 << 10;
+
+    auto measure = [](const std::string &path)
+    {
+        Progress progress;
+        auto crc = createCRC32();
+        auto file = File::fromFileName(
+            path, File::Mode::Read | File::Mode::Binary);
+        auto start = std::chrono::steady_clock::now();
+        crc->computeChecksum(*file, progress);
+        std::chrono::duration<double> elapsed
+            = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    };
+
+    std::string block(blockSize, '\0');
+    std::string dense(blockSize, '\0');
+    for (size_t i = 0; i < blockSize; i++)
+    {
+        dense[i] = static_cast<char>(i * 2654435761u >> 24 | 1);
+        if (i < dataSize)
+            block[i] = dense[i];
+    }
+
+    {
+        auto sparseFile = File::fromFileName(
+            "bench-zeros.bin", File::Mode::Write | File::Mode::Binary);
+        auto denseFile = File::fromFileName(
+            "bench-dense.bin", File::Mode::Write | File::Mode::Binary);
+        for (size_t i = 0; i < corpusSize / blockSize; i++)
+        {
+            sparseFile->write(block.data(), block.size());
+            denseFile->write(dense.data(), dense.size());
+        }
+    }
+
+    auto zerosTime = measure("bench-zeros.bin");
+    auto denseTime = measure("bench-dense.bin");
+    WARN("zero-heavy: " << (corpusSize >> 20) / zerosTime << " MiB/s, "
+        << "dense: " << (corpusSize >> 20) / denseTime << " MiB/s");
+
+    std::remove("bench-zeros.bin");
+    std::remove("bench-dense.bin");
+}
@@ -0,0 +1,101 @@
+#include "catch.hh"
+#include "lib/crc_factories.h"
+#include "lib/profile.h"
+#include "test_crc_reference.h"
+
+namespace
+{
+    const size_t NumSeeds = 40;
+
+    uint64_t nextRandom(uint64_t &state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    /**
+     * Random bytes broken up by zero runs long enough for the zero skipping
+     * kernel, of sizes around the interesting boundaries.
+     */
+    std::vector<uint8_t> createContent(uint64_t seed)
+    {
+        const size_t sizes[] = {0, 1, 3, 15, 16, 17, 255, 4096, 70001};
+        uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+        auto size = sizes[nextRandom(state) % 9] + nextRandom(state) % 300;
+        std::vector<uint8_t> content(size);
+        for (auto &byte : content)
+            byte = nextRandom(state);
+        for (size_t i = 0, count = nextRandom(state) % 4; i < count; i++)
+        {
+            auto start = nextRandom(state) % (size + 1);
+            auto runSize = std::min<size_t>(
+                size - start, nextRandom(state) % 9000);
+            std::fill(
+                content.begin() + start,
+                content.begin() + start + runSize,
+                0);
+        }
+        return content;
+    }
+
+    /**
+     * Every fourth seed also goes through files, read in chunks of odd
+     * sizes so that chunk boundaries fall anywhere.
+     */
+    void testAgainstReference(const CRC &crc, uint64_t seed)
+    {
+        bool useFiles = seed % 4 == 0;
+        if (useFiles)
+        {
+            Profile profile = getBuiltinProfile();
+            profile.defaults.chunkSize = 1 + seed * 977 % 20000;
+            setActiveProfile(profile);
+        }
+        auto mismatch = findReferenceMismatch(
+            crc, createContent(seed), seed, useFiles);
+        setActiveProfile(getBuiltinProfile());
+        INFO("seed " << seed);
+        REQUIRE(mismatch == "");
+    }
+}
+
+TEST_CASE("Reference engine matches check values", "[reference]")
+{
+    const std::string content = "123456789";
+    auto data = reinterpret_cast<const uint8_t*>(content.data());
+    for (auto &specs : getBuiltinSpecs())
+    {
+        ReferenceCRC reference(specs);
+        REQUIRE(reference.computeChecksum(data, content.size()) == specs.test);
+    }
+}
+
+TEST_CASE("CRC matches the reference engine", "[reference]")
+{
+    for (auto &crc : createAllCRC())
+        SECTION(crc->getSpecs().name)
+            for (uint64_t seed = 1; seed <= NumSeeds; seed++)
+                testAgainstReference(*crc, seed);
+}
+
+TEST_CASE("CRC with random parameters matches the reference engine",
+    "[reference]")
+{
+    uint64_t state = 0xC0FFEE;
+    for (size_t i = 0; i < 24; i++)
+    {
+        size_t numBits = 8 * (1 + nextRandom(state) % 4);
+        CRC::Value mask = (1ull << numBits) - 1;
+        auto crc = createCustomCRC(
+            numBits,
+            (nextRandom(state) & mask) | 1,
+            nextRandom(state) & mask,
+            nextRandom(state) & mask,
+            nextRandom(state) & 1);
+        SECTION(crc->getSpecs().name)
+            for (uint64_t seed = 1; seed <= NumSeeds / 4; seed++)
+                testAgainstReference(*crc, seed * 31 + i);
+    }
+}
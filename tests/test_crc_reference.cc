@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include "test_crc_reference.h"
+
+namespace
+{
+    const char *InputPath = "test-reference-in.bin";
+    const char *OutputPath = "test-reference-out.bin";
+
+    //largest input whose every window the reference checks one by one
+    const size_t MaxWindowedSize = 1 << 14;
+
+    /**
+     * xorshift64*, so that a seed replays the same choices anywhere.
+     */
+    class Random final
+    {
+        public:
+            Random(uint64_t seed) : state(seed ? seed : 1) { }
+
+            uint64_t next()
+            {
+                state ^= state >> 12;
+                state ^= state << 25;
+                state ^= state >> 27;
+                return state * 2685821657736338717ull;
+            }
+
+            size_t below(size_t limit)
+            {
+                return limit ? next() % limit : 0;
+            }
+
+        private:
+            uint64_t state;
+    };
+
+    std::string describe(
+        const std::string &what, CRC::Value expected, CRC::Value actual)
+    {
+        std::ostringstream s;
+        s << what << ": expected " << std::hex << expected
+            << ", got " << actual;
+        return s.str();
+    }
+
+    CRC::Value getMask(const CRC &crc)
+    {
+        return (1ull << (crc.getSpecs().numBytes * 8)) - 1;
+    }
+
+    std::string checkBuffers(
+        const CRC &crc,
+        const ReferenceCRC &reference,
+        const uint8_t *data,
+        size_t size,
+        Random &random)
+    {
+        auto expected = reference.computeChecksum(data, size);
+        auto actual = crc.computeChecksum(data, size);
+        if (actual != expected)
+            return describe("checksum", expected, actual);
+
+        CRC::Value state = random.next() & getMask(crc);
+        if (crc.computePartialChecksum(data, size, state)
+            != reference.feed(state, data, size))
+        {
+            return describe(
+                "partial checksum",
+                reference.feed(state, data, size),
+                crc.computePartialChecksum(data, size, state));
+        }
+
+        //several buffers at once go through the interleaved lanes
+        std::vector<const uint8_t*> buffers;
+        std::vector<size_t> sizes;
+        for (size_t i = 0, count = 1 + random.below(9); i < count; i++)
+        {
+            auto offset = random.below(size + 1);
+            buffers.push_back(data + offset);
+            sizes.push_back(random.below(size - offset + 1));
+        }
+        auto checksums = crc.computeChecksums(buffers, sizes);
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            expected = reference.computeChecksum(buffers[i], sizes[i]);
+            if (checksums[i] != expected)
+                return describe("batch checksum", expected, checksums[i]);
+        }
+        return "";
+    }
+
+    std::string checkStreams(
+        const CRC &crc,
+        const ReferenceCRC &reference,
+        const uint8_t *data,
+        size_t size,
+        Random &random)
+    {
+        auto expected = reference.computeChecksum(data, size);
+
+        CRC::Stream pieces(crc);
+        for (size_t pos = 0; pos < size; )
+        {
+            auto pieceSize = 1 + random.below(std::min<size_t>(
+                size - pos, 1 + random.below(70000)));
+            pieces.update(data + pos, pieceSize);
+            pos += pieceSize;
+        }
+        if (pieces.finalize() != expected)
+            return describe("stream in pieces", expected, pieces.finalize());
+
+        auto split = random.below(size + 1);
+        CRC::Stream prefix(crc), suffix(crc);
+        prefix.update(data, split);
+        suffix.update(data + split, size - split);
+        prefix.combine(suffix);
+        if (prefix.finalize() != expected)
+            return describe("combined streams", expected, prefix.finalize());
+
+        auto numZeros = random.below(100000);
+        CRC::Stream zeros(crc);
+        zeros.update(data, size).updateZeros(numZeros);
+        expected = reference.finalize(
+            reference.feedZeros(
+                reference.feed(crc.getSpecs().initialXOR, data, size),
+                numZeros),
+            size + numZeros);
+        if (zeros.finalize() != expected)
+            return describe("skipped zeros", expected, zeros.finalize());
+        return "";
+    }
+
+    std::string checkPatch(
+        const CRC &crc,
+        const ReferenceCRC &reference,
+        const uint8_t *data,
+        size_t size,
+        bool overwrite,
+        Random &random)
+    {
+        auto patchSize = crc.getSpecs().numBytes;
+        if (overwrite && size < patchSize)
+            return "";
+        auto pos = random.below(size - (overwrite ? patchSize : 0) + 1);
+        CRC::Value target = random.next() & getMask(crc);
+
+        auto patch = crc.computePatch(target, data, size, pos, overwrite);
+        if (patch.size() != patchSize)
+            return describe("patch size", patchSize, patch.size());
+        std::vector<uint8_t> output(data, data + pos);
+        output.insert(output.end(), patch.begin(), patch.end());
+        output.insert(
+            output.end(),
+            data + pos + (overwrite ? patchSize : 0),
+            data + size);
+
+        auto actual = reference.computeChecksum(output.data(), output.size());
+        if (actual != target)
+        {
+            return describe(
+                overwrite ? "overwriting patch" : "inserting patch",
+                target,
+                actual);
+        }
+        return "";
+    }
+
+    /**
+     * Zero blocks become holes where the filesystem supports them, which
+     * sends the file paths through their hole handling too.
+     */
+    void writeInput(const std::vector<uint8_t> &data)
+    {
+        const size_t BlockSize = 4096;
+        auto file = File::fromFileName(
+            InputPath, File::Mode::Write | File::Mode::Binary);
+        for (size_t pos = 0; pos < data.size(); pos += BlockSize)
+        {
+            auto blockSize = std::min(BlockSize, data.size() - pos);
+            if (std::all_of(
+                data.begin() + pos,
+                data.begin() + pos + blockSize,
+                [](uint8_t byte) { return byte == 0; }))
+            {
+                file->writeZeros(blockSize);
+            }
+            else
+                file->write(data.data() + pos, blockSize);
+        }
+    }
+
+    std::vector<uint8_t> readOutput()
+    {
+        auto file = File::fromFileName(
+            OutputPath, File::Mode::Read | File::Mode::Binary);
+        std::vector<uint8_t> content(file->getSize());
+        file->read(content.data(), content.size());
+        return content;
+    }
+
+    std::string checkFiles(
+        const CRC &crc,
+        const ReferenceCRC &reference,
+        const std::vector<uint8_t> &data,
+        Random &random)
+    {
+        Progress progress;
+        writeInput(data);
+        auto input = File::fromFileName(
+            InputPath, File::Mode::Read | File::Mode::Binary);
+
+        auto expected = reference.computeChecksum(data.data(), data.size());
+        auto actual = crc.computeChecksum(*input, progress);
+        if (actual != expected)
+            return describe("file checksum", expected, actual);
+
+        CRC::Mask mask;
+        mask.offset = random.below(data.size() + 1);
+        mask.size = random.below(data.size() - mask.offset + 1);
+        mask.skip = random.next() & 1;
+        auto masked = data;
+        if (mask.skip)
+        {
+            masked.erase(
+                masked.begin() + mask.offset,
+                masked.begin() + mask.offset + mask.size);
+        }
+        else
+        {
+            std::fill(
+                masked.begin() + mask.offset,
+                masked.begin() + mask.offset + mask.size,
+                0);
+        }
+        expected = reference.computeChecksum(masked.data(), masked.size());
+        actual = crc.computeMaskedChecksum(*input, {mask}, progress);
+        if (actual != expected)
+            return describe("masked checksum", expected, actual);
+
+        if (!data.empty() && data.size() <= MaxWindowedSize)
+        {
+            auto windowSize = 1 + random.below(std::min<size_t>(
+                data.size(), 64));
+            auto targetPos = random.below(data.size() - windowSize + 1);
+            auto target = reference.computeChecksum(
+                data.data() + targetPos, windowSize);
+            std::vector<File::OffsetType> expectedOffsets;
+            for (size_t pos = 0; pos + windowSize <= data.size(); pos++)
+            {
+                if (reference.computeChecksum(data.data() + pos, windowSize)
+                    == target)
+                {
+                    expectedOffsets.push_back(pos);
+                }
+            }
+            auto offsets = crc.findWindows(
+                *input, windowSize, target, progress);
+            if (offsets != expectedOffsets)
+            {
+                return describe(
+                    "window matches", expectedOffsets.size(), offsets.size());
+            }
+        }
+
+        for (bool overwrite : {false, true})
+        {
+            auto patchSize = crc.getSpecs().numBytes;
+            if (overwrite && data.size() < patchSize)
+                continue;
+            auto pos = random.below(
+                data.size() - (overwrite ? patchSize : 0) + 1);
+            CRC::Value target = random.next() & getMask(crc);
+            {
+                Progress writeProgress;
+                auto output = File::fromFileName(
+                    OutputPath, File::Mode::Write | File::Mode::Binary);
+                crc.applyPatch(
+                    target,
+                    pos,
+                    *input,
+                    *output,
+                    overwrite,
+                    writeProgress,
+                    progress,
+                    true);
+            }
+            auto output = readOutput();
+            actual = reference.computeChecksum(output.data(), output.size());
+            if (actual != target)
+            {
+                return describe(
+                    overwrite ? "overwriting file patch" : "file patch",
+                    target,
+                    actual);
+            }
+        }
+        return "";
+    }
+}
+
+ReferenceCRC::ReferenceCRC(const CRC::Specs &specs)
+    : specs(specs), mask((1ull << (specs.numBytes * 8)) - 1),
+        polynomialReverse(0)
+{
+    size_t numBits = specs.numBytes * 8;
+    for (size_t i = 0; i < numBits; i++)
+        if (specs.polynomial & (1ull << i))
+            polynomialReverse |= 1ull << (numBits - 1 - i);
+}
+
+/**
+ * Big endian algorithms shift the register left and take input from the
+ * top, the rest mirror that.
+ */
+CRC::Value ReferenceCRC::feedByte(CRC::Value state, uint8_t byte) const
+{
+    size_t numBits = specs.numBytes * 8;
+    if (specs.flags & CRC::Flags::BigEndian)
+    {
+        state ^= static_cast<CRC::Value>(byte) << (numBits - 8);
+        for (size_t bit = 0; bit < 8; bit++)
+        {
+            bool carry = state & (1ull << (numBits - 1));
+            state = (state << 1) & mask;
+            if (carry)
+                state ^= specs.polynomial;
+        }
+        return state;
+    }
+
+    state ^= byte;
+    for (size_t bit = 0; bit < 8; bit++)
+    {
+        bool carry = state & 1;
+        state >>= 1;
+        if (carry)
+            state ^= polynomialReverse;
+    }
+    return state;
+}
+
+CRC::Value ReferenceCRC::feed(
+    CRC::Value state, const uint8_t *data, size_t size) const
+{
+    for (size_t i = 0; i < size; i++)
+        state = feedByte(state, data[i]);
+    return state;
+}
+
+CRC::Value ReferenceCRC::feedZeros(CRC::Value state, size_t size) const
+{
+    for (size_t i = 0; i < size; i++)
+        state = feedByte(state, 0);
+    return state;
+}
+
+/**
+ * Algorithms that use the file size feed it after the data, least
+ * significant byte first, leaving out the zero bytes at the top.
+ */
+CRC::Value ReferenceCRC::finalize(CRC::Value state, uint64_t totalSize) const
+{
+    if (specs.flags & CRC::Flags::UseFileSize)
+        for (; totalSize; totalSize >>= 8)
+            state = feedByte(state, totalSize & 0xFF);
+    return (state ^ specs.finalXOR) & mask;
+}
+
+CRC::Value ReferenceCRC::computeChecksum(
+    const uint8_t *data, size_t size) const
+{
+    return finalize(feed(specs.initialXOR, data, size), size);
+}
+
+/**
+ * Each check is one path of the engine: the table and zero skipping
+ * kernels through plain checksums, the interleaved lanes through batches,
+ * the zero operators through streams, the reverse direction through
+ * patches, and the I/O loops through files.
+ */
+std::string findReferenceMismatch(
+    const CRC &crc,
+    const std::vector<uint8_t> &data,
+    uint64_t seed,
+    bool useFiles)
+{
+    Random random(seed);
+    ReferenceCRC reference(crc.getSpecs());
+
+    //same data at an arbitrary alignment
+    std::vector<uint8_t> buffer(data.size() + 16);
+    auto alignment = random.below(16);
+    std::copy(data.begin(), data.end(), buffer.begin() + alignment);
+    const uint8_t *aligned = buffer.data() + alignment;
+
+    std::string mismatch = checkBuffers(
+        crc, reference, aligned, data.size(), random);
+    if (mismatch.empty())
+        mismatch = checkStreams(crc, reference, aligned, data.size(), random);
+    for (bool overwrite : {false, true})
+    {
+        if (mismatch.empty())
+        {
+            mismatch = checkPatch(
+                crc, reference, aligned, data.size(), overwrite, random);
+        }
+    }
+    if (mismatch.empty() && useFiles)
+    {
+        mismatch = checkFiles(crc, reference, data, random);
+        std::remove(InputPath);
+        std::remove(OutputPath);
+    }
+    return mismatch;
+}
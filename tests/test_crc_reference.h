@@ -0,0 +1,42 @@
+#ifndef TEST_CRC_REFERENCE_H
+#define TEST_CRC_REFERENCE_H
+#include <string>
+#include <vector>
+#include "lib/crc.h"
+
+/**
+ * CRC computed a bit at a time straight from the specs, with no tables or
+ * shortcuts. It's slow on purpose: the fast engine is checked against it.
+ */
+class ReferenceCRC final
+{
+    public:
+        ReferenceCRC(const CRC::Specs &specs);
+
+        CRC::Value feed(
+            CRC::Value state, const uint8_t *data, size_t size) const;
+        CRC::Value feedZeros(CRC::Value state, size_t size) const;
+        CRC::Value finalize(CRC::Value state, uint64_t totalSize) const;
+        CRC::Value computeChecksum(const uint8_t *data, size_t size) const;
+
+    private:
+        CRC::Value feedByte(CRC::Value state, uint8_t byte) const;
+
+        CRC::Specs specs;
+        CRC::Value mask;
+        CRC::Value polynomialReverse;
+};
+
+/**
+ * Runs the fast paths of crc over data, with buffer alignment, splits and
+ * patch positions picked by seed, and compares them with the reference.
+ * Returns what differed first, or an empty string if nothing did. File
+ * paths go through temporary files in the current directory.
+ */
+std::string findReferenceMismatch(
+    const CRC &crc,
+    const std::vector<uint8_t> &data,
+    uint64_t seed,
+    bool useFiles);
+
+#endif
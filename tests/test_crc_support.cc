@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <cstdio>
 #include <string>
+#include <vector>
 #include "catch.hh"
 #include "lib/file.h"
 #include "test_crc_support.h"
@@ -149,3 +151,546 @@ void testOverwriting(const CRC &crc, CRC::Value checksum)
         std::remove("test-out.txt");
     }
 }
+
+void testBatchPatching(const CRC &crc, bool overwrite)
+{
+    Progress progress;
+    auto content = getTestContent();
+    std::vector<CRC::Value> checksums = {0, 1, 0xDECEA5ED, 0xFFFFFFFF};
+    for (auto &checksum : checksums)
+        checksum &= 0xFFFFFFFFUL >> (32 - (crc.getSpecs().numBytes << 3));
+
+    {
+        auto inFile = File::fromFileName("test-in.txt", File::Mode::Write);
+        inFile->write(content.data(), content.size());
+    }
+
+    size_t offset = content.size() / 3;
+    size_t size = content.size() + (overwrite ? 0 : crc.getSpecs().numBytes);
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        auto patches = crc.computePatches(
+            checksums, offset, *inFile, overwrite, progress);
+        REQUIRE(patches.size() == checksums.size());
+
+        std::vector<std::unique_ptr<File>> outFiles;
+        std::vector<File*> outputs;
+        for (size_t i = 0; i < checksums.size(); i++)
+        {
+            outFiles.push_back(File::fromFileName(
+                "test-out" + std::to_string(i) + ".txt",
+                File::Mode::Write | File::Mode::Binary));
+            outputs.push_back(outFiles.back().get());
+        }
+        crc.applyPatches(
+            patches, offset, *inFile, outputs, overwrite, progress);
+    }
+
+    for (size_t i = 0; i < checksums.size(); i++)
+    {
+        auto path = "test-out" + std::to_string(i) + ".txt";
+        {
+            auto outFile = File::fromFileName(
+                path, File::Mode::Read | File::Mode::Binary);
+            REQUIRE(outFile->getSize() == size);
+            REQUIRE(crc.computeChecksum(*outFile, progress) == checksums[i]);
+
+            std::unique_ptr<char[]> buf(new char[offset]);
+            outFile->seek(0, File::Origin::Start);
+            outFile->read(buf.get(), offset);
+            REQUIRE(std::string(buf.get(), offset)
+                == content.substr(0, offset));
+        }
+        std::remove(path.c_str());
+    }
+    std::remove("test-in.txt");
+}
+
+void testPositionSweep(const CRC &crc, CRC::Value checksum, bool overwrite)
+{
+    Progress progress;
+    auto content = getTestContent();
+
+    {
+        auto inFile = File::fromFileName("test-in.txt", File::Mode::Write);
+        inFile->write(content.data(), content.size());
+    }
+
+    File::OffsetType lastPosition = content.size()
+        - (overwrite ? crc.getSpecs().numBytes : 0);
+    std::vector<File::OffsetType> positions;
+    for (File::OffsetType pos = 0; pos < 40; pos++)
+        positions.push_back(pos);
+    positions.push_back(lastPosition);
+    positions.push_back(content.size() / 2);
+    positions.push_back(9000);
+    positions.push_back(content.size() / 2);
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        auto patches = crc.computePatchesAtPositions(
+            checksum, positions, *inFile, overwrite, progress);
+        REQUIRE(patches.size() == positions.size());
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            auto expected = crc.computePatches(
+                {checksum}, positions[i], *inFile, overwrite, progress);
+            REQUIRE(patches[i] == expected[0]);
+        }
+
+        REQUIRE_THROWS(crc.computePatchesAtPositions(
+            checksum, {lastPosition + 1}, *inFile, overwrite, progress));
+    }
+
+    std::remove("test-in.txt");
+}
+
+void testMultiPatching(
+    const std::vector<const CRC*> &crcs,
+    const std::vector<CRC::Value> &checksums,
+    bool overwrite,
+    const CRC::ByteSet &allowedBytes)
+{
+    Progress progress;
+    auto content = getTestContent();
+
+    {
+        auto inFile = File::fromFileName("test-in.txt", File::Mode::Write);
+        inFile->write(content.data(), content.size());
+    }
+
+    size_t offset = content.size() / 2;
+    std::vector<uint8_t> patch;
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Write | File::Mode::Binary);
+        patch = CRC::computeMultiPatch(
+            crcs,
+            checksums,
+            offset,
+            *inFile,
+            overwrite,
+            allowedBytes,
+            progress);
+        CRC::writePatch(
+            patch, offset, *inFile, *outFile, overwrite, progress);
+    }
+
+    REQUIRE(patch.size() >= CRC::getMultiPatchSize(crcs, allowedBytes));
+    for (auto byte : patch)
+        REQUIRE(allowedBytes[byte]);
+
+    {
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Read | File::Mode::Binary);
+        REQUIRE(outFile->getSize()
+            == content.size() + (overwrite ? 0 : patch.size()));
+        for (size_t i = 0; i < crcs.size(); i++)
+            REQUIRE(crcs[i]->computeChecksum(*outFile, progress)
+                == checksums[i]);
+
+        std::unique_ptr<char[]> buf(new char[offset]);
+        outFile->seek(0, File::Origin::Start);
+        outFile->read(buf.get(), offset);
+        REQUIRE(std::string(buf.get(), offset) == content.substr(0, offset));
+    }
+
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
+
+void testPartPatching(
+    const CRC &crc, CRC::Value checksum, size_t patchedPart, bool overwrite)
+{
+    Progress progress;
+    auto content = getTestContent();
+    std::vector<std::string> contents = {
+        content.substr(0, 1000),
+        content.substr(1000, 9000),
+        content.substr(10000)};
+    std::vector<std::string> paths = {
+        "test-in.001", "test-in.002", "test-in.003"};
+
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        auto partFile = File::fromFileName(paths[i], File::Mode::Write);
+        partFile->write(contents[i].data(), contents[i].size());
+    }
+
+    {
+        std::vector<std::unique_ptr<File>> partFiles;
+        std::vector<File*> parts;
+        for (auto &path : paths)
+        {
+            partFiles.push_back(File::fromFileName(
+                path, File::Mode::Read | File::Mode::Binary));
+            parts.push_back(partFiles.back().get());
+        }
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Write | File::Mode::Binary);
+        crc.applyPartPatch(
+            checksum,
+            parts,
+            patchedPart,
+            contents[patchedPart].size() / 2,
+            *outFile,
+            overwrite,
+            progress,
+            progress);
+    }
+
+    {
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Read | File::Mode::Binary);
+        std::string patched(outFile->getSize(), '\0');
+        outFile->read(&patched[0], patched.size());
+        contents[patchedPart] = patched;
+    }
+
+    {
+        std::string joined;
+        for (auto &part : contents)
+            joined += part;
+        auto joinedFile = File::fromFileName(
+            "test-out.txt", File::Mode::Write | File::Mode::Binary);
+        joinedFile->write(joined.data(), joined.size());
+    }
+
+    {
+        auto joinedFile = File::fromFileName(
+            "test-out.txt", File::Mode::Read | File::Mode::Binary);
+        REQUIRE(crc.computeChecksum(*joinedFile, progress) == checksum);
+    }
+
+    for (auto &path : paths)
+        std::remove(path.c_str());
+    std::remove("test-out.txt");
+}
+
+void testSparsePatching(const CRC &crc, CRC::Value checksum, bool overwrite)
+{
+    Progress progress;
+    const File::OffsetType holeSize = 1 << 20;
+    const File::OffsetType targetPos = 2 * holeSize;
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Write | File::Mode::Binary);
+        inFile->writeZeros(holeSize);
+        inFile->write("sparse", 6);
+        inFile->writeZeros(3 * holeSize);
+    }
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Write | File::Mode::Binary);
+        crc.applyPatch(
+            checksum,
+            targetPos,
+            *inFile,
+            *outFile,
+            overwrite,
+            progress,
+            progress);
+    }
+
+    {
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Read | File::Mode::Binary);
+        auto expectedSize = 4 * holeSize + 6
+            + (overwrite ? 0 : crc.getSpecs().numBytes);
+        REQUIRE(outFile->getSize() == expectedSize);
+        REQUIRE(crc.computeChecksum(*outFile, progress) == checksum);
+
+        std::unique_ptr<char[]> buffer(new char[outFile->getSize()]);
+        outFile->read(buffer.get(), outFile->getSize());
+        REQUIRE(std::string(buffer.get() + holeSize, 6) == "sparse");
+        size_t numNonZero = 0;
+        for (File::OffsetType i = 0; i < outFile->getSize(); i++)
+        {
+            if (i < targetPos
+                || i >= targetPos + crc.getSpecs().numBytes)
+            {
+                numNonZero += buffer[i] != 0;
+            }
+        }
+        REQUIRE(numNonZero == 6);
+    }
+
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
+
+void testBufferComputing(const CRC &crc)
+{
+    Progress progress;
+    auto content = getTestContent();
+    auto data = reinterpret_cast<const uint8_t*>(content.data());
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Write | File::Mode::Binary);
+        inFile->write(content.data(), content.size());
+    }
+
+    CRC::Value expected;
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        expected = crc.computeChecksum(*inFile, progress);
+    }
+    std::remove("test-in.txt");
+
+    REQUIRE(crc.computeChecksum(data, content.size()) == expected);
+
+    CRC::Stream stream(crc);
+    for (size_t pos = 0, step = 1; pos < content.size(); step *= 3)
+    {
+        auto size = std::min(step, content.size() - pos);
+        stream.update(data + pos, size);
+        pos += size;
+    }
+    REQUIRE(stream.getSize() == content.size());
+    REQUIRE(stream.finalize() == expected);
+
+    for (size_t split : {size_t(0), size_t(1), size_t(5000), content.size()})
+    {
+        CRC::Stream head(crc);
+        CRC::Stream tail(crc);
+        head.update(data, split);
+        tail.update(data + split, content.size() - split);
+        REQUIRE(head.combine(tail).finalize() == expected);
+    }
+}
+
+void testBufferPatching(const CRC &crc, CRC::Value checksum, bool overwrite)
+{
+    auto content = getTestContent();
+    std::vector<uint8_t> data(content.begin(), content.end());
+
+    for (size_t targetPos : {size_t(0), size_t(777), data.size() - 4})
+    {
+        auto patch = crc.computePatch(
+            checksum, data.data(), data.size(), targetPos, overwrite);
+        REQUIRE(patch.size() == crc.getSpecs().numBytes);
+
+        auto output = data;
+        if (overwrite)
+            std::copy(patch.begin(), patch.end(), output.begin() + targetPos);
+        else
+        {
+            output.insert(
+                output.begin() + targetPos, patch.begin(), patch.end());
+        }
+        REQUIRE(crc.computeChecksum(output.data(), output.size()) == checksum);
+    }
+
+    REQUIRE_THROWS(crc.computePatch(
+        checksum, data.data(), data.size(), data.size() + 1, overwrite));
+}
+
+void testWindowSearch(const CRC &crc, File::OffsetType windowSize)
+{
+    Progress progress;
+    auto content = getTestContent();
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Write | File::Mode::Binary);
+        inFile->write(content.data(), content.size());
+    }
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        auto computeWindow = [&](File::OffsetType offset)
+        {
+            return crc.finalizeChecksum(
+                crc.computePartialChecksum(
+                    *inFile,
+                    offset,
+                    offset + windowSize,
+                    crc.getSpecs().initialXOR,
+                    progress),
+                windowSize);
+        };
+
+        const File::OffsetType knownOffset = 1234;
+        auto checksum = computeWindow(knownOffset);
+        auto offsets = crc.findWindows(
+            *inFile, windowSize, checksum, progress);
+
+        REQUIRE(std::find(offsets.begin(), offsets.end(), knownOffset)
+            != offsets.end());
+        for (auto offset : offsets)
+            REQUIRE(computeWindow(offset) == checksum);
+
+        //rescanning every offset is affordable only for small windows
+        if (windowSize <= 16)
+        {
+            std::vector<File::OffsetType> expected;
+            for (File::OffsetType offset = 0;
+                offset + windowSize <= inFile->getSize();
+                offset++)
+            {
+                if (computeWindow(offset) == checksum)
+                    expected.push_back(offset);
+            }
+            REQUIRE(offsets == expected);
+        }
+    }
+
+    std::remove("test-in.txt");
+}
+
+void testZeroRuns(const CRC &crc, CRC::Value checksum)
+{
+    Progress progress;
+
+    //pieces too short for zero runs to be detected in them
+    auto computeReference = [&](File &file)
+    {
+        const File::OffsetType pieceSize = 100;
+        CRC::Value state = crc.getSpecs().initialXOR;
+        for (File::OffsetType pos = 0; pos < file.getSize(); )
+        {
+            auto end = std::min(pos + pieceSize, file.getSize());
+            state = crc.computePartialChecksum(
+                file, pos, end, state, progress);
+            pos = end;
+        }
+        return crc.finalizeChecksum(state, file.getSize());
+    };
+
+    auto content = getTestContent();
+    const std::vector<std::pair<size_t, size_t>> runs = {
+        {1, 255}, {300, 256}, {1000, 7000}, {8190, 300}, {10001, 4096}};
+    for (const auto &run : runs)
+        content.replace(run.first, run.second, run.second, '\0');
+    content.append(5000, '\0');
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Write | File::Mode::Binary);
+        inFile->write(content.data(), content.size());
+    }
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        REQUIRE(
+            crc.computeChecksum(*inFile, progress)
+            == computeReference(*inFile));
+
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Write | File::Mode::Binary);
+        crc.applyPatch(
+            checksum, 500, *inFile, *outFile, false, progress, progress);
+    }
+
+    {
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Read | File::Mode::Binary);
+        REQUIRE(computeReference(*outFile) == checksum);
+    }
+
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
+
+void testMaskedComputing(const CRC &crc, const std::vector<CRC::Mask> &masks)
+{
+    Progress progress;
+    auto content = getTestContent();
+
+    std::string expected;
+    File::OffsetType pos = 0;
+    while (pos < static_cast<File::OffsetType>(content.size()))
+    {
+        const CRC::Mask *current = nullptr;
+        for (const auto &mask : masks)
+            if (mask.offset <= pos && pos < mask.offset + mask.size)
+                current = &mask;
+        if (!current)
+            expected += content[pos];
+        else if (!current->skip)
+            expected += '\0';
+        pos++;
+    }
+
+    {
+        auto inFile = File::fromFileName("test-in.txt", File::Mode::Write);
+        inFile->write(content.data(), content.size());
+        auto outFile = File::fromFileName("test-out.txt", File::Mode::Write);
+        outFile->write(expected.data(), expected.size());
+    }
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Read | File::Mode::Binary);
+        REQUIRE(
+            crc.computeMaskedChecksum(*inFile, masks, progress)
+            == crc.computeChecksum(*outFile, progress));
+    }
+
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
+
+void testScatteredPatching(
+    const CRC &crc,
+    CRC::Value checksum,
+    const std::vector<CRC::Region> &regions)
+{
+    Progress progress;
+    auto content = getTestContent();
+
+    {
+        auto inFile = File::fromFileName("test-in.txt", File::Mode::Write);
+        inFile->write(content.data(), content.size());
+    }
+
+    {
+        auto inFile = File::fromFileName(
+            "test-in.txt", File::Mode::Read | File::Mode::Binary);
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Write | File::Mode::Binary);
+        crc.applyScatteredPatch(
+            checksum, regions, *inFile, *outFile, progress, progress);
+    }
+
+    {
+        auto outFile = File::fromFileName(
+            "test-out.txt", File::Mode::Read | File::Mode::Binary);
+        REQUIRE(outFile->getSize() == content.size());
+        REQUIRE(crc.computeChecksum(*outFile, progress) == checksum);
+
+        std::unique_ptr<char[]> buf(new char[content.size()]);
+        outFile->seek(0, File::Origin::Start);
+        outFile->read(buf.get(), content.size());
+        size_t numChangedOutside = 0;
+        for (File::OffsetType i = 0; i < content.size(); i++)
+        {
+            uint8_t mask = 0;
+            for (const auto &region : regions)
+                if (region.offset <= i && i < region.offset + region.size)
+                    mask = region.mask;
+            if (static_cast<uint8_t>(buf[i] ^ content[i]) & ~mask)
+                numChangedOutside++;
+        }
+        REQUIRE(numChangedOutside == 0);
+    }
+
+    std::remove("test-in.txt");
+    std::remove("test-out.txt");
+}
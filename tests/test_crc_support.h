@@ -1,10 +1,30 @@
 #ifndef TEST_CRC_SUPPORT_H
 #define TEST_CRC_SUPPORT_H
+#include <vector>
 #include "lib/crc.h"
 
 void testComputing(const CRC &crc, CRC::Value checksum);
 void testAppending(const CRC &crc, CRC::Value checksum);
 void testInserting(const CRC &crc, CRC::Value checksum);
 void testOverwriting(const CRC &crc, CRC::Value checksum);
+void testBatchPatching(const CRC &crc, bool overwrite);
+void testPositionSweep(const CRC &crc, CRC::Value checksum, bool overwrite);
+void testPartPatching(
+    const CRC &crc, CRC::Value checksum, size_t patchedPart, bool overwrite);
+void testSparsePatching(const CRC &crc, CRC::Value checksum, bool overwrite);
+void testBufferComputing(const CRC &crc);
+void testBufferPatching(const CRC &crc, CRC::Value checksum, bool overwrite);
+void testWindowSearch(const CRC &crc, File::OffsetType windowSize);
+void testZeroRuns(const CRC &crc, CRC::Value checksum);
+void testMaskedComputing(const CRC &crc, const std::vector<CRC::Mask> &masks);
+void testScatteredPatching(
+    const CRC &crc,
+    CRC::Value checksum,
+    const std::vector<CRC::Region> &regions);
+void testMultiPatching(
+    const std::vector<const CRC*> &crcs,
+    const std::vector<CRC::Value> &checksums,
+    bool overwrite,
+    const CRC::ByteSet &allowedBytes = CRC::ByteSet().set());
 
 #endif
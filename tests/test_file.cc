@@ -1,5 +1,9 @@
+#include <limits>
 #include "catch.hh"
 #include "lib/file.h"
+#if HAVE_SEEK_DATA
+    #include <unistd.h>
+#endif
 
 TEST_CASE("Reading and writing from files works", "[file]")
 {
@@ -21,6 +25,95 @@ TEST_CASE("Reading and writing from files works", "[file]")
     std::remove("test.txt");
 }
 
+TEST_CASE("Writing zeros and finding holes works", "[file]")
+{
+    const File::OffsetType holeSize = 1 << 20;
+    {
+        auto f = File::fromFileName("test.txt", File::Mode::Write);
+        f->write("abc", 3);
+        f->writeZeros(holeSize);
+        f->write("def", 3);
+        f->writeZeros(holeSize);
+        REQUIRE(f->getSize() == 6 + 2 * holeSize);
+    }
+
+    {
+        auto f = File::fromFileName(
+            "test.txt", File::Mode::Read | File::Mode::Binary);
+        REQUIRE(f->getSize() == 6 + 2 * holeSize);
+        REQUIRE(f->findData(0) == 0);
+        REQUIRE(f->findHole(0) >= 3);
+        REQUIRE(f->findData(3) <= 3 + holeSize);
+        REQUIRE(f->findHole(4 + holeSize) >= 6 + holeSize);
+        REQUIRE(f->findHole(0) <= f->getSize());
+        REQUIRE(f->tell() == 0);
+
+        std::unique_ptr<char[]> buffer(new char[f->getSize()]);
+        f->read(buffer.get(), f->getSize());
+        REQUIRE(std::string(buffer.get(), 3) == "abc");
+        REQUIRE(std::string(buffer.get() + 3 + holeSize, 3) == "def");
+        size_t numNonZero = 0;
+        for (File::OffsetType i = 0; i < f->getSize(); i++)
+            numNonZero += buffer[i] != 0;
+        REQUIRE(numNonZero == 6);
+    }
+
+    std::remove("test.txt");
+}
+
+#if HAVE_SEEK_DATA
+    TEST_CASE("Streams of unknown size have no holes", "[file]")
+    {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        REQUIRE(write(fds[1], "abc", 3) == 3);
+        close(fds[1]);
+        auto f = File::fromFileHandle(fdopen(fds[0], "rb"));
+        REQUIRE(f->getSize() == -1);
+        REQUIRE(f->findData(5) == 5);
+        REQUIRE(f->findHole(5)
+            == std::numeric_limits<File::OffsetType>::max());
+    }
+#endif
+
+TEST_CASE("Bypassing the page cache keeps content intact", "[file]")
+{
+    const size_t size = 20 << 20;
+    std::string content(size, 0);
+    for (size_t i = 0; i < size; i++)
+        content[i] = static_cast<char>(i * 7);
+
+    File::setCachePolicy(File::CachePolicy::NoCache);
+    auto statsBefore = File::getStats();
+    {
+        auto f = File::fromFileName(
+            "test.txt", File::Mode::Write | File::Mode::Binary);
+        f->write(content.data(), size);
+    }
+    {
+        auto f = File::fromFileName(
+            "test.txt", File::Mode::Read | File::Mode::Binary);
+        std::unique_ptr<char[]> buffer(new char[size]);
+        f->read(buffer.get(), size);
+        REQUIRE(std::string(buffer.get(), size) == content);
+    }
+    auto statsAfter = File::getStats();
+    File::setCachePolicy(File::CachePolicy::Default);
+
+    REQUIRE(statsAfter.bytesWritten - statsBefore.bytesWritten == size);
+    REQUIRE(statsAfter.bytesRead - statsBefore.bytesRead == size);
+    REQUIRE(statsAfter.numOpens - statsBefore.numOpens == 2);
+    #if HAVE_POSIX_FADVISE
+        REQUIRE(statsAfter.bytesDropped - statsBefore.bytesDropped
+            == 2 * size);
+        REQUIRE(statsAfter.numDropRequests > statsBefore.numDropRequests);
+    #else
+        REQUIRE(statsAfter.bytesDropped == statsBefore.bytesDropped);
+    #endif
+
+    std::remove("test.txt");
+}
+
 TEST_CASE("Support for big file sizes works", "[file]")
 {
     REQUIRE(sizeof(File::OffsetType) > sizeof(uint32_t));
@@ -0,0 +1,60 @@
+#include "catch.hh"
+#include "lib/gf2.h"
+
+namespace
+{
+    Gf2Basis::Vector createVector(size_t numBits, uint64_t value)
+    {
+        auto vector = Gf2Basis::createVector(numBits);
+        for (size_t i = 0; i < numBits; i++)
+            Gf2Basis::setBit(vector, i, (value >> i) & 1);
+        return vector;
+    }
+}
+
+TEST_CASE("GF(2) basis skips dependent vectors", "[gf2]")
+{
+    Gf2Basis basis(4);
+    REQUIRE(basis.add(createVector(4, 0x3)));
+    REQUIRE(basis.add(createVector(4, 0x6)));
+    REQUIRE(!basis.add(createVector(4, 0x5)));
+    REQUIRE(!basis.add(createVector(4, 0x0)));
+    REQUIRE(basis.getRank() == 2);
+    REQUIRE(!basis.isFull());
+    REQUIRE(basis.add(createVector(4, 0x8)));
+    REQUIRE(basis.add(createVector(4, 0x1)));
+    REQUIRE(basis.isFull());
+    REQUIRE(!basis.add(createVector(4, 0x4)));
+}
+
+TEST_CASE("GF(2) basis solves for sums of added vectors", "[gf2]")
+{
+    Gf2Basis basis(100);
+    std::vector<Gf2Basis::Vector> vectors;
+    for (size_t i = 0; i < 100; i += 3)
+    {
+        auto vector = Gf2Basis::createVector(100);
+        Gf2Basis::setBit(vector, i, true);
+        Gf2Basis::setBit(vector, 99 - i, true);
+        Gf2Basis::setBit(vector, (i * 7) % 100, true);
+        if (basis.add(vector))
+            vectors.push_back(vector);
+    }
+
+    auto target = Gf2Basis::createVector(100);
+    for (size_t i = 0; i < vectors.size(); i += 2)
+        for (size_t j = 0; j < target.size(); j++)
+            target[j] ^= vectors[i][j];
+
+    std::vector<size_t> indices;
+    REQUIRE(basis.solve(target, indices));
+    auto sum = Gf2Basis::createVector(100);
+    for (auto index : indices)
+        for (size_t j = 0; j < sum.size(); j++)
+            sum[j] ^= vectors[index][j];
+    REQUIRE(sum == target);
+
+    Gf2Basis small(3);
+    small.add(createVector(3, 0x1));
+    REQUIRE(!small.solve(createVector(3, 0x2), indices));
+}
@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "catch.hh"
+#include "lib/crc_factories.h"
+#include "lib/job.h"
+
+namespace
+{
+    void writeFile(const std::string &path, size_t size)
+    {
+        auto f = File::fromFileName(
+            path, File::Mode::Write | File::Mode::Binary);
+        std::string content(size, 0);
+        for (size_t i = 0; i < size; i++)
+            content[i] = static_cast<char>(i * 31 + (i >> 12));
+        f->write(content.data(), content.size());
+    }
+
+    bool fileExists(const std::string &path)
+    {
+        return std::ifstream(path).good();
+    }
+}
+
+TEST_CASE("Jobs compute checksums and patches", "[job]")
+{
+    std::shared_ptr<const CRC> crc(createCRC32());
+    writeFile("test.txt", 100000);
+
+    auto checksumJob = Job::computeChecksum(crc, "test.txt");
+    auto patchJob = Job::applyPatch(
+        crc, 0x12345678, 500, "test.txt", "test-patched.txt", false);
+    REQUIRE(patchJob->get() == 0x12345678);
+
+    auto input = File::fromFileName(
+        "test.txt", File::Mode::Read | File::Mode::Binary);
+    Progress progress;
+    REQUIRE(checksumJob->get() == crc->computeChecksum(*input, progress));
+    REQUIRE(checksumJob->isDone());
+
+    auto patchedChecksumJob = Job::computeChecksum(crc, "test-patched.txt");
+    REQUIRE(patchedChecksumJob->get() == 0x12345678);
+
+    std::remove("test.txt");
+    std::remove("test-patched.txt");
+}
+
+TEST_CASE("Failed jobs report errors", "[job]")
+{
+    std::shared_ptr<const CRC> crc(createCRC32());
+    auto job = Job::computeChecksum(crc, "nonexistent.txt");
+    REQUIRE_THROWS_AS(job->get(), std::runtime_error);
+}
+
+TEST_CASE("Cancelled patch jobs remove their output", "[job]")
+{
+    std::shared_ptr<const CRC> crc(createCRC32());
+    writeFile("test.txt", 64 << 20);
+
+    auto job = Job::applyPatch(
+        crc, 0x12345678, 0, "test.txt", "test-patched.txt", false);
+    while (job->getChecksumProgress().getPhase() == Progress::Phase::Idle
+        && !job->isDone())
+    {
+        std::this_thread::yield();
+    }
+    job->cancel();
+    REQUIRE_THROWS_AS(job->get(), JobCancelled);
+    REQUIRE(!fileExists("test-patched.txt"));
+
+    std::remove("test.txt");
+}
+
+TEST_CASE("Jobs past their deadline get cancelled", "[job]")
+{
+    std::shared_ptr<const CRC> crc(createCRC32());
+    writeFile("test.txt", 1000);
+
+    CancellationToken token;
+    REQUIRE(!token.isCancelled());
+    token.setDeadline(CancellationToken::Clock::now());
+    REQUIRE(token.isCancelled());
+    REQUIRE_THROWS_AS(token.check(), JobCancelled);
+
+    auto job = Job::applyPatch(
+        crc, 0x12345678, 0, "test.txt", "test-patched.txt", false);
+    job->setDeadline(CancellationToken::Clock::now());
+    try
+    {
+        job->get();
+    }
+    catch (JobCancelled &)
+    {
+        REQUIRE(!fileExists("test-patched.txt"));
+    }
+
+    std::remove("test.txt");
+    std::remove("test-patched.txt");
+}
@@ -49,6 +49,8 @@ TEST_CASE("Manual negative patch insertion position works", "[pos]")
     REQUIRE(shiftUserPosition(-3, 4, 4, false) == 1);
     REQUIRE(shiftUserPosition(-4, 4, 4, false) == 0);
     REQUIRE(shiftUserPosition(-5, 4, 4, false) == 3);
+    REQUIRE(shiftUserPosition(INT64_MIN, 100, 4, false) == 92);
+    REQUIRE_THROWS(shiftUserPosition(-1, 0, 4, false));
 }
 
 TEST_CASE("Manual negative patch overwrite position works", "[pos]")
@@ -60,3 +62,40 @@ TEST_CASE("Manual negative patch overwrite position works", "[pos]")
     REQUIRE(shiftUserPosition(-4, 4, 4, true) == 0);
     REQUIRE_THROWS(shiftUserPosition(-5, 4, 4, true));
 }
+
+TEST_CASE("Scattered patch region validation works", "[pos]")
+{
+    validateRegions({{0, 4, 0xFF}}, 4);
+    validateRegions({{6, 2, 0xFF}, {0, 4, 0x01}}, 8);
+    REQUIRE_THROWS(validateRegions({}, 4));
+    REQUIRE_THROWS(validateRegions({{0, 5, 0xFF}}, 4));
+    REQUIRE_THROWS(validateRegions({{-1, 2, 0xFF}}, 4));
+    REQUIRE_THROWS(validateRegions({{0, 0, 0xFF}}, 4));
+    REQUIRE_THROWS(validateRegions({{0, 2, 0x00}}, 4));
+    REQUIRE_THROWS(validateRegions({{0, 2, 0xFF}, {1, 2, 0xFF}}, 4));
+}
+
+TEST_CASE("Parsing integers works", "[pos]")
+{
+    REQUIRE(parseInteger("position", "-12", 10, INT64_MIN, INT64_MAX) == -12);
+    REQUIRE(parseInteger("poly", "1EDC6F41", 16, 0, 0xFFFFFFFF)
+        == 0x1EDC6F41);
+    REQUIRE_THROWS_AS(
+        parseInteger("position", "", 10, INT64_MIN, INT64_MAX),
+        std::invalid_argument);
+    REQUIRE_THROWS_AS(
+        parseInteger("position", "x", 10, INT64_MIN, INT64_MAX),
+        std::invalid_argument);
+    REQUIRE_THROWS_AS(
+        parseInteger("position", "12x", 10, INT64_MIN, INT64_MAX),
+        std::invalid_argument);
+    REQUIRE_THROWS_AS(
+        parseInteger("poly", "-1", 16, 0, 0xFFFFFFFF),
+        std::invalid_argument);
+    REQUIRE_THROWS_AS(
+        parseInteger("poly", "1FFFFFFFF", 16, 0, 0xFFFFFFFF),
+        std::invalid_argument);
+    REQUIRE_THROWS_AS(
+        parseInteger("position", "99999999999999999999", 10, 0, INT64_MAX),
+        std::invalid_argument);
+}
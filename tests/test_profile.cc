@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <fstream>
+#include "catch.hh"
+#include "lib/crc_factories.h"
+#include "lib/profile.h"
+#include "test_crc_support.h"
+
+namespace
+{
+    void useChunkSize(size_t chunkSize, size_t bufferSize)
+    {
+        Profile profile = getBuiltinProfile();
+        profile.defaults.chunkSize = chunkSize;
+        profile.defaults.bufferSize = bufferSize;
+        setActiveProfile(profile);
+    }
+}
+
+TEST_CASE("Saving and loading profiles works", "[profile]")
+{
+    Profile profile = getBuiltinProfile();
+    profile.defaults.chunkSize = 65536;
+    profile.filesystems[42] = {1 << 20, 1 << 16, 128};
+
+    saveProfile("test.profile", profile);
+    Profile loaded;
+    REQUIRE(loadProfile("test.profile", loaded));
+    REQUIRE(loaded.defaults.chunkSize == 65536);
+    REQUIRE(loaded.filesystems.size() == 1);
+    REQUIRE(loaded.getTuning(42).chunkSize == 1 << 20);
+    REQUIRE(loaded.getTuning(42).bufferSize == 1 << 16);
+    REQUIRE(loaded.getTuning(42).queueDepth == 128);
+    REQUIRE(loaded.getTuning(7).chunkSize == 65536);
+
+    std::remove("test.profile");
+    REQUIRE(!loadProfile("test.profile", loaded));
+}
+
+TEST_CASE("Loading broken profiles fails", "[profile]")
+{
+    {
+        std::ofstream stream("test.profile");
+        stream << "crcmanip-profile 1\ndefault 0 0 64\n";
+    }
+    Profile profile;
+    REQUIRE_THROWS(loadProfile("test.profile", profile));
+    std::remove("test.profile");
+}
+
+TEST_CASE("Loading profiles skips insane settings", "[profile]")
+{
+    {
+        std::ofstream stream("test.profile");
+        stream << "crcmanip-profile 1\n"
+            << "default 1000000000000000000 0 64\n"
+            << "fs 42 65536 65536 64\n"
+            << "fs 43 65536 1 64\n";
+    }
+    Profile profile;
+    REQUIRE(loadProfile("test.profile", profile));
+    REQUIRE(profile.defaults.chunkSize
+        == getBuiltinProfile().defaults.chunkSize);
+    REQUIRE(profile.filesystems.size() == 1);
+    REQUIRE(profile.filesystems.count(42));
+    std::remove("test.profile");
+}
+
+TEST_CASE("Files follow the active profile", "[profile]")
+{
+    {
+        auto f = File::fromFileName("test.txt", File::Mode::Write);
+        f->write("test", 4);
+    }
+
+    useChunkSize(12345, 0);
+    REQUIRE(File::fromFileName("test.txt", File::Mode::Read)
+        ->getChunkSize() == 12345);
+    setActiveProfile(getBuiltinProfile());
+    REQUIRE(File::fromFileName("test.txt", File::Mode::Read)
+        ->getChunkSize() == getBuiltinProfile().defaults.chunkSize);
+
+    std::remove("test.txt");
+}
+
+TEST_CASE("CRC works with odd chunk and buffer sizes", "[profile]")
+{
+    useChunkSize(7, 13);
+    for (auto &crc : createAllCRC())
+    {
+        SECTION(crc->getSpecs().name)
+        {
+            testComputing(*crc, crc->getSpecs().test);
+            testInserting(*crc, crc->getSpecs().test);
+            testOverwriting(*crc, crc->getSpecs().test);
+            testSparsePatching(*crc, crc->getSpecs().test, false);
+        }
+    }
+    setActiveProfile(getBuiltinProfile());
+}
@@ -0,0 +1,70 @@
+#include <vector>
+#include "catch.hh"
+#include "lib/progress.h"
+
+TEST_CASE("Progress handles positions past 4 GiB", "[progress]")
+{
+    const uint64_t max = 10ull << 30;
+    std::vector<double> percentages;
+    Progress progress;
+    progress.changed = [&](double percentage)
+        { percentages.push_back(percentage); };
+
+    progress.start(max, Progress::Phase::Suffix);
+    REQUIRE(progress.getPhase() == Progress::Phase::Suffix);
+    progress.poll();
+    progress.set(max / 2);
+    progress.poll();
+    progress.poll();
+    progress.set(max / 4 * 3);
+    progress.poll();
+    REQUIRE(progress.getCurrent() == max / 4 * 3);
+    progress.finish();
+    REQUIRE(progress.getPhase() == Progress::Phase::Idle);
+    progress.poll();
+
+    REQUIRE(percentages == std::vector<double>({0.0, 50.0, 75.0, 100.0}));
+}
+
+TEST_CASE("Progress observer samples progress", "[progress]")
+{
+    size_t numChanges = 0;
+    double lastPercentage = 0.0;
+    Progress progress;
+    progress.changed = [&](double percentage)
+    {
+        numChanges++;
+        lastPercentage = percentage;
+    };
+
+    {
+        ProgressObserver observer({&progress}, std::chrono::milliseconds(1));
+        progress.start(1000, Progress::Phase::Copy);
+        for (uint64_t i = 0; i < 1000; i++)
+            progress.set(i);
+        progress.finish();
+    }
+
+    REQUIRE(numChanges >= 1);
+    REQUIRE(lastPercentage == 100.0);
+}
+
+TEST_CASE("Progress records time and bytes of each phase", "[progress]")
+{
+    Progress progress;
+    progress.start(100, Progress::Phase::Prefix);
+    progress.finish();
+    progress.start(200, Progress::Phase::Suffix);
+    progress.finish();
+    progress.start(300, Progress::Phase::Prefix);
+    progress.finish();
+
+    auto prefix = progress.getPhaseStats(Progress::Phase::Prefix);
+    REQUIRE(prefix.bytes == 400);
+    REQUIRE(prefix.numRuns == 2);
+    REQUIRE(prefix.seconds >= 0.0);
+    auto suffix = progress.getPhaseStats(Progress::Phase::Suffix);
+    REQUIRE(suffix.bytes == 200);
+    REQUIRE(suffix.numRuns == 1);
+    REQUIRE(progress.getPhaseStats(Progress::Phase::Copy).numRuns == 0);
+}
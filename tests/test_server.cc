@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "catch.hh"
+#include "lib/crc_factories.h"
+#include "lib/server.h"
+
+namespace
+{
+    const char *SocketPath = "test-server.sock";
+
+    void writeFile(const std::string &path, size_t size)
+    {
+        auto f = File::fromFileName(
+            path, File::Mode::Write | File::Mode::Binary);
+        std::string content(size, 0);
+        for (size_t i = 0; i < size; i++)
+            content[i] = static_cast<char>(i * 31 + (i >> 12));
+        f->write(content.data(), content.size());
+    }
+
+    CRC::Value computeFileChecksum(const CRC &crc, const std::string &path)
+    {
+        auto file = File::fromFileName(
+            path, File::Mode::Read | File::Mode::Binary);
+        Progress progress;
+        return crc.computeChecksum(*file, progress);
+    }
+
+    /**
+     * Skips progress reports.
+     */
+    std::vector<std::string> receiveResult(ServerClient &client)
+    {
+        while (true)
+        {
+            auto fields = client.receive();
+            if (fields.size() < 2 || fields[1] != "progress")
+                return fields;
+        }
+    }
+
+    class RunningServer final
+    {
+        public:
+            RunningServer(size_t maxActiveJobs = 0)
+                : server(SocketPath, maxActiveJobs),
+                    thread(&Server::run, &server)
+            {
+            }
+
+            ~RunningServer()
+            {
+                server.stop();
+                thread.join();
+            }
+
+        private:
+            Server server;
+            std::thread thread;
+    };
+}
+
+TEST_CASE("Server messages survive being split", "[server]")
+{
+    auto message = encodeMessage({"1", "calc", "", "a b"})
+        + encodeMessage({"2"});
+    std::string buffer;
+    std::vector<std::string> fields;
+    for (size_t i = 0; i < 8; i++)
+    {
+        buffer.push_back(message[i]);
+        REQUIRE(!decodeMessage(buffer, fields));
+    }
+    buffer += message.substr(8);
+    REQUIRE(decodeMessage(buffer, fields));
+    REQUIRE(fields == std::vector<std::string>({"1", "calc", "", "a b"}));
+    REQUIRE(decodeMessage(buffer, fields));
+    REQUIRE(fields == std::vector<std::string>({"2"}));
+    REQUIRE(buffer.empty());
+
+    buffer = std::string("\xFF\xFF\xFF\x7F", 4);
+    REQUIRE_THROWS_AS(decodeMessage(buffer, fields), std::runtime_error);
+}
+
+TEST_CASE("Server computes checksums and patches", "[server]")
+{
+    auto crc = createCRC32();
+    writeFile("test.txt", 100000);
+    RunningServer server;
+    ServerClient client(SocketPath);
+
+    client.send({"a", "calc", "CRC32", "test.txt"});
+    client.send({
+        "b", "patch", "CRC16IBM", "test.txt", "test-patched.txt",
+        "beef", "-4", "overwrite", "verify"});
+    client.send({"c", "calc", "CRC32", "test.txt"});
+
+    auto expected = computeFileChecksum(*crc, "test.txt");
+    std::vector<std::vector<std::string>> results;
+    for (size_t i = 0; i < 3; i++)
+        results.push_back(receiveResult(client));
+    std::sort(results.begin(), results.end());
+
+    char expectedText[9];
+    std::snprintf(
+        expectedText, sizeof(expectedText), "%08X",
+        static_cast<unsigned>(expected));
+    REQUIRE(results[0] == std::vector<std::string>({"a", "ok", expectedText}));
+    REQUIRE(results[1] == std::vector<std::string>({"b", "ok", "BEEF"}));
+    REQUIRE(results[2] == std::vector<std::string>({"c", "ok", expectedText}));
+
+    auto crc16 = createCRC16IBM();
+    REQUIRE(computeFileChecksum(*crc16, "test-patched.txt") == 0xBEEF);
+    auto patched = File::fromFileName(
+        "test-patched.txt", File::Mode::Read | File::Mode::Binary);
+    REQUIRE(patched->getSize() == 100000);
+
+    std::remove("test.txt");
+    std::remove("test-patched.txt");
+}
+
+TEST_CASE("Server reports bad requests", "[server]")
+{
+    RunningServer server;
+    ServerClient client(SocketPath);
+
+    client.send({"1", "calc", "CRC99", "test.txt"});
+    REQUIRE(receiveResult(client)[1] == "error");
+    client.send({"2", "calc", "CRC32", "nonexistent.txt"});
+    REQUIRE(receiveResult(client)[1] == "error");
+    client.send({"3", "frobnicate"});
+    REQUIRE(receiveResult(client)[1] == "error");
+    client.send({"4"});
+    REQUIRE(receiveResult(client)[1] == "error");
+
+    writeFile("test.txt", 100);
+    client.send({
+        "5", "patch", "CRC32", "test.txt", "test-patched.txt",
+        "12345678", "x", "insert"});
+    REQUIRE(receiveResult(client)
+        == std::vector<std::string>({"5", "error", "Invalid position: x"}));
+    client.send({
+        "6", "patch", "CRC32", "test.txt", "test-patched.txt",
+        "12345678", "-9223372036854775807", "overwrite"});
+    REQUIRE(receiveResult(client)
+        == std::vector<std::string>({"6", "ok", "12345678"}));
+    std::remove("test.txt");
+    std::remove("test-patched.txt");
+
+    REQUIRE_THROWS_AS(Server(SocketPath), std::runtime_error);
+}
+
+TEST_CASE("Server lets clients take turns", "[server]")
+{
+    const size_t NumRequests = 6;
+    writeFile("test.txt", 16 << 20);
+    writeFile("test-small.txt", 100);
+    RunningServer server(1);
+    ServerClient busyClient(SocketPath);
+    ServerClient otherClient(SocketPath);
+
+    for (size_t i = 0; i < NumRequests; i++)
+        busyClient.send({std::to_string(i), "calc", "CRC32", "test.txt"});
+    otherClient.send({"x", "calc", "CRC32", "test-small.txt"});
+
+    std::chrono::steady_clock::time_point lastBusyResult;
+    std::thread busyReader([&]()
+    {
+        for (size_t i = 0; i < NumRequests; i++)
+            receiveResult(busyClient);
+        lastBusyResult = std::chrono::steady_clock::now();
+    });
+    REQUIRE(receiveResult(otherClient)[1] == "ok");
+    auto otherResult = std::chrono::steady_clock::now();
+    busyReader.join();
+    REQUIRE(otherResult < lastBusyResult);
+
+    std::remove("test.txt");
+    std::remove("test-small.txt");
+}
+
+TEST_CASE("Server answers clients that are done sending", "[server]")
+{
+    const size_t NumRequests = 2000;
+    writeFile("test.txt", 100);
+    RunningServer server(1);
+    ServerClient client(SocketPath);
+
+    for (size_t i = 0; i < NumRequests; i++)
+        client.send({std::to_string(i), "calc", "CRC32", "test.txt"});
+    client.finishSending();
+
+    std::vector<bool> answered(NumRequests);
+    for (size_t i = 0; i < NumRequests; i++)
+    {
+        auto result = receiveResult(client);
+        REQUIRE(result[1] == "ok");
+        answered[std::stoul(result[0])] = true;
+    }
+    REQUIRE(std::count(answered.begin(), answered.end(), true)
+        == static_cast<long>(NumRequests));
+    REQUIRE_THROWS_AS(client.receive(), std::runtime_error);
+
+    std::remove("test.txt");
+}
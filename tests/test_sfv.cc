@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "catch.hh"
+#include "lib/crc_factories.h"
+#include "lib/sfv.h"
+
+namespace
+{
+    void writeFile(const std::string &path, size_t size)
+    {
+        auto f = File::fromFileName(
+            path, File::Mode::Write | File::Mode::Binary);
+        std::string content(size, 0);
+        for (size_t i = 0; i < size; i++)
+            content[i] = static_cast<char>(i * 31 + (i >> 12));
+        f->write(content.data(), content.size());
+    }
+
+    CRC::Value computeChecksum(const CRC &crc, const std::string &path)
+    {
+        Progress progress;
+        auto f = File::fromFileName(
+            path, File::Mode::Read | File::Mode::Binary);
+        return crc.computeChecksum(*f, progress);
+    }
+}
+
+TEST_CASE("SFV lists survive writing and reading", "[sfv]")
+{
+    std::istringstream input(
+        "; comment\r\n"
+        "\r\n"
+        "file one.rar 0123ABCD\r\n"
+        "  b.r00\tdeadbeef  \r\n");
+    auto entries = readSfv(input);
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries[0].path == "file one.rar");
+    REQUIRE(entries[0].checksum == 0x0123ABCD);
+    REQUIRE(entries[1].path == "b.r00");
+    REQUIRE(entries[1].checksum == 0xDEADBEEF);
+
+    std::ostringstream output;
+    writeSfv(output, entries);
+    REQUIRE(output.str() == "file one.rar 0123ABCD\nb.r00 DEADBEEF\n");
+
+    std::istringstream invalid("file.rar 12345678\nfile.r00 xyz\n");
+    REQUIRE_THROWS_AS(readSfv(invalid), std::runtime_error);
+    std::istringstream missing("file.rar\n");
+    REQUIRE_THROWS_AS(readSfv(missing), std::runtime_error);
+}
+
+TEST_CASE("File checksums come biggest first", "[sfv]")
+{
+    std::shared_ptr<const CRC> crc(createCRC32());
+    std::vector<std::string> paths = {
+        "test-1.txt", "test-3.txt", "nonexistent.txt", "test-2.txt"};
+    writeFile("test-1.txt", 1000);
+    writeFile("test-2.txt", 2000);
+    writeFile("test-3.txt", 3000);
+
+    std::vector<size_t> indices;
+    std::vector<FileChecksum> results;
+    computeFileChecksums(
+        crc, paths, 1, nullptr,
+        [&](size_t index, const FileChecksum &result)
+        {
+            indices.push_back(index);
+            results.push_back(result);
+            return true;
+        });
+    REQUIRE(indices == std::vector<size_t>({2, 1, 3, 0}));
+    REQUIRE(!results[0].error.empty());
+    for (size_t i = 1; i < indices.size(); i++)
+    {
+        REQUIRE(results[i].error.empty());
+        REQUIRE(results[i].checksum
+            == computeChecksum(*crc, paths[indices[i]]));
+    }
+
+    indices.clear();
+    computeFileChecksums(
+        crc, paths, 1, nullptr,
+        [&](size_t index, const FileChecksum &)
+        {
+            indices.push_back(index);
+            return false;
+        });
+    REQUIRE(indices == std::vector<size_t>({2}));
+
+    std::remove("test-1.txt");
+    std::remove("test-2.txt");
+    std::remove("test-3.txt");
+}
+
+TEST_CASE("File checksums reuse saved states", "[sfv]")
+{
+    std::shared_ptr<const CRC> crc(createCRC32());
+    std::vector<std::string> paths = {"test-1.txt", "test-2.txt"};
+    writeFile("test-1.txt", 1 << 20);
+    writeFile("test-2.txt", 1 << 20);
+
+    auto run = [&](std::map<std::string, ChecksumState> &states)
+    {
+        std::vector<CRC::Value> checksums(paths.size());
+        auto bytesRead = File::getStats().bytesRead;
+        computeFileChecksums(
+            crc, paths, 2, &states,
+            [&](size_t index, const FileChecksum &result)
+            {
+                checksums[index] = result.checksum;
+                return true;
+            });
+        bytesRead = File::getStats().bytesRead - bytesRead;
+        for (size_t i = 0; i < paths.size(); i++)
+            REQUIRE(checksums[i] == computeChecksum(*crc, paths[i]));
+        return bytesRead;
+    };
+
+    std::map<std::string, ChecksumState> states;
+    REQUIRE(run(states) >= 2u << 20);
+    REQUIRE(states.size() == 2);
+    saveChecksumStates("test.state", states);
+
+    //unchanged files are read whole, in case the middle changed
+    std::map<std::string, ChecksumState> loaded;
+    REQUIRE(loadChecksumStates("test.state", loaded));
+    REQUIRE(run(loaded) >= 2u << 20);
+
+    {
+        std::fstream f("test-1.txt",
+            std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(1 << 19);
+        f.put('x');
+    }
+    REQUIRE(run(loaded) >= 2u << 20);
+
+    for (auto &path : paths)
+        std::ofstream(path, std::ios::app | std::ios::binary) << "appended";
+    REQUIRE(run(loaded) < 1u << 20);
+
+    std::remove("test-2.txt");
+    paths.push_back("test-1.txt");
+    REQUIRE_NOTHROW(computeFileChecksums(
+        crc, paths, 3, &loaded,
+        [&](size_t, const FileChecksum &) { return true; }));
+    REQUIRE(loaded.count("test-1.txt"));
+    REQUIRE(!loaded.count("test-2.txt"));
+
+    std::remove("test-1.txt");
+    std::remove("test.state");
+}
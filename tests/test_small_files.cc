@@ -0,0 +1,45 @@
+#include <cstdio>
+#include <string>
+#include "catch.hh"
+#include "lib/file.h"
+#include "lib/small_files.h"
+
+namespace
+{
+    void writeFile(const std::string &path, const std::string &content)
+    {
+        auto f = File::fromFileName(
+            path, File::Mode::Write | File::Mode::Binary);
+        f->write(content.data(), content.size());
+    }
+}
+
+TEST_CASE("Reading small files works", "[small_files]")
+{
+    const size_t maxSize = 4096;
+    std::vector<std::string> paths;
+    std::vector<std::string> contents;
+    for (size_t i = 0; i < 150; i++)
+    {
+        paths.push_back("test-small-" + std::to_string(i) + ".bin");
+        contents.push_back(std::string(i * 29 % (maxSize + 1), 'a' + i % 26));
+        writeFile(paths.back(), contents.back());
+    }
+    paths.push_back("test-small-big.bin");
+    writeFile(paths.back(), std::string(maxSize + 1, 'x'));
+    paths.push_back("test-small-missing.bin");
+
+    auto files = readSmallFiles(paths, maxSize);
+    REQUIRE(files.size() == paths.size());
+    for (size_t i = 0; i < contents.size(); i++)
+    {
+        REQUIRE(files[i].status == SmallFile::Status::Read);
+        REQUIRE(std::string(files[i].content.begin(), files[i].content.end())
+            == contents[i]);
+    }
+    REQUIRE(files[150].status == SmallFile::Status::TooBig);
+    REQUIRE(files[151].status == SmallFile::Status::Failed);
+
+    for (auto &path : paths)
+        std::remove(path.c_str());
+}